@@ -0,0 +1,105 @@
+# Measures the builds of the executables of this example in a separate build tree,
+# one target at a time with a single job:
+# - the full build of each executable
+# - the rebuild after a change to one translation unit that uses the JSON parser
+# - the size of each executable, and the size of its text section if `size` is found
+#
+# Run through the target `grammar_build_benchmark`, or directly with
+#   cmake -DSOURCE_DIR=<anpa> -DBINARY_DIR=<dir> [-DBUILD_TYPE=Release] -P build_benchmark.cmake
+
+cmake_minimum_required(VERSION 3.23) # For microseconds in string(TIMESTAMP)
+
+if(NOT SOURCE_DIR OR NOT BINARY_DIR)
+    message(FATAL_ERROR "SOURCE_DIR and BINARY_DIR are required")
+endif()
+if(NOT BUILD_TYPE)
+    set(BUILD_TYPE Release)
+endif()
+
+set(TARGETS header_grammar precompiled_grammar rule_grammar)
+set(CHANGED_SOURCE count_members)
+
+set(configure_args -S ${SOURCE_DIR} -B ${BINARY_DIR} -DBUILD_EXAMPLES=ON -DCMAKE_BUILD_TYPE=${BUILD_TYPE})
+if(CXX_COMPILER)
+    list(APPEND configure_args -DCMAKE_CXX_COMPILER=${CXX_COMPILER})
+endif()
+if(CXX_FLAGS)
+    list(APPEND configure_args "-DCMAKE_CXX_FLAGS=${CXX_FLAGS}")
+endif()
+
+file(REMOVE_RECURSE ${BINARY_DIR})
+execute_process(COMMAND ${CMAKE_COMMAND} ${configure_args} OUTPUT_QUIET RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "Configuring ${BINARY_DIR} failed")
+endif()
+
+# Build `target`, and set `seconds` to the time it took
+function(timed_build target seconds)
+    string(TIMESTAMP start "%s%f" UTC)
+    execute_process(COMMAND ${CMAKE_COMMAND} --build ${BINARY_DIR} --target ${target} --parallel 1
+                    OUTPUT_QUIET RESULT_VARIABLE result)
+    string(TIMESTAMP end "%s%f" UTC)
+    if(result)
+        message(FATAL_ERROR "Building ${target} failed")
+    endif()
+    math(EXPR centiseconds "(${end} - ${start}) / 10000")
+    math(EXPR whole "${centiseconds} / 100")
+    math(EXPR fraction "${centiseconds} % 100")
+    if(fraction LESS 10)
+        set(fraction "0${fraction}")
+    endif()
+    set(${seconds} "${whole}.${fraction}" PARENT_SCOPE)
+endfunction()
+
+# Pad `value` with spaces to `width` characters
+function(pad value width out)
+    string(LENGTH "${value}" length)
+    while(length LESS width)
+        string(APPEND value " ")
+        math(EXPR length "${length} + 1")
+    endwhile()
+    set(${out} "${value}" PARENT_SCOPE)
+endfunction()
+
+find_program(SIZE_TOOL size)
+
+pad("target" 22 line)
+string(APPEND line "build (s)   rebuild one TU (s)   size (KB)   text (KB)")
+set(report "${line}")
+
+foreach(target ${TARGETS})
+    timed_build(${target} build_time)
+
+    file(GLOB_RECURSE objects "${BINARY_DIR}/*${CHANGED_SOURCE}*")
+    list(FILTER objects INCLUDE REGEX "/${target}\\.dir/(.*/)?${CHANGED_SOURCE}[^/]*\\.(o|obj)$")
+    if(NOT objects)
+        message(FATAL_ERROR "The object file of ${CHANGED_SOURCE} for ${target} was not found")
+    endif()
+    file(REMOVE ${objects})
+    timed_build(${target} rebuild_time)
+
+    file(GLOB_RECURSE executable "${BINARY_DIR}/${target}" "${BINARY_DIR}/${target}.exe")
+    list(FILTER executable EXCLUDE REGEX "/CMakeFiles/")
+    list(GET executable 0 executable)
+    file(SIZE ${executable} size)
+    math(EXPR size_kb "${size} / 1024")
+
+    set(text_kb "-")
+    if(SIZE_TOOL)
+        execute_process(COMMAND ${SIZE_TOOL} ${executable} OUTPUT_VARIABLE size_output RESULT_VARIABLE result)
+        if(NOT result AND size_output MATCHES "\n[ \t]*([0-9]+)")
+            math(EXPR text_kb "${CMAKE_MATCH_1} / 1024")
+        endif()
+    endif()
+
+    pad("${target}" 22 line)
+    pad("${build_time}" 12 column)
+    string(APPEND line "${column}")
+    pad("${rebuild_time}" 21 column)
+    string(APPEND line "${column}")
+    pad("${size_kb}" 12 column)
+    string(APPEND line "${column}${text_kb}")
+    string(APPEND report "\n${line}")
+endforeach()
+
+message("${report}")
@@ -0,0 +1,6 @@
+#include "json_users.h"
+
+std::size_t count_array_items(const std::vector<char>& document) {
+    auto res = JSON_PARSER.parse(document);
+    return res.second && res.second->is_a<json_array>() ? res.second->get<json_array>().size() : 0;
+}
@@ -0,0 +1,9 @@
+#include "anpa/combinators.h"
+#include "anpa/parsers.h"
+#include "json_users.h"
+
+std::size_t count_documents(std::string_view lines) {
+    using namespace anpa;
+    auto res = many_to_vector(JSON_PARSER, item<'\n'>()).parse(lines);
+    return res.second ? res.second->size() : 0;
+}
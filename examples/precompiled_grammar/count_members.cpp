@@ -0,0 +1,6 @@
+#include "json_users.h"
+
+std::size_t count_members(const std::string& document) {
+    auto res = JSON_PARSER.parse(document);
+    return res.second && res.second->is_a<json_object>() ? res.second->get<json_object>().size() : 0;
+}
@@ -0,0 +1,5 @@
+#include "json_users.h"
+
+bool is_valid(std::string_view document) {
+    return anpa::validate(JSON_PARSER, document).second;
+}
@@ -0,0 +1,4 @@
+#include "json_parser.h"
+#include "json_grammar.h"
+
+ANPA_DEFINE_PARSER(json, json_parser)
@@ -0,0 +1,10 @@
+#ifndef JSON_GRAMMAR_H
+#define JSON_GRAMMAR_H
+
+#include "json_value.h"
+#include "anpa/declare.h"
+
+// The JSON parser, defined in json_grammar.cpp
+ANPA_DECLARE_PARSER(json, const char*, json_value)
+
+#endif // JSON_GRAMMAR_H
@@ -0,0 +1,4 @@
+#include "json_parser.h"
+#include "json_rule.h"
+
+anpa::rule<const char*, json_value> json_rule = json_parser;
@@ -0,0 +1,10 @@
+#ifndef JSON_RULE_H
+#define JSON_RULE_H
+
+#include "json_value.h"
+#include "anpa/rule.h"
+
+// The JSON parser as a rule, defined in json_rule.cpp
+extern anpa::rule<const char*, json_value> json_rule;
+
+#endif // JSON_RULE_H
@@ -0,0 +1,28 @@
+#ifndef JSON_USERS_H
+#define JSON_USERS_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Each function is defined in its own translation unit, that uses the JSON parser
+// through its declaration (json_grammar.h), through a rule (json_rule.h), or through
+// its definition (json_parser.h).
+#if defined(PRECOMPILED_GRAMMAR)
+#include "json_grammar.h"
+#define JSON_PARSER json
+#elif defined(RULE_GRAMMAR)
+#include "json_rule.h"
+#define JSON_PARSER json_rule
+#else
+#include "json_parser.h"
+#define JSON_PARSER json_parser
+#endif
+
+std::size_t count_members(const std::string& document);
+bool is_valid(std::string_view document);
+std::size_t count_documents(std::string_view lines);
+std::size_t count_array_items(const std::vector<char>& document);
+
+#endif // JSON_USERS_H
@@ -0,0 +1,19 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include "json_users.h"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <file.json>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(argv[1]);
+    std::string document((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::cout << "valid: " << is_valid(document) << '\n'
+              << "members: " << count_members(document) << '\n'
+              << "array items: " << count_array_items(std::vector<char>(document.begin(), document.end())) << '\n'
+              << "documents: " << count_documents("[1]\n{\"a\": 2}\n\"3\"") << std::endl;
+}
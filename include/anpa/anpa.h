@@ -8,5 +8,13 @@
 #include "anpa/core.h"
 #include "anpa/combinators.h"
 #include "anpa/parsers.h"
+#include "anpa/grammar.h"
+#include "anpa/runtime_grammar.h"
+#include "anpa/rule.h"
+#include "anpa/declare.h"
+#include "anpa/padded_string.h"
+#include "anpa/structural_index.h"
+#include "anpa/parallel.h"
+#include "anpa/pipeline.h"
 
 #endif // TOKEN_PARSIMON_H
@@ -6,6 +6,7 @@
 #include <map>
 #include <vector>
 #include <memory>
+#include <limits>
 #include "anpa/core.h"
 #include "anpa/monad.h"
 #include "anpa/internal/combinators_internal.h"
@@ -22,23 +23,28 @@ namespace anpa {
  */
 template <options Options = options::none, typename Parser>
 inline constexpr auto succeed(Parser p) {
-    return parser([=](auto& s) {
-        if constexpr (has_options(Options, options::optional)) {
-            using optional_type = std::optional<std::decay_t<decltype(*apply(p, s))>>;
-            if (auto&& result = apply(p, s)) {
-                return s.template return_success_emplace<optional_type>(*std::forward<decltype(result)>(result));
-            } else {
-                return s.template return_success_emplace<optional_type>();
-            }
+    using first = internal::first_nullable<internal::first_of_parser<Parser>>;
+    return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            recognize(p, s);
+            return true;
         } else {
-            if (apply(p, s)) {
-                return s.return_success(true);
+            if constexpr (has_options(Options, options::optional)) {
+                using optional_type = std::optional<std::decay_t<decltype(*apply(p, s))>>;
+                if (auto&& result = apply(p, s)) {
+                    return s.template return_success_emplace<optional_type>(*std::forward<decltype(result)>(result));
+                } else {
+                    return s.template return_success_emplace<optional_type>();
+                }
             } else {
-                return s.return_success(false);
+                if (recognize(p, s)) {
+                    return s.return_success(true);
+                } else {
+                    return s.return_success(false);
+                }
             }
         }
-
-    });
+    }));
 }
 
 /**
@@ -47,9 +53,13 @@ inline constexpr auto succeed(Parser p) {
  */
 template <typename Parser>
 inline constexpr auto flip(Parser p) {
-    return parser([=](auto& s) {
-        return apply(p, s) ? s.template return_fail<empty_result>() : s.template return_success_emplace<empty_result>();
-    });
+    return parser(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return !recognize(p, s);
+        } else {
+            return apply(p, s) ? s.template return_fail<empty_result>() : s.template return_success_emplace<empty_result>();
+        }
+    }));
 }
 
 /**
@@ -59,9 +69,14 @@ inline constexpr auto flip(Parser p) {
  */
 template <typename Size, typename Parser>
 inline constexpr auto times(Size&& n, Parser p) {
-    return parser([n = std::forward<Size>(n), p](auto& s) {
-        return internal::times(s, n, p);
-    });
+    using first = internal::first_nullable<internal::first_of_parser<Parser>>;
+    return internal::with_first<first>(internal::with_recognizer([n = std::forward<Size>(n), p](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return internal::times_recognize(s, n, p);
+        } else {
+            return internal::times(s, n, p);
+        }
+    }));
 }
 
 /**
@@ -72,9 +87,14 @@ inline constexpr auto times(Size&& n, Parser p) {
  */
 template <size_t N, typename Parser>
 inline constexpr auto times(Parser p) {
-    return parser([=](auto& s) {
-        return internal::times(s, N, p);
-    });
+    using first = std::conditional_t<N == 0, internal::first_nothing, internal::first_of_parser<Parser>>;
+    return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return internal::times_recognize(s, N, p);
+        } else {
+            return internal::times(s, N, p);
+        }
+    }));
 }
 
 /**
@@ -84,7 +104,7 @@ inline constexpr auto times(Parser p) {
  */
 template <typename Error, typename Parser>
 inline constexpr auto change_error(Error&& error, Parser p) {
-    return parser([error = std::forward<Error>(error), p](auto& s) {
+    return internal::with_first<internal::first_of_parser<Parser>>([error = std::forward<Error>(error), p](auto& s) {
         if (auto result = apply(p, s)) {
             return result;
         } else {
@@ -103,14 +123,23 @@ inline constexpr auto change_error(Error&& error, Parser p) {
  */
 template <options Options = options::none, typename Parser>
 inline constexpr auto no_consume(Parser p) {
-    return parser([=](auto& s) {
-        auto old_position = s.position;
-        auto result = apply(p, s);
-        if (!has_options(Options, options::failure_only) || !result) {
-            s.set_position(old_position);
+    return internal::with_first<internal::first_of_parser<Parser>>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            auto old_position = s.position;
+            bool success = recognize(p, s);
+            if (!has_options(Options, options::failure_only) || !success) {
+                s.set_position(old_position);
+            }
+            return success;
+        } else {
+            auto old_position = s.position;
+            auto result = apply(p, s);
+            if (!has_options(Options, options::failure_only) || !result) {
+                s.set_position(old_position);
+            }
+            return result;
         }
-        return result;
-    });
+    }));
 }
 
 /**
@@ -132,7 +161,7 @@ inline constexpr auto try_parser(Parser p) {
  */
 template <typename Predicate, typename Parser>
 inline constexpr auto constrain(Predicate pred, Parser p) {
-    return parser([=](auto& s) {
+    return internal::with_first<internal::first_of_parser<Parser>>([=](auto& s) {
         if (auto result = apply(p, s); !result || pred(*result)) {
             return result;
         } else {
@@ -163,9 +192,14 @@ inline constexpr auto not_empty(Parser p) {
 template <typename... Parsers>
 inline constexpr auto get_parsed(Parsers... ps) {
     types::assert_parsers_not_empty<Parsers...>();
-    return parser([=](auto& s) {
-        return internal::get_parsed_recursive(s, s.position, ps...);
-    });
+    using first = internal::first_sequence<internal::first_of_parser<Parsers>...>;
+    return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return (recognize(ps, s) && ...);
+        } else {
+            return internal::get_parsed_recursive(s, s.position, ps...);
+        }
+    }));
 }
 
 /**
@@ -180,46 +214,72 @@ inline constexpr auto operator+(parser<P1> p1, parser<P2> p2) {
 /**
  * Combine two parsers so that the second will be tried before failing.
  * If the two parsers return different types the return value will instead be `empty_result`.
+ *
+ * A parser whose first set (see `first_of`) excludes the next item is not tried, and the
+ * combined parser begins with the union of the two sets.
  */
 template <bool FailOnPartial = false, typename P1, typename P2>
 inline constexpr auto operator||(parser<P1> p1, parser<P2> p2) {
-    return parser([=](auto& s) {
-        using R1 = decltype(*apply(p1, s));
-        using R2 = decltype(*apply(p2, s));
+    using first = internal::first_alternatives<internal::first_of_parser<P1>, internal::first_of_parser<P2>>;
+    using first1 = internal::first_of_parser<P1>;
+    using first2 = internal::first_of_parser<P2>;
+    return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            auto original_position = s.position;
+            if (first1::value.is_unknown() || first1::value.accepts(s)) {
+                if (recognize(p1, s)) return true;
+                if (FailOnPartial && s.position != original_position) return false;
+                s.set_position(original_position);
+            }
+            if constexpr (!first2::value.is_unknown()) {
+                if (!first2::value.accepts(s)) return false;
+            }
+            return recognize(p2, s);
+        } else {
+            using R1 = decltype(*apply(p1, s));
+            using R2 = decltype(*apply(p2, s));
 
-        auto original_position = s.position;
+            auto original_position = s.position;
 
-        constexpr bool is_same = std::is_same_v<R1, R2>;
-        auto return_success = [&s](auto&& result) {
-            if constexpr (is_same) {
-                return std::forward<decltype(result)>(result);
-            } else {
-                return s.template return_success_emplace<empty_result>();
-            }
-        };
+            constexpr bool is_same = std::is_same_v<R1, R2>;
+            auto return_success = [&s](auto&& result) {
+                if constexpr (is_same) {
+                    return std::forward<decltype(result)>(result);
+                } else {
+                    return s.template return_success_emplace<empty_result>();
+                }
+            };
 
-        auto return_fail = [&s](auto&& result) {
-            if constexpr (is_same) {
-                return std::forward<decltype(result)>(result);
-            } else {
-                return s.template return_fail_change_result<empty_result>(result);
-            }
-        };
+            auto return_fail = [&s](auto&& result) {
+                if constexpr (is_same) {
+                    return std::forward<decltype(result)>(result);
+                } else {
+                    return s.template return_fail_change_result<empty_result>(result);
+                }
+            };
 
-        if (auto&& result1 = apply(p1, s)) {
-                return return_success(std::forward<decltype(result1)>(result1));
-        } else {
-            if constexpr (FailOnPartial) {
-                if (s.position != original_position) {
-                    return return_fail(std::forward<decltype(result1)>(result1));
+            if (first1::value.is_unknown() || first1::value.accepts(s)) {
+                if (auto&& result1 = apply(p1, s)) {
+                    return return_success(std::forward<decltype(result1)>(result1));
+                } else {
+                    if constexpr (FailOnPartial) {
+                        if (s.position != original_position) {
+                            return return_fail(std::forward<decltype(result1)>(result1));
+                        }
+                    }
+                    s.set_position(original_position);
+                    if constexpr (!first2::value.is_unknown()) {
+                        // The second parser cannot match either, so the failure is final
+                        if (!first2::value.accepts(s)) return return_fail(std::forward<decltype(result1)>(result1));
+                    }
                 }
             }
-            s.set_position(original_position);
+
             auto&& result2 = apply(p2, s);
             return result2 ? return_success(std::forward<decltype(result2)>(result2))
                            : return_fail(std::forward<decltype(result2)>(result2));
         }
-    });
+    }));
 }
 
 /**
@@ -257,7 +317,7 @@ inline constexpr auto with_state(Fn f) {
  */
 template <typename Fn>
 inline constexpr auto modify_state(Fn f) {
-    return parser([=](auto& s) {
+    return internal::with_first<internal::first_nothing>([=](auto& s) {
         using result_type = decltype(f(s.user_state));
         if constexpr (std::is_void_v<result_type>) {
             f(s.user_state);
@@ -279,17 +339,18 @@ inline constexpr auto modify_state(Fn f) {
 template <typename Fn, typename... Parsers>
 inline constexpr auto apply_to_state(Fn f, Parsers...ps) {
     types::assert_parsers_not_empty<Parsers...>();
-    return parser([=](auto& s) {
+    using first = internal::first_sequence<internal::first_of_parser<Parsers>...>;
+    return internal::with_first<first>([=](auto& s) {
         types::assert_functor_application_modify<decltype(s), Fn, decltype((s.user_state)), Parsers...>();
 
-        auto to_apply = [f, &state = s.user_state] (auto&&... vals) {
+        auto to_apply = [&f, &state = s.user_state] (auto&&... vals) {
             if constexpr (std::is_void_v<decltype(f(state, std::forward<decltype(vals)>(vals)...))>) {
                 f(state, std::forward<decltype(vals)>(vals)...);
             } else {
                 return f(state, std::forward<decltype(vals)>(vals)...);
             }
         };
-        return apply(lift(to_apply, ps...), s);
+        return internal::lift_apply(s, internal::lift_function(to_apply), ps...);
     });
 }
 
@@ -318,26 +379,30 @@ template <options Options = options::none,
 inline constexpr auto many_to_vector(Parser p,
                                      ParserSep separator = {},
                                      Inserter inserter = {}) {
-    return parser([=](auto& s) {
-        using result_type = std::decay_t<decltype(*apply(p, s))>;
-        auto ins = internal::default_arg(inserter, [](auto& v, auto&& rs) {
-            v.push_back(std::forward<decltype(rs)>(rs));
-        });
+    return internal::with_first<internal::first_many<Options, Parser>>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return internal::many_recognize<Options>(s, separator, p);
+        } else {
+            using result_type = std::decay_t<decltype(*apply(p, s))>;
+            auto ins = internal::default_arg(inserter, [](auto& v, auto&& rs) {
+                v.push_back(std::forward<decltype(rs)>(rs));
+            });
 
-        using vector_type = std::vector<result_type>;
+            using vector_type = std::vector<result_type>;
 
-        types::assert_functor_application_modify<decltype(s), decltype(ins), vector_type, Parser>();
+            types::assert_functor_application_modify<decltype(s), decltype(ins), vector_type, Parser>();
 
-        auto init = []() {
-            if constexpr (Reserve > 0) {
-                return [](auto& v) {v.reserve(Reserve);};
-            } else {
-                return no_arg();
-            }
-        }();
+            auto init = []() {
+                if constexpr (Reserve > 0) {
+                    return [](auto& v) {v.reserve(Reserve);};
+                } else {
+                    return no_arg();
+                }
+            }();
 
-        return internal::fold_internal<Options>(s, init, ins, vector_type{}, separator, p);
-    });
+            return internal::fold_internal<Options>(s, init, ins, vector_type{}, separator, p);
+        }
+    }));
 }
 
 /**
@@ -376,23 +441,27 @@ template <size_t Size,
           typename ParserSep = no_arg>
 inline constexpr auto many_to_array(Parser p,
                                     ParserSep separator = {}) {
-    return parser([=](auto& s) {
-        using result_type = std::decay_t<decltype(*apply(p, s))>;
-        std::array<result_type, Size> arr{};
-        size_t i = 0;
-        auto result = internal::many_internal<Options>(s, [&arr, &i](auto&& res) {
-            arr[i++] = std::forward<decltype(res)>(res);
-        }, separator, p);
-
-        using parse_result = std::pair<std::array<result_type, Size>, size_t>;
-
-        if constexpr (types::has_arg<ParserSep> && has_options(Options, options::no_trailing_separator)) {
-            if (!result) {
-                return s.template return_fail_change_result<parse_result>(result);
+    return internal::with_first<internal::first_many<Options, Parser>>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return internal::many_recognize<Options>(s, separator, p);
+        } else {
+            using result_type = std::decay_t<decltype(*apply(p, s))>;
+            std::array<result_type, Size> arr{};
+            size_t i = 0;
+            auto result = internal::many_internal<Options>(s, [&arr, &i](auto&& res) {
+                arr[i++] = std::forward<decltype(res)>(res);
+            }, separator, p);
+
+            using parse_result = std::pair<std::array<result_type, Size>, size_t>;
+
+            if constexpr (types::has_arg<ParserSep> && has_options(Options, options::no_trailing_separator)) {
+                if (!result) {
+                    return s.template return_fail_change_result<parse_result>(result);
+                }
             }
+            return s.template return_success_emplace<parse_result>(std::move(arr), i);
         }
-        return s.template return_success_emplace<parse_result>(std::move(arr), i);
-    });
+    }));
 }
 
 /**
@@ -430,18 +499,23 @@ inline constexpr auto many_to_map(KeyParser key_parser,
                                   ValueParser value_parser,
                                   ParserSep separator = {},
                                   Inserter inserter = {}) {
-    return parser([=](auto& s) {
-        using key = std::conditional_t<types::has_arg<Key>, Key, std::decay_t<decltype(*apply(key_parser, s))>>;
-        using value = std::conditional_t<types::has_arg<Value>, Value, std::decay_t<decltype(*apply(value_parser, s))>>;
-        using map_type = std::conditional_t<has_options(Options, options::ordered), std::map<key, value>, std::unordered_map<key, value>>;
-        auto ins = internal::default_arg(inserter, [](auto& map, auto&&... rs) {
-            map.emplace(std::forward<decltype(rs)>(rs)...);
-        });
+    using first = internal::first_many<Options, KeyParser, ValueParser>;
+    return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return internal::many_recognize<Options>(s, separator, key_parser, value_parser);
+        } else {
+            using key = std::conditional_t<types::has_arg<Key>, Key, std::decay_t<decltype(*apply(key_parser, s))>>;
+            using value = std::conditional_t<types::has_arg<Value>, Value, std::decay_t<decltype(*apply(value_parser, s))>>;
+            using map_type = std::conditional_t<has_options(Options, options::ordered), std::map<key, value>, std::unordered_map<key, value>>;
+            auto ins = internal::default_arg(inserter, [](auto& map, auto&&... rs) {
+                map.emplace(std::forward<decltype(rs)>(rs)...);
+            });
 
-        types::assert_functor_application_modify<decltype(s), decltype(ins), map_type, KeyParser, ValueParser>();
+            types::assert_functor_application_modify<decltype(s), decltype(ins), map_type, KeyParser, ValueParser>();
 
-        return internal::fold_internal<Options>(s, {}, ins, map_type{}, separator, key_parser, value_parser);
-    });
+            return internal::fold_internal<Options>(s, {}, ins, map_type{}, separator, key_parser, value_parser);
+        }
+    }));
 }
 
 /**
@@ -466,10 +540,19 @@ inline constexpr auto many_f(Fn f,
                              ParserSep separator,
                              Parsers... ps) {
     types::assert_parsers_not_empty<Parsers...>();
-    return parser([=](auto& s) {
-        types::assert_functor_application<decltype(s), Fn, Parsers...>();
-        return internal::many_internal<Options>(s, f, separator, ps...);
-    });
+    return internal::with_first<internal::first_many<Options, Parsers...>>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            // `f` is called for its effects, so it can only be skipped if there is none
+            if constexpr (types::has_arg<Fn>) {
+                return bool(internal::many_internal<Options>(s, f, separator, ps...));
+            } else {
+                return internal::many_recognize<Options>(s, separator, ps...);
+            }
+        } else {
+            types::assert_functor_application<decltype(s), Fn, Parsers...>();
+            return internal::many_internal<Options>(s, f, separator, ps...);
+        }
+    }));
 }
 
 /**
@@ -488,7 +571,12 @@ template <options Options = options::none,
           typename Parser,
           typename ParserSep = no_arg>
 inline constexpr auto many(Parser p, ParserSep separator = {}) {
-    return many_f<Options>({}, separator, p);
+    if constexpr (!types::has_arg<ParserSep> && internal::can_fuse_many<Parser>) {
+        constexpr auto fail_on_no_parse = has_options(Options, options::fail_on_no_parse);
+        return internal::fuse_many<fail_on_no_parse ? options::fail_on_no_parse : options::none>(p);
+    } else {
+        return many_f<Options>({}, separator, p);
+    }
 }
 
 /**
@@ -513,9 +601,9 @@ inline constexpr auto many_state(Fn f,
                                  ParserSep separator,
                                  Parsers... ps) {
     types::assert_parsers_not_empty<Parsers...>();
-    return parser([=](auto& s) {
+    return internal::with_first<internal::first_many<Options, Parsers...>>([=](auto& s) {
         types::assert_functor_application_modify<decltype(s), Fn, decltype((s.user_state)), Parsers...>();
-        return internal::many_internal<Options>(s, [f, &s](auto&& res) {
+        return internal::many_internal<Options>(s, [&f, &s](auto&& res) {
             f(s.user_state, std::forward<decltype(res)>(res));
         }, separator, ps...);
     });
@@ -549,7 +637,8 @@ inline constexpr auto fold(Fn f,
                            Acc&& acc,
                            ParserSep separator,
                            Parsers... ps) {
-    return parser([f, acc = std::forward<Acc>(acc), separator, ps...](auto& s) {
+    using first = internal::first_many<Options, Parsers...>;
+    return internal::with_first<first>([f, acc = std::forward<Acc>(acc), separator, ps...](auto& s) {
         return internal::fold_internal<Options>(s, {}, f, acc, separator, ps...);
     });
 }
@@ -585,7 +674,8 @@ inline constexpr auto fold_direct(
                            Fn f,
                            ParserSep separator,
                            Parsers... ps) {
-    return parser([init, f, separator, ps...](auto& s) {
+    using first = internal::first_many<Options, Parsers...>;
+    return internal::with_first<first>([init, f, separator, ps...](auto& s) {
         return internal::fold_internal<Options>(s, init, f, InitType{}, separator, ps...);
     });
 }
@@ -595,6 +685,9 @@ inline constexpr auto fold_direct(
  * to the first successful parser's result.
  * The lifted functor must provide an overload for every parser result type.
  *
+ * `f` is not called by `validate`. Use `lift_or_state` for side effects that must also
+ * happen there.
+ *
  * @param f a functor with the signature:
  *            `ResultType(auto&& result)`
  *          it must be overloaded for every possible parser result type.
@@ -602,10 +695,16 @@ inline constexpr auto fold_direct(
 template <typename Fn, typename... Parsers>
 inline constexpr auto lift_or(Fn f, Parsers... ps) {
     types::assert_parsers_not_empty<Parsers...>();
-    return parser([=](auto& s) {
-        (types::assert_functor_application<decltype(s), Fn, Parsers>(), ...);
-        return internal::lift_or_rec(s, s.position, f, ps...);
-    });
+    using first = internal::first_alternatives<internal::first_of_parser<Parsers>...>;
+    return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (!recognize_only) {
+            return internal::lift_or_apply(s, f, ps...);
+        } else if (s.skip_functors) {
+            return internal::lift_or_recognize(s, ps...);
+        } else {
+            return bool(internal::lift_or_apply(s, f, ps...));
+        }
+    }));
 }
 
 /**
@@ -623,12 +722,13 @@ inline constexpr auto lift_or(Fn f, Parsers... ps) {
 template <typename Fn, typename... Parsers>
 inline constexpr auto lift_or_state(Fn f, Parsers... ps) {
     types::assert_parsers_not_empty<Parsers...>();
-    return parser([=](auto& s) {
+    using first = internal::first_alternatives<internal::first_of_parser<Parsers>...>;
+    return internal::with_first<first>([=](auto& s) {
         (types::assert_functor_application_modify<decltype(s), Fn, decltype((s.user_state)), Parsers>(), ...);
-        auto to_apply = [f, &s] (auto&& val) {
+        auto to_apply = [&f, &s] (auto&& val) {
             return f(s.user_state, std::forward<decltype(val)>(val));
         };
-        return internal::lift_or_rec(s, s.position, to_apply, ps...);
+        return internal::lift_or_select(s, to_apply, ps...);
     });
 }
 
@@ -646,6 +746,49 @@ inline constexpr auto lift_or_value(Parsers... ps) {
     return lift_or([](auto&& arg) {return T(std::forward<decltype(arg)>(arg));}, ps...);
 }
 
+/**
+ * Annotate a parser with the items it may begin with.
+ *
+ * The built in parsers and combinators already know which items they may begin
+ * with. Use this for parsers where this can not be deduced, e.g. parsers created
+ * with `custom`, `item_if` or `recursive`.
+ *
+ * The annotation is a promise that `p` fails without consuming any input
+ * unless the next item is one of `Items`. Alternatives (`||`, `lift_or`,
+ * `lift_or_state`, `lift_or_value` and `dispatch`) use it to select the
+ * parsers to try with a table lookup on the next item, instead of trying
+ * every parser in turn.
+ *
+ * Example:
+ * @code
+ * constexpr auto p = lift_or_value<json_value>(first_of<'"'>(string_parser),
+ *                                              first_of<'{'>(object_parser),
+ *                                              first_of<'['>(array_parser));
+ * @endcode
+ *
+ * @tparam Items the items that `p` may begin with. Only items with values in
+ *               `[0, 255]` are used for dispatch.
+ */
+template <auto... Items, typename Parser>
+inline constexpr auto first_of(Parser p) {
+    static_assert(sizeof...(Items) > 0, "At least one item must be provided");
+    return parser(internal::first_annotated<internal::first_items<Items...>, Parser>{p});
+}
+
+/**
+ * Try the parsers in order and return the result of the first successful one.
+ * All parsers must have the same result type.
+ *
+ * Parsers annotated with `first_of` are only tried if they may begin with the
+ * next item. The selection is a single lookup in a table of all possible items,
+ * computed at compile time.
+ */
+template <typename... Parsers>
+inline constexpr auto dispatch(Parsers... ps) {
+    types::assert_parsers_not_empty<Parsers...>();
+    return lift_or([](auto&& arg) { return std::forward<decltype(arg)>(arg); }, ps...);
+}
+
 /**
  * Create a parser that parses the result of `p1` with `p2`.
  * `std::begin` and `std::end` will be used with the result of `p1` for the
@@ -655,24 +798,26 @@ inline constexpr auto lift_or_value(Parsers... ps) {
  * this combinator.
  *
  * @tparam NewSettings use this template parameter if you want to change the parse settings
- *                     for the parse with `p2`.
+ *                     for the parse with `p2`. The parse with `p2` never uses `padded_input`,
+ *                     as the result of `p1` is not followed by padding.
  *
  * @param p1 the parser to apply first
  * @param p2 the parser to apply to the result of `p1`
  */
 template <typename NewSettings = no_arg, typename Parser1, typename Parser2>
 inline constexpr auto parse_result(Parser1 p1, Parser2 p2) {
-    return parser([=](auto& s) {
+    return internal::with_first<internal::first_of_parser<Parser1>>([=](auto& s) {
         if (auto&& result = apply(p1, s)) {
             auto result_text = std::move(*result);
             using state_type = std::decay_t<decltype(s)>;
 
             auto new_state = [&](){
+                // The result is a part of the input, which is not padded
                 constexpr auto new_settings = []() {
                     if constexpr (types::has_arg<NewSettings>)
-                        return NewSettings();
+                        return unpadded_settings_t<NewSettings>();
                     else
-                        return typename state_type::settings();
+                        return unpadded_settings_t<typename state_type::settings>();
                 }();
                 if constexpr (state_type::has_user_state) {
                 return parser_state(std::begin(result_text), std::end(result_text), s.user_state, new_settings);
@@ -696,6 +841,7 @@ inline constexpr auto parse_result(Parser1 p1, Parser2 p2) {
  *
  * Note: For parsing until a certain sequence or item, use functions
  * `until_item` and `until_seq` instead, as they are more efficient.
+ * `until` of a templated `item` or `seq` is applied as these automatically.
  *
  * @tparam Options available options:
  * 				     `options::dont_eat`: do not consume the successful parse
@@ -703,26 +849,30 @@ inline constexpr auto parse_result(Parser1 p1, Parser2 p2) {
  */
 template <options Options = options::none, typename Parser>
 inline constexpr auto until(Parser p) {
-    return parser([=](auto& s) {
-        auto position_start = s.position;
-        auto position_end = position_start;
+    if constexpr (internal::can_fuse_until<Parser>) {
+        return internal::fuse_until<Options>(p);
+    } else {
+        return parser([=](auto& s) {
+            auto position_start = s.position;
+            auto position_end = position_start;
 
-        for (auto result = apply(p, s); !result; result = apply(p, s)) {
-            if (s.at_end()) {
-                s.set_position(position_start);
-                return s.return_fail_result_default(result);
+            for (auto result = apply(p, s); !result; result = apply(p, s)) {
+                if (s.at_end()) {
+                    s.set_position(position_start);
+                    return s.return_fail_result_default(result);
+                }
+                s.advance(1);
+                position_end = s.position;
             }
-            s.advance(1);
-            position_end = s.position;
-        }
 
-        auto end_pos = has_options(Options, options::include) ? s.position : position_end;
-        if constexpr (has_options(Options, options::dont_eat)) {
-            s.set_position(position_end);
-        }
+            auto end_pos = has_options(Options, options::include) ? s.position : position_end;
+            if constexpr (has_options(Options, options::dont_eat)) {
+                s.set_position(position_end);
+            }
 
-        return s.return_success(s.convert(position_start, end_pos));
-    });
+            return s.return_success(s.convert(position_start, end_pos));
+        });
+    }
 }
 
 /**
@@ -743,28 +893,110 @@ inline constexpr auto until(Parser p) {
  */
 template <typename Parser, typename OpParser>
 constexpr auto chain(Parser p, OpParser op) {
-    return parser([=](auto& s) {
+    return internal::with_first<internal::first_of_parser<Parser>>([=](auto& s) {
         auto result1 = apply(p, s);
         if (!result1) return result1;
 
         auto r = *std::move(result1);
         for (;;) {
             auto opRes = apply(op, s);
-            if (!opRes) return s.return_success(r);
+            if (!opRes) return s.return_success(std::move(r));
 
             auto result2 = apply(p, s);
-            if (!result2) return s.return_success(r);
+            if (!result2) return s.return_success(std::move(r));
 
-            r = (*opRes)(r, *result2);
+            r = (*opRes)(std::move(r), *std::move(result2));
         }
     });
 }
 
+/**
+ * Create a prefix (unary) operator for `operator_table`.
+ *
+ * @tparam Precedence the precedence of the operator. Higher binds tighter.
+ *
+ * @param p a parser for the operator token. Its result is ignored.
+ * @param f a unary functor with signature:
+ *            `V(V)`
+ */
+template <int Precedence, typename Parser, typename Fn>
+constexpr auto prefix(Parser p, Fn f) {
+    return internal::table_operator<internal::operator_kind::prefix, Precedence, options::none, Parser, Fn>{p, f};
+}
+
+/**
+ * Create an infix (binary) operator for `operator_table`.
+ *
+ * @tparam Precedence the precedence of the operator. Higher binds tighter.
+ *
+ * @tparam Options available options:
+ * 				     `options::right_associative`: make the operator right associative
+ *                                               (default is left associative)
+ *
+ * @param p a parser for the operator token. Its result is ignored.
+ * @param f a binary functor with signature:
+ *            `V(V, V)`
+ */
+template <int Precedence, options Options = options::none, typename Parser, typename Fn>
+constexpr auto infix(Parser p, Fn f) {
+    return internal::table_operator<internal::operator_kind::infix, Precedence, Options, Parser, Fn>{p, f};
+}
+
+/**
+ * Create a postfix (unary) operator for `operator_table`.
+ *
+ * @tparam Precedence the precedence of the operator. Higher binds tighter.
+ *
+ * @param p a parser for the operator token. Its result is ignored.
+ * @param f a unary functor with signature:
+ *            `V(V)`
+ */
+template <int Precedence, typename Parser, typename Fn>
+constexpr auto postfix(Parser p, Fn f) {
+    return internal::table_operator<internal::operator_kind::postfix, Precedence, options::none, Parser, Fn>{p, f};
+}
+
+/**
+ * Parse an expression of `atom`s combined with the operators in the provided table,
+ * with a single precedence climbing loop.
+ *
+ * The table consists of operators created with `prefix`, `infix` and `postfix`.
+ * Operators of the same kind are tried in the order given, skipping those whose
+ * tokens can't begin with the next item (see `first_of`), with a table lookup.
+ *
+ * Compared to stacking `chain` for every precedence level, an atom is parsed
+ * once regardless of the number of levels, and right associative as well as
+ * unary operators can be expressed.
+ *
+ * Example of a parser for integer expressions:
+ * @code
+ * constexpr auto expr = operator_table(integer<int, options::no_negative>(),
+ *                                      infix<1>(item<'+'>(), std::plus<>()),
+ *                                      infix<2>(item<'*'>(), std::multiplies<>()),
+ *                                      prefix<3>(item<'-'>(), std::negate<>()),
+ *                                      infix<4, options::right_associative>(item<'^'>(), power));
+ * @endcode
+ *
+ * @param atom a parser that returns some value `V`
+ * @param operators the operator table
+ */
+template <typename Parser, typename... Operators>
+constexpr auto operator_table(Parser atom, Operators... operators) {
+    using first = internal::first_alternatives<internal::first_of_parser<Parser>, internal::operator_first<Operators>...>;
+    return internal::with_first<first>([=](auto& s) {
+        using value_type = std::decay_t<decltype(*apply(atom, s))>;
+        return internal::precedence_climb<value_type>(s, std::numeric_limits<int>::min(), atom, operators...);
+    });
+}
+
 /**
  * Create a recursive parser.
  * Provide a lambda taking an `auto` as its parameter, and returning
  * a parser. The passed parser is functionally identical to the returned parser,
  * and can be used recursively within that.
+ *
+ * The lambda is called once for every application of the recursive parser, and
+ * not for every level of recursion.
  * You must provide the `ReturnType` of the parsers as the first template argument
  * (to make the compiler happy).
  *
@@ -779,26 +1011,42 @@ constexpr auto chain(Parser p, OpParser op) {
  *
  * this will parse a string on the format "{{{{{{{{123}}}}}}}}"
  *
+ * The nesting depth can be limited with the `MaxDepth` parameter of `parser_settings`.
+ * A parse that nests deeper fails cleanly instead of overflowing the stack.
+ *
  * @tparam ReturnType the result type for the parser.
  *
+ * @tparam Options available options:
+ * 				     `options::heap_stack`: evaluate the recursion on heap allocated stack segments
+ *                                        once the recursion has used half of the thread's stack
+ *                                        that was left when the parse started. Nesting depth is
+ *                                        then bounded by memory instead of the size of the
+ *                                        thread's stack.
+ *                                        This option cannot be used at compile time.
+ *
  * @param f a lambda with the format:
  *            `[](auto p) {...} -> RecursiveParser`
  *
  */
-template <typename ReturnType, typename Fn>
+template <typename ReturnType, options Options = options::none, typename Fn>
 constexpr auto recursive(Fn f) {
-    return parser([f](auto& s) {
-        auto rec = [f, &s](auto self)
-                -> result<ReturnType, typename std::decay_t<decltype(s)>::error_type> {
-            auto p = parser([self](auto&) { // The actual parser sent to the caller.
-                return self(self);
-            });
-            return apply(f(p), s);
-        };
-        return rec(rec);
-    });
+    return parser(internal::with_recognizer([f](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            const internal::recursive_grammar<ReturnType, Options, Fn> grammar(f);
+            if constexpr (has_options(Options, options::heap_stack)) {
+                grammar.stack.set_native_base();
+            }
+            return recognize(grammar.p, s);
+        } else {
+            // Build the grammar once, and let the recursive references point into it.
+            const internal::recursive_grammar<ReturnType, Options, Fn> grammar(f);
+            if constexpr (has_options(Options, options::heap_stack)) {
+                grammar.stack.set_native_base();
+            }
+            return apply(grammar.p, s);
+        }
+    }));
 }
-
 }
 
 #endif // PARSIMON_COMBINATORS_H
@@ -6,6 +6,7 @@
 #include "anpa/state.h"
 #include "anpa/settings.h"
 #include "anpa/types.h"
+#include "anpa/internal/first_set.h"
 
 namespace anpa {
 
@@ -13,18 +14,77 @@ namespace anpa {
 // Apply a parser to a state and return the result.
 // This application unwraps arbitrary layers of callables so that one can
 // wrap the parser to enable recursion.
+// The parser is taken by reference so that its captures are never copied
+// on the invocation path.
 template <typename Parser, typename S>
-constexpr auto apply(Parser p, S& s) {
-    if constexpr (std::is_invocable_v<Parser>) {
+constexpr auto apply(Parser&& p, S& s) {
+    if constexpr (std::is_invocable_v<Parser&>) {
         return apply(p(), s);
     } else {
         return p(s);
     }
 }
 
+/**
+ * Apply a parser to a state in recognizer mode, i.e. only for its effect on the position.
+ * Return whether the parse was successful.
+ *
+ * Parsers that provide a member function `recognize(State&)` use it to skip the
+ * construction of their result. Other parsers are applied as usual and their
+ * result is discarded.
+ */
+template <typename Parser, typename S>
+constexpr bool recognize(Parser&& p, S& s);
+
 template <typename P>
 struct parser;
 
+namespace internal {
+
+template <typename P, typename S, typename = void>
+constexpr bool has_recognize = false;
+
+template <typename P, typename S>
+constexpr bool has_recognize<P, S, std::void_t<decltype(std::declval<const P&>().recognize(std::declval<S&>()))>> = true;
+
+/**
+ * A parser with a separate, cheaper, implementation for recognizer mode.
+ * `P` is called with the state and `std::false_type` to parse, and with
+ * the state and `std::true_type` to recognize.
+ */
+template <typename P>
+struct recognizer {
+    P p;
+
+    template <typename State>
+    constexpr auto operator()(State& s) const {
+        return p(s, std::false_type());
+    }
+
+    template <typename State>
+    constexpr bool recognize(State& s) const {
+        return p(s, std::true_type());
+    }
+};
+
+template <typename P>
+constexpr auto with_recognizer(P p) {
+    return recognizer<P>{p};
+}
+
+}
+
+template <typename Parser, typename S>
+constexpr bool recognize(Parser&& p, S& s) {
+    if constexpr (std::is_invocable_v<Parser&>) {
+        return recognize(p(), s);
+    } else if constexpr (internal::has_recognize<std::decay_t<Parser>, S>) {
+        return p.recognize(s);
+    } else {
+        return bool(p(s));
+    }
+}
+
 /**
  * Monadic bind for the parser
  *
@@ -37,14 +97,20 @@ struct parser;
  */
 template <typename P, typename Fn>
 inline constexpr auto operator>>=(parser<P> p, Fn f) {
-    return parser([=](auto& s) {
-        if (auto&& result = apply(p, s)) {
-            return apply(f(*std::forward<decltype(result)>(result)), s);
+    using first = internal::first_then_unknown<internal::first_of_parser<P>>;
+    return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            auto&& result = apply(p, s);
+            return result && recognize(f(*std::forward<decltype(result)>(result)), s);
         } else {
-            using new_return_type = decltype(*apply(f(*std::forward<decltype(result)>(result)), s));
-            return s.template return_fail_change_result<new_return_type>(result);
+            if (auto&& result = apply(p, s)) {
+                return apply(f(*std::forward<decltype(result)>(result)), s);
+            } else {
+                using new_return_type = decltype(*apply(f(*std::forward<decltype(result)>(result)), s));
+                return s.template return_fail_change_result<new_return_type>(result);
+            }
         }
-    });
+    }));
 }
 
 /**
@@ -74,7 +140,7 @@ inline constexpr auto operator>>=(parser<P> p, Fn f) {
 template <typename T>
 constexpr auto mreturn(T&& t) {
     types::assert_copyable_mreturn<T>();
-    return parser([t = std::forward<T>(t)](auto& s) {
+    return internal::with_first<internal::first_nothing>([t = std::forward<T>(t)](auto& s) {
         return s.return_success(t);
     });
 }
@@ -94,7 +160,7 @@ constexpr auto mreturn(T&& t) {
 template <typename T, typename... Args>
 constexpr auto mreturn_emplace(Args&&... args) {
     (types::assert_copyable_mreturn<Args>(), ...);
-    return parser([args = std::make_tuple(std::forward<Args>(args)...)](auto& s) {
+    return internal::with_first<internal::first_nothing>([args = std::make_tuple(std::forward<Args>(args)...)](auto& s) {
         return std::apply([&s](auto... args){
             return s.template return_success_emplace<T>(std::move(args)...);
         }, args);
@@ -105,14 +171,76 @@ constexpr auto mreturn_emplace(Args&&... args) {
  * Lift a value to the parser monad. Templated general version. The returned value must be in global scope.
  */
 template <auto& T>
-constexpr auto mreturn() { return parser([](auto& s) { return s.return_success(T); }); }
+constexpr auto mreturn() {
+    return internal::with_first<internal::first_nothing>([](auto& s) { return s.return_success(T); });
+}
 
 /**
  * Lift a value to the parser monad. Templated general version. Use this for literal types you know at
  * compile time.
  */
 template <auto T>
-constexpr auto mreturn() { return parser([](auto& s) { return s.return_success(T); }); }
+constexpr auto mreturn() {
+    return internal::with_first<internal::first_nothing>([](auto& s) { return s.return_success(T); });
+}
+
+namespace internal {
+
+/**
+ * Apply `p` to `s` and convert its result to `Result`, for parsers whose
+ * result type must be fixed (see `rule`).
+ */
+template <typename Result, typename Parser, typename State>
+constexpr auto apply_as(const Parser& p, State& s) -> result<Result, typename State::error_type> {
+    auto&& r = apply(p, s);
+    if constexpr (std::is_same_v<std::decay_t<decltype(r)>, result<Result, typename State::error_type>>) {
+        return std::forward<decltype(r)>(r);
+    } else if (r) {
+        return s.template return_success_emplace<Result>(*std::forward<decltype(r)>(r));
+    } else {
+        return s.template return_fail_change_result<Result>(r);
+    }
+}
+
+/**
+ * The beginning of `sequence` as passed to the parser. Contiguous sequences are parsed
+ * through pointers, so that a parser is only instantiated once for e.g. `std::string`,
+ * `std::string_view` and `std::vector<char>`, and so that pointer fast paths apply.
+ */
+template <typename Sequence>
+constexpr auto sequence_begin(const Sequence& sequence) {
+    if constexpr (types::is_contiguous_sequence<Sequence>) {
+        return std::data(sequence);
+    } else {
+        return std::begin(sequence);
+    }
+}
+
+/**
+ * The end of `sequence` as passed to the parser. See `sequence_begin`.
+ */
+template <typename Sequence>
+constexpr auto sequence_end(const Sequence& sequence) {
+    if constexpr (types::is_contiguous_sequence<Sequence>) {
+        return std::data(sequence) + std::size(sequence);
+    } else {
+        return std::end(sequence);
+    }
+}
+
+}
+
+/**
+ * Convert a position of a parse of the contiguous `sequence` back to an iterator of `sequence`.
+ *
+ * Parsing a contiguous sequence (e.g. `std::string`) results in pointer positions.
+ * Use this function if an iterator of the sequence is needed instead.
+ */
+template <typename Sequence, typename Item>
+constexpr auto to_iterator(Sequence& sequence, const Item* position) {
+    static_assert(types::is_contiguous_sequence<std::remove_const_t<Sequence>>, "The sequence must be contiguous");
+    return std::next(std::begin(sequence), position - std::data(sequence));
+}
 
 /**
  * Monadic parser
@@ -130,6 +258,11 @@ struct parser {
         return apply(p, s);
     }
 
+    template <typename State>
+    constexpr bool recognize(State& s) const {
+        return anpa::recognize(p, s);
+    }
+
     template <typename InternalState>
     constexpr auto parse_internal(InternalState&& state) const {
         return std::pair(std::forward<InternalState>(state), apply(p, state));
@@ -155,14 +288,15 @@ struct parser {
      *
      * The result is a std::pair with the anpa::parser_state as the first
      * element and the result of the parse as the second.
+     * Contiguous sequences are parsed through pointers (see `to_iterator`).
      *
      * @tparam the parser settings to use (default: `default_parser_settings`)
      */
     template <typename Settings = default_parser_settings, typename SequenceType, typename State>
     constexpr auto parse_with_state(const SequenceType& sequence,
                                     State&& user_state) const {
-        return parse_with_state<Settings>(std::begin(sequence),
-                                std::end(sequence),
+        return parse_with_state<Settings>(internal::sequence_begin(sequence),
+                                internal::sequence_end(sequence),
                                 std::forward<State>(user_state));
     }
 
@@ -200,12 +334,13 @@ struct parser {
      *
      * The result is a std::pair with anpa::parser_state_simple as the first
      * element and the result of the parse as the second.
+     * Contiguous sequences are parsed through pointers (see `to_iterator`).
      *
      * @tparam the parser settings to use (default: `default_parser_settings`)
      */
     template <typename Settings = default_parser_settings, typename SequenceType>
     constexpr auto parse(const SequenceType& sequence) const {
-        return parse<Settings>(std::begin(sequence), std::end(sequence));
+        return parse<Settings>(internal::sequence_begin(sequence), internal::sequence_end(sequence));
     }
 
     /**
@@ -236,6 +371,49 @@ struct parser {
     }
 };
 
+/**
+ * Check if the sequence described by `[begin, end)` can be parsed by `p`,
+ * without constructing any results.
+ *
+ * Parsers are applied in recognizer mode (see `recognize`), so that e.g.
+ * containers are never built and functors passed to `lift` and friends are never called.
+ *
+ * The result is a std::pair with anpa::parser_state_simple as the first
+ * element and `true` if the parse succeeded as the second.
+ *
+ * @tparam the parser settings to use (default: `default_parser_settings`)
+ */
+template <typename Settings = default_parser_settings, typename Parser, typename InputIt>
+constexpr auto validate(const Parser& p, InputIt begin, InputIt end) {
+    auto state = parser_state_simple(begin, end, Settings());
+    state.skip_functors = true;
+    bool success = recognize(p, state);
+    return std::pair(state, success);
+}
+
+/**
+ * Check if a sequence described by `[std::begin(sequence), std::end(sequence))`
+ * can be parsed by `p`, without constructing any results.
+ * Contiguous sequences are parsed through pointers (see `to_iterator`).
+ *
+ * @tparam the parser settings to use (default: `default_parser_settings`)
+ */
+template <typename Settings = default_parser_settings, typename Parser, typename SequenceType>
+constexpr auto validate(const Parser& p, const SequenceType& sequence) {
+    return validate<Settings>(p, internal::sequence_begin(sequence), internal::sequence_end(sequence));
+}
+
+/**
+ * Check if a null terminated string literal can be parsed by `p`, without
+ * constructing any results.
+ *
+ * @tparam the parser settings to use (default: `default_parser_settings`)
+ */
+template <typename Settings = default_parser_settings, typename Parser, typename ItemType, size_t N>
+constexpr auto validate(const Parser& p, const ItemType (&sequence)[N]) {
+    return validate<Settings>(p, sequence, sequence + N - 1);
+}
+
 }
 
 #endif // PARSIMON_CORE_H
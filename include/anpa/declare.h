@@ -0,0 +1,92 @@
+#ifndef PARSIMON_DECLARE_H
+#define PARSIMON_DECLARE_H
+
+#include <type_traits>
+#include "anpa/core.h"
+#include "anpa/result.h"
+#include "anpa/settings.h"
+#include "anpa/state.h"
+
+namespace anpa::internal {
+
+/**
+ * Parser that calls the functions of the declaration `Declaration`, which are
+ * defined in another translation unit by `ANPA_DEFINE_PARSER`.
+ */
+template <typename Declaration>
+struct declared_parser {
+    template <typename S>
+    static constexpr void assert_state() {
+        static_assert(std::is_same_v<S, typename Declaration::state_type>,
+                      "A declared parser can only be applied to the iterator type and settings it was declared with");
+    }
+
+    template <typename S>
+    auto operator()(S& s) const {
+        assert_state<S>();
+        return Declaration::parse(s);
+    }
+
+    template <typename S>
+    bool recognize(S& s) const {
+        assert_state<S>();
+        return Declaration::recognize(s);
+    }
+};
+
+}
+
+/**
+ * Declare the parser `name` for items of type `InputIt` with result type `Result`,
+ * to be defined with `ANPA_DEFINE_PARSER` in a single translation unit.
+ *
+ * Translation units that only see the declaration don't instantiate the parser
+ * that defines it, which may save a lot of compile time and binary size for
+ * large grammars that are used in many places. The declared parser is a normal
+ * parser that may be combined with others, and its definition may be recursive.
+ *
+ * Example:
+ * ```
+ * // json.h
+ * ANPA_DECLARE_PARSER(json, const char*, json_value)
+ *
+ * // json.cpp
+ * ANPA_DEFINE_PARSER(json, recursive<json_value>(json_value_grammar))
+ *
+ * // Elsewhere
+ * auto res = json.parse(str);
+ * ```
+ *
+ * Contiguous sequences are parsed through pointers, so a parser declared for
+ * `const char*` applies to e.g. `std::string` and `std::string_view`.
+ */
+#define ANPA_DECLARE_PARSER(name, InputIt, Result) \
+    ANPA_DECLARE_PARSER_WITH_SETTINGS(name, InputIt, Result, ::anpa::default_parser_settings)
+
+/**
+ * Like `ANPA_DECLARE_PARSER`, but for parser settings `Settings`.
+ */
+#define ANPA_DECLARE_PARSER_WITH_SETTINGS(name, InputIt, Result, Settings) \
+    struct name##_declaration { \
+        using state_type = ::anpa::parser_state_simple<InputIt, Settings>; \
+        using value_type = Result; \
+        using result_type = ::anpa::result<value_type, typename state_type::error_type>; \
+        static result_type parse(state_type& s); \
+        static bool recognize(state_type& s); \
+    }; \
+    inline constexpr ::anpa::parser<::anpa::internal::declared_parser<name##_declaration>> name{{}};
+
+/**
+ * Define the parser `name`, declared with `ANPA_DECLARE_PARSER`, as the parser given
+ * by the remaining arguments. The result of the parser is converted to the declared result type.
+ * Use this macro in exactly one translation unit, in the namespace of the declaration.
+ */
+#define ANPA_DEFINE_PARSER(name, ...) \
+    name##_declaration::result_type name##_declaration::parse(state_type& s) { \
+        return ::anpa::internal::apply_as<value_type>((__VA_ARGS__), s); \
+    } \
+    bool name##_declaration::recognize(state_type& s) { \
+        return ::anpa::recognize((__VA_ARGS__), s); \
+    }
+
+#endif // PARSIMON_DECLARE_H
@@ -0,0 +1,251 @@
+#ifndef PARSIMON_GRAMMAR_H
+#define PARSIMON_GRAMMAR_H
+
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "anpa/core.h"
+#include "anpa/options.h"
+#include "anpa/combinators.h"
+#include "anpa/parsers.h"
+#include "anpa/internal/fusion.h"
+#include "anpa/internal/peg.h"
+
+namespace anpa::internal::peg {
+
+/**
+ * A user action bound to the rule named `Name`.
+ */
+template <auto& Name, typename Fn>
+struct binding {
+    static constexpr std::string_view name{Name};
+
+    Fn f;
+};
+
+template <auto& Text, typename Bindings, std::size_t Rule>
+struct rule_reference;
+
+/**
+ * Lowering of the syntax tree of the grammar `Text` to parsers.
+ *
+ * Every lowered expression restores the position when it fails, as required
+ * by PEG. Only sequences of several parsers may fail after consuming, so they
+ * are wrapped in `try_parser`.
+ */
+template <auto& Text, typename Bindings>
+struct lowering {
+    static constexpr const auto& tree = compiled<Text>::value;
+
+    template <std::size_t First, std::size_t... I>
+    static constexpr auto lower_literal(std::index_sequence<I...>) {
+        if constexpr (sizeof...(I) == 1) {
+            return anpa::item<tree.chars[First]>();
+        } else {
+            return anpa::seq<tree.chars[First + I]...>();
+        }
+    }
+
+    template <std::size_t First, std::size_t... I>
+    static constexpr auto lower_sequence(const Bindings* bindings, std::index_sequence<I...>) {
+        return anpa::try_parser((... >> lower<tree.children[First + I]>(bindings)));
+    }
+
+    template <std::size_t First, std::size_t... I>
+    static constexpr auto lower_choice(const Bindings* bindings, std::index_sequence<I...>) {
+        return (... || lower<tree.children[First + I]>(bindings));
+    }
+
+    template <std::size_t Node>
+    static constexpr auto lower(const Bindings* bindings) {
+        constexpr node n = tree.nodes[Node];
+        if constexpr (n.kind == node_kind::literal) {
+            if constexpr (n.size == 0) {
+                return anpa::success();
+            } else {
+                return lower_literal<n.first>(std::make_index_sequence<n.size>());
+            }
+        } else if constexpr (n.kind == node_kind::char_class) {
+            return parser(item_if_parser<class_predicate<Text, n.first>, first_of_class<Text, n.first>>{});
+        } else if constexpr (n.kind == node_kind::any) {
+            return anpa::any_item();
+        } else if constexpr (n.kind == node_kind::reference) {
+            return parser(rule_reference<Text, Bindings, n.first>{bindings});
+        } else if constexpr (n.kind == node_kind::sequence) {
+            if constexpr (n.size == 0) {
+                return anpa::success();
+            } else {
+                return lower_sequence<n.first>(bindings, std::make_index_sequence<n.size>());
+            }
+        } else if constexpr (n.kind == node_kind::choice) {
+            return lower_choice<n.first>(bindings, std::make_index_sequence<n.size>());
+        } else if constexpr (n.kind == node_kind::and_predicate) {
+            return anpa::no_consume(lower<n.first>(bindings));
+        } else if constexpr (n.kind == node_kind::not_predicate) {
+            return anpa::no_consume(anpa::flip(lower<n.first>(bindings)));
+        } else if constexpr (n.kind == node_kind::optional) {
+            return anpa::succeed(lower<n.first>(bindings));
+        } else if constexpr (n.kind == node_kind::zero_or_more) {
+            return anpa::many(lower<n.first>(bindings));
+        } else {
+            return anpa::many<options::fail_on_no_parse>(lower<n.first>(bindings));
+        }
+    }
+
+    /// Return the index of the binding for the rule `Rule`, or the number of bindings if there is none.
+    template <std::size_t Rule, std::size_t I = 0>
+    static constexpr std::size_t find_binding() {
+        if constexpr (I == std::tuple_size_v<Bindings>) {
+            return I;
+        } else if (std::tuple_element_t<I, Bindings>::name == tree.rules[Rule].name) {
+            return I;
+        } else {
+            return find_binding<Rule, I + 1>();
+        }
+    }
+};
+
+/**
+ * Parser for the rule `Rule` of the grammar `Text`.
+ * The result is the matched range, and the bound action, if any, is called with it.
+ */
+template <auto& Text, typename Bindings, std::size_t Rule>
+struct rule_reference {
+    using first_type = first_of_rule<Text, Rule>;
+    using lowered = lowering<Text, Bindings>;
+
+    const Bindings* bindings;
+
+    template <typename State>
+    constexpr bool recognize(State& s) const {
+        constexpr auto max_depth = State::settings::max_depth;
+        if constexpr (max_depth > 0) {
+            if (s.depth == max_depth) return false;
+        }
+
+        auto start = s.position;
+        bool success = call_nested(s, [&]() {
+            return anpa::recognize(lowered::template lower<lowered::tree.rules[Rule].node>(bindings), s);
+        });
+        if (!success) {
+            s.set_position(start);
+            return false;
+        }
+
+        constexpr auto index = lowered::template find_binding<Rule>();
+        if constexpr (index < std::tuple_size_v<Bindings>) {
+            const auto& f = std::get<index>(*bindings).f;
+            auto range = s.convert(start, s.position);
+            if constexpr (State::has_user_state) {
+                if constexpr (std::is_invocable_v<decltype(f), decltype((s.user_state)), decltype(range)>) {
+                    f(s.user_state, range);
+                } else {
+                    f(range);
+                }
+            } else {
+                f(range);
+            }
+        }
+        return true;
+    }
+
+    template <typename State>
+    constexpr auto operator()(State& s) const
+        -> result<decltype(s.convert(s.position, s.position)), typename State::error_type> {
+        auto start = s.position;
+        if (recognize(s)) {
+            return s.return_success(s.convert(start, s.position));
+        }
+        return s.template return_fail<decltype(s.convert(s.position, s.position))>();
+    }
+};
+
+template <auto& Text, std::size_t Rule, typename... Bindings>
+constexpr auto make_grammar(Bindings... bindings) {
+    constexpr auto& tree = compiled<Text>::value;
+    static_assert(Rule < tree.rule_count, "No such rule in the grammar");
+    static_assert(((tree.find_rule(Bindings::name) < tree.rule_count) && ...), "Action bound to a rule that does not exist");
+
+    using bindings_type = std::tuple<Bindings...>;
+    return with_first<first_of_rule<Text, Rule>>(with_recognizer([bs = bindings_type(bindings...)](auto& s, auto recognize_only) {
+        rule_reference<Text, bindings_type, Rule> start{&bs};
+        if constexpr (recognize_only) {
+            return start.recognize(s);
+        } else {
+            return start(s);
+        }
+    }));
+}
+
+}
+
+namespace anpa {
+
+/**
+ * Bind an action to the rule named `Name` of a grammar.
+ *
+ * The action is called with the matched range every time the rule matches, while
+ * the input is parsed. It is also called for matches that are undone when an
+ * enclosing expression fails later on, so actions should only record what they
+ * see, e.g. to a user state that is reset for each attempt. The result of the
+ * action is ignored, as every rule results in its range. Use `runtime_grammar`
+ * for ranges of only the successful parse.
+ *
+ * @tparam Name a null-terminated array with static storage duration
+ *
+ * @param f a functor with the signature:
+ *            `void(auto range)` or `void(auto& user_state, auto range)`
+ */
+template <auto& Name, typename Fn>
+constexpr auto rule_action(Fn f) {
+    return internal::peg::binding<Name, Fn>{f};
+}
+
+/**
+ * Parser for the PEG grammar `Text`, starting at its first rule.
+ *
+ * The grammar is parsed at compile time and lowered to the parsers and combinators
+ * of this library, so nothing is interpreted at runtime. Every rule results in the
+ * range that it matched, and actions bound to rules with `rule_action` are called
+ * with their ranges as they match (see `rule_action` for the limits). The result of
+ * the parser is the range matched by the start rule, and actions can't change it.
+ *
+ * Example:
+ * ```
+ * static constexpr char list[] = R"(
+ *     list   <- '[' (number (',' number)*)? ']'
+ *     number <- [0-9]+
+ * )";
+ * static constexpr char number[] = "number";
+ *
+ * std::vector<int> numbers;
+ * auto p = grammar<list>(rule_action<number>([&](auto r) { numbers.push_back(...); }));
+ * ```
+ *
+ * See `anpa/internal/peg.h` for the syntax. Left recursive rules and repetition
+ * of expressions that may succeed without consuming are not supported.
+ * The nesting depth of rules can be limited with the `MaxDepth` parameter of `parser_settings`.
+ *
+ * @tparam Text a null-terminated array with static storage duration
+ *
+ * @param bindings actions created with `rule_action`
+ */
+template <auto& Text, typename... Bindings>
+constexpr auto grammar(Bindings... bindings) {
+    return internal::peg::make_grammar<Text, 0>(bindings...);
+}
+
+/**
+ * Parser for the PEG grammar `Text`, starting at the rule named `Start`.
+ */
+template <auto& Text, auto& Start, typename... Bindings>
+constexpr auto grammar(Bindings... bindings) {
+    constexpr auto rule = internal::peg::compiled<Text>::value.find_rule(Start);
+    return internal::peg::make_grammar<Text, rule>(bindings...);
+}
+
+}
+
+#endif // PARSIMON_GRAMMAR_H
@@ -2,14 +2,43 @@
 #define PARSIMON_INTERNAL_ALGORITHM_H
 
 #include <algorithm>
+#include <cstring>
 #include <iterator>
+#include <type_traits>
 #include "anpa/types.h"
 
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define ANPA_HAS_BUILTIN_IS_CONSTANT_EVALUATED
+#endif
+#endif
+
 /**
  * constexpr variants of some algorithms
  */
 namespace anpa::algorithm {
 
+/**
+ * Return whether the call is evaluated at compile time. Without compiler support
+ * this is always `true`, so that runtime only fast paths are never taken.
+ */
+inline constexpr bool is_constant_evaluated() {
+#ifdef ANPA_HAS_BUILTIN_IS_CONSTANT_EVALUATED
+    return __builtin_is_constant_evaluated();
+#else
+    return true;
+#endif
+}
+
+/**
+ * True if `InputIt` is a pointer to byte sized integral items of type `Element`,
+ * so that the items can be searched with `std::memchr`.
+ */
+template <typename InputIt, typename Element>
+constexpr bool is_byte_pointer = std::is_pointer_v<InputIt> &&
+                                 std::is_same_v<std::remove_cv_t<std::remove_pointer_t<InputIt>>, Element> &&
+                                 std::is_integral_v<Element> && sizeof(Element) == 1;
+
 /**
  * constexpr version of `std::equal` (1)
  */
@@ -62,7 +91,7 @@ inline constexpr auto equal(InputIt begin, InputIt end) {
  * constexpr version of `std::find_if`
  */
 template <typename InputIt, typename Predicate>
-inline constexpr auto find_if(InputIt begin, InputIt end, Predicate p) {
+inline constexpr auto find_if(InputIt begin, InputIt end, const Predicate& p) {
     for (;begin != end; ++begin) {
         if (p(*begin)) return begin;
     }
@@ -73,8 +102,8 @@ inline constexpr auto find_if(InputIt begin, InputIt end, Predicate p) {
  * constexpr version of `std::find_if_not`
  */
 template <typename InputIt, typename Predicate>
-inline constexpr auto find_if_not(InputIt begin, InputIt end, Predicate p) {
-    return algorithm::find_if(begin, end, [=](const auto& val){return !p(val);});
+inline constexpr auto find_if_not(InputIt begin, InputIt end, const Predicate& p) {
+    return algorithm::find_if(begin, end, [&](const auto& val){return !p(val);});
 }
 
 /**
@@ -82,6 +111,14 @@ inline constexpr auto find_if_not(InputIt begin, InputIt end, Predicate p) {
  */
 template <typename InputIt, typename Element>
 inline constexpr auto find(InputIt begin, InputIt end, const Element& element) {
+    if constexpr (is_byte_pointer<InputIt, Element>) {
+        if (!is_constant_evaluated()) {
+            if (begin == end) return end;
+            using item_type = std::remove_pointer_t<InputIt>;
+            auto pos = std::memchr(begin, static_cast<unsigned char>(element), static_cast<size_t>(end - begin));
+            return pos ? begin + (static_cast<const item_type*>(pos) - begin) : end;
+        }
+    }
     return algorithm::find_if(begin, end, [&](const auto& val){return val == element;});
 }
 
@@ -109,6 +146,21 @@ inline constexpr auto contains(const V& sought) {
  */
 template <typename InputIt1, typename InputIt2>
 inline constexpr std::pair<InputIt1, InputIt1> search(InputIt1 begin1, InputIt1 end1, InputIt2 begin2, InputIt2 end2) {
+    using item_type = std::remove_cv_t<std::remove_pointer_t<InputIt1>>;
+    if constexpr (is_byte_pointer<InputIt1, item_type> && is_byte_pointer<InputIt2, item_type>) {
+        // Skip to the candidates with `memchr`
+        if (!is_constant_evaluated() && begin2 != end2) {
+            for (;; ++begin1) {
+                begin1 = algorithm::find(begin1, end1, *begin2);
+                if (begin1 == end1) return {end1, end1};
+                auto b1 = std::next(begin1);
+                auto b2 = std::next(begin2);
+                for (; b2 != end2 && b1 != end1 && *b1 == *b2; ++b1, ++b2);
+                if (b2 == end2) return {begin1, b1};
+                if (b1 == end1) return {end1, end1};
+            }
+        }
+    }
     for (;;++begin1) {
         InputIt1 b1 = begin1;
         for (InputIt2 b2 = begin2; ; ++b1, ++b2) {
@@ -0,0 +1,114 @@
+#ifndef PARSIMON_INTERNAL_BOUNDED_QUEUE_H
+#define PARSIMON_INTERNAL_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+namespace anpa::internal {
+
+/**
+ * A lock-free queue of a fixed capacity for any number of producers and consumers.
+ *
+ * Every cell has a sequence number that tells whether it is ready to be written or read
+ * in the current lap around the ring, so producers and consumers only contend on their
+ * own position. The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class bounded_queue {
+    struct cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::size_t mask;
+    std::unique_ptr<cell[]> cells;
+    alignas(64) std::atomic<std::size_t> push_position{0};
+    alignas(64) std::atomic<std::size_t> pop_position{0};
+
+public:
+    explicit bounded_queue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size *= 2;
+        mask = size - 1;
+        cells.reset(new cell[size]);
+        for (std::size_t i = 0; i < size; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bounded_queue(const bounded_queue&) = delete;
+    bounded_queue& operator=(const bounded_queue&) = delete;
+
+    /// Push `value`, or return `false` if the queue is full.
+    bool try_push(T value) {
+        auto position = push_position.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& c = cells[position & mask];
+            auto sequence = c.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence - position);
+            if (diff == 0) {
+                if (push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    c.value = std::move(value);
+                    c.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = push_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Pop the oldest value to `value`, or return `false` if the queue is empty.
+    bool try_pop(T& value) {
+        auto position = pop_position.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& c = cells[position & mask];
+            auto sequence = c.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+            if (diff == 0) {
+                if (pop_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(c.value);
+                    c.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = pop_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// The number of values in the queue, which may be outdated when it is returned.
+    std::size_t size() const {
+        auto pushed = push_position.load(std::memory_order_relaxed);
+        auto popped = pop_position.load(std::memory_order_relaxed);
+        return pushed > popped ? pushed - popped : 0;
+    }
+};
+
+/**
+ * Waiting for a lock-free queue: yields to other threads at first, and then sleeps for
+ * short periods, so that a long wait (e.g. for slow input) does not occupy a core.
+ */
+class backoff {
+    unsigned attempts = 0;
+
+public:
+    void wait() {
+        constexpr unsigned yields = 64;
+        if (attempts < yields) {
+            ++attempts;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+};
+
+}
+
+#endif // PARSIMON_INTERNAL_BOUNDED_QUEUE_H
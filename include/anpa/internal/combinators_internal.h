@@ -3,14 +3,45 @@
 
 #include <type_traits>
 #include <utility>
+#include <limits>
+#include <tuple>
 #include <valgrind/callgrind.h>
 #include "anpa/types.h"
 #include "anpa/monad.h"
 #include "anpa/options.h"
+#include "anpa/internal/stack.h"
+#include "anpa/internal/first_set.h"
 
 
 namespace anpa::internal {
 
+/**
+ * Recognizer mode version of `many_internal`.
+ */
+template <options Options, typename State, typename Sep, typename... Parsers>
+inline constexpr bool many_recognize(State& s, [[maybe_unused]] const Sep& sep, const Parsers&... ps) {
+    bool successes = false;
+    constexpr bool no_trailing_sep = types::has_arg<Sep> && has_options(Options, options::no_trailing_separator);
+
+    for (;;) {
+        if (!(recognize(ps, s) && ...)) {
+            if constexpr (has_options(Options, options::fail_on_no_parse)) {
+                if (!successes) return false;
+            }
+            if constexpr (no_trailing_sep) {
+                if (successes) return false;
+            }
+            return true;
+        }
+
+        successes = true;
+
+        if constexpr (!std::is_empty_v<Sep>) {
+            if (!recognize(sep, s)) return true;
+        }
+    }
+}
+
 /**
  * General helper for evaluating a parser multiple times with an optional separator.
  */
@@ -20,15 +51,23 @@ template <options Options,
           typename Sep = no_arg,
           typename... Parsers>
 inline constexpr auto many_internal(State& s,
-                            Fn f,
-                            [[maybe_unused]] Sep sep,
-                            Parsers... ps ) {
+                            const Fn& f,
+                            [[maybe_unused]] const Sep& sep,
+                            const Parsers&... ps ) {
     auto start = s.position;
+
+    // Without a functor the results are not needed, unless they hold the error
+    if constexpr (!types::has_arg<Fn> && !State::error_messages) {
+        if (!many_recognize<Options>(s, sep, ps...)) return s.return_fail();
+        return s.return_success(s.convert(start, s.position));
+    }
+
+    const auto lifted = lift_function(f);
     bool successes = false;
     constexpr bool no_trailing_sep = types::has_arg<Sep> && has_options(Options, options::no_trailing_separator);
 
     for (;;) {
-        if (auto&& result = apply(lift(f, ps...), s); !result) {
+        if (auto&& result = lift_apply(s, lifted, ps...); !result) {
             if constexpr (has_options(Options, options::fail_on_no_parse)) {
                 if (!successes) {
                     return s.return_fail_result_default(result);
@@ -60,13 +99,13 @@ template <options Options,
           typename ParserSep,
           typename... Parsers>
 inline constexpr auto fold_internal(State& s,
-                                    Init init,
-                                    Fn f,
+                                    const Init& init,
+                                    const Fn& f,
                                     Acc acc,
-                                    ParserSep sep,
-                                    Parsers... ps) {
+                                    const ParserSep& sep,
+                                    const Parsers&... ps) {
     if constexpr (types::has_arg<Init>) init(acc);
-    auto result = many_internal<Options>(s, [&acc, f](auto&&... rs) {
+    auto result = many_internal<Options>(s, [&acc, &f](auto&&... rs) {
         if constexpr (has_options(Options, options::replace)) {
             acc = std::move(f(std::move(acc), std::forward<decltype(rs)>(rs)...));
         } else {
@@ -93,10 +132,22 @@ inline constexpr auto default_arg(ProvidedArg provided_arg, DefaultArg default_a
 }
 
 template <typename State, typename Size, typename Parser>
-inline constexpr auto times(State& s, Size n, Parser p) {
-    auto start = s.position;
+inline constexpr bool times_recognize(State& s, Size n, const Parser& p) {
     for (Size i = 0; i < n; ++i) {
-        if (auto&& result = apply(p, s); !result) return s.return_fail_result_default(result);
+        if (!recognize(p, s)) return false;
+    }
+    return true;
+}
+
+template <typename State, typename Size, typename Parser>
+inline constexpr auto times(State& s, Size n, const Parser& p) {
+    auto start = s.position;
+    if constexpr (!State::error_messages) {
+        if (!times_recognize(s, n, p)) return s.return_fail();
+    } else {
+        for (Size i = 0; i < n; ++i) {
+            if (auto&& result = apply(p, s); !result) return s.return_fail_result_default(result);
+        }
     }
     return s.return_success(s.convert(start, s.position));
 }
@@ -105,8 +156,15 @@ inline constexpr auto times(State& s, Size n, Parser p) {
  * Recursive helper for `get_parsed`
  */
 template <typename State, typename InputIt, typename Parser, typename... Parsers>
-inline constexpr auto get_parsed_recursive(State& s, InputIt original_position, Parser p, Parsers... ps) {
-    if (auto&& result = apply(p, s)) {
+inline constexpr auto get_parsed_recursive(State& s, InputIt original_position, const Parser& p, const Parsers&... ps) {
+    if constexpr (!State::error_messages) {
+        if (!recognize(p, s)) return s.return_fail();
+        if constexpr (sizeof...(Parsers) == 0) {
+            return s.return_success(s.convert(original_position, s.position));
+        } else {
+            return get_parsed_recursive(s, original_position, ps...);
+        }
+    } else if (auto&& result = apply(p, s)) {
         if constexpr (sizeof...(Parsers) == 0) {
             return s.return_success(s.convert(original_position, s.position));
         } else {
@@ -119,7 +177,7 @@ inline constexpr auto get_parsed_recursive(State& s, InputIt original_position,
 
 // Compile time recursive resolver for lifting of arbitrary number of parsers
 template <typename State, typename InputIt, typename Fn, typename Parser, typename... Parsers>
-inline constexpr auto lift_or_rec(State& s, InputIt start_pos, Fn f, Parser p, Parsers... ps) {
+inline constexpr auto lift_or_rec(State& s, InputIt start_pos, Fn& f, const Parser& p, const Parsers&... ps) {
     using result_type = decltype(f(std::move(*apply(p, s))));
     constexpr auto void_return = std::is_void_v<result_type>;
     if (auto&& result = apply(p, s)) {
@@ -141,6 +199,272 @@ inline constexpr auto lift_or_rec(State& s, InputIt start_pos, Fn f, Parser p, P
     }
 }
 
+// First set of a parser repeated by the `many` family of combinators
+template <options Options, typename... Parsers>
+using first_many = std::conditional_t<has_options(Options, options::fail_on_no_parse),
+                                      first_sequence<first_of_parser<Parsers>...>,
+                                      first_nullable<first_sequence<first_of_parser<Parsers>...>>>;
+
+// Like `lift_or_rec`, but only tries the alternatives in `candidates`
+template <typename State, typename Mask, typename Fn, std::size_t... I, typename... Parsers>
+inline constexpr auto lift_or_dispatch(State& s, Mask candidates, Fn& f, std::index_sequence<I...>,
+                                       const Parsers&... ps) {
+    using first_parser = std::tuple_element_t<0, std::tuple<Parsers...>>;
+    using result_type = decltype(f(std::move(*apply(std::declval<const first_parser&>(), s))));
+    constexpr auto void_return = std::is_void_v<result_type>;
+    using actual_result_type = std::conditional_t<void_return, empty_result, result_type>;
+
+    auto start_pos = s.position;
+    auto res = s.template return_fail<actual_result_type>();
+    auto try_parser = [&](const auto& parser) {
+        if (auto&& result = apply(parser, s)) {
+            if constexpr (void_return) {
+                f(*std::forward<decltype(result)>(result));
+                res = s.template return_success_emplace<empty_result>();
+            } else {
+                res = s.return_success(f(*std::forward<decltype(result)>(result)));
+            }
+            return true;
+        } else {
+            s.set_position(start_pos);
+            res = s.template return_fail_change_result<actual_result_type>(result);
+            return false;
+        }
+    };
+
+    (((candidates & (Mask(1) << I)) && try_parser(ps)) || ...);
+    return res;
+}
+
+// Try the alternatives in order, skipping those whose first set excludes the next item
+template <typename State, typename Fn, typename... Parsers>
+inline constexpr auto lift_or_select(State& s, Fn& f, const Parsers&... ps) {
+    using table = dispatch_table<Parsers...>;
+    if constexpr (table::enabled) {
+        return lift_or_dispatch(s, table::lookup(s), f, std::index_sequence_for<Parsers...>(), ps...);
+    } else {
+        return lift_or_rec(s, s.position, f, ps...);
+    }
+}
+
+/**
+ * Apply `lift_or` with the functor `f`.
+ */
+template <typename State, typename Fn, typename... Parsers>
+inline constexpr auto lift_or_apply(State& s, const Fn& f, const Parsers&... ps) {
+    (types::assert_functor_application<State&, Fn, Parsers>(), ...);
+    if constexpr ((std::is_invocable_v<const Fn&, decltype(std::move(*apply(ps, s)))> && ...)) {
+        return lift_or_select(s, f, ps...);
+    } else {
+        // The functor has a non-const call operator
+        auto fn = f;
+        return lift_or_select(s, fn, ps...);
+    }
+}
+
+// Recognizer mode version of `lift_or_dispatch`
+template <typename State, typename Mask, std::size_t... I, typename... Parsers>
+inline constexpr bool lift_or_recognize_dispatch(State& s, Mask candidates, std::index_sequence<I...>,
+                                                 const Parsers&... ps) {
+    auto start_pos = s.position;
+    auto try_parser = [&](const auto& parser) {
+        if (recognize(parser, s)) return true;
+        s.set_position(start_pos);
+        return false;
+    };
+    return (((candidates & (Mask(1) << I)) && try_parser(ps)) || ...);
+}
+
+// Recognizer mode version of `lift_or_select`
+template <typename State, typename... Parsers>
+inline constexpr bool lift_or_recognize(State& s, const Parsers&... ps) {
+    using table = dispatch_table<Parsers...>;
+    if constexpr (table::enabled) {
+        return lift_or_recognize_dispatch(s, table::lookup(s), std::index_sequence_for<Parsers...>(), ps...);
+    } else {
+        auto start_pos = s.position;
+        return ((recognize(ps, s) || (s.set_position(start_pos), false)) || ...);
+    }
+}
+
+template <typename ReturnType, options Options, typename Fn>
+struct recursive_grammar;
+
+/**
+ * The parser passed to the functor provided to `recursive`.
+ * It refers to the grammar that the functor returned, so that recursion
+ * doesn't need to rebuild it.
+ */
+template <typename ReturnType, options Options, typename Fn>
+struct recursive_reference {
+    const recursive_grammar<ReturnType, Options, Fn>* grammar;
+
+    template <typename State>
+    constexpr auto operator()(State& s) const -> result<ReturnType, typename State::error_type> {
+        constexpr auto max_depth = State::settings::max_depth;
+        if constexpr (max_depth > 0) {
+            if (s.depth == max_depth) {
+                return s.template return_fail<ReturnType>("Maximum recursion depth exceeded");
+            }
+        }
+
+        return call_nested(s, [&]() {
+            if constexpr (has_options(Options, options::heap_stack)) {
+                return call_with_heap_stack(grammar->stack, [&]() { return apply(grammar->p, s); });
+            } else {
+                return apply(grammar->p, s);
+            }
+        });
+    }
+
+    template <typename State>
+    constexpr bool recognize(State& s) const {
+        constexpr auto max_depth = State::settings::max_depth;
+        if constexpr (max_depth > 0) {
+            if (s.depth == max_depth) return false;
+        }
+
+        return call_nested(s, [&]() {
+            if constexpr (has_options(Options, options::heap_stack)) {
+                return call_with_heap_stack(grammar->stack, [&]() { return anpa::recognize(grammar->p, s); });
+            } else {
+                return anpa::recognize(grammar->p, s);
+            }
+        });
+    }
+};
+
+/**
+ * Holder for a grammar built by the functor provided to `recursive`.
+ */
+template <typename ReturnType, options Options, typename Fn>
+struct recursive_grammar {
+    using reference = parser<recursive_reference<ReturnType, Options, Fn>>;
+
+    decltype(std::declval<const Fn&>()(std::declval<reference>())) p;
+
+    // Stack segments used with `options::heap_stack`
+    mutable std::conditional_t<has_options(Options, options::heap_stack), heap_stack, no_arg> stack;
+
+    constexpr recursive_grammar(const Fn& f) : p{f(reference({this}))}, stack{} {}
+
+    // The grammar refers to itself, so it can't be copied.
+    recursive_grammar(const recursive_grammar&) = delete;
+    recursive_grammar& operator=(const recursive_grammar&) = delete;
+};
+
+enum class operator_kind { prefix, infix, postfix };
+
+/**
+ * An operator for `operator_table`
+ */
+template <operator_kind Kind, int Precedence, options Options, typename Parser, typename Fn>
+struct table_operator {
+    constexpr static auto kind = Kind;
+    constexpr static int precedence = Precedence;
+    constexpr static bool right_associative = has_options(Options, options::right_associative);
+
+    Parser p;
+    Fn f;
+};
+
+// An expression may begin with a prefix operator
+template <typename Operator>
+using operator_first = std::conditional_t<Operator::kind == operator_kind::prefix,
+                                          first_of_parser<decltype(Operator::p)>,
+                                          first_items<>>;
+
+// Call `on_match` for `op` if it is of kind `Kind`, has a precedence of at least
+// `min_precedence`, and its token parses. Restores the position otherwise.
+template <operator_kind Kind, typename State, typename OnMatch, typename Operator>
+inline constexpr bool try_operator(State& s, int min_precedence, const OnMatch& on_match, const Operator& op) {
+    if constexpr (Operator::kind != Kind) {
+        return false;
+    } else {
+        if (Operator::precedence < min_precedence) return false;
+        auto start_pos = s.position;
+        if (apply(op.p, s) && on_match(op)) return true;
+        s.set_position(start_pos);
+        return false;
+    }
+}
+
+// Like `match_operator`, but only tries the operators in `candidates`
+template <operator_kind Kind, typename State, typename Mask, typename OnMatch, std::size_t... I, typename... Operators>
+inline constexpr bool match_operator_dispatch(State& s, int min_precedence, Mask candidates, const OnMatch& on_match,
+                                              std::index_sequence<I...>, const Operators&... ops) {
+    constexpr Mask of_kind = ((Operators::kind == Kind ? Mask(1) << I : Mask(0)) | ...);
+    candidates &= of_kind;
+    if (!candidates) return false;
+    return (((candidates & (Mask(1) << I)) && try_operator<Kind>(s, min_precedence, on_match, ops)) || ...);
+}
+
+/**
+ * Call `on_match` for the first operator of kind `Kind`, with a precedence of
+ * at least `min_precedence`, whose token parses. If `on_match` returns `false`
+ * the position is restored and the next operator is tried.
+ *
+ * Only the operators whose tokens may begin with the next item are tried. They
+ * are selected with a table lookup on the first sets of the tokens.
+ *
+ * Returns `true` if an operator was matched.
+ */
+template <operator_kind Kind, typename State, typename OnMatch, typename... Operators>
+inline constexpr bool match_operator(State& s, int min_precedence, const OnMatch& on_match, const Operators&... ops) {
+    using table = dispatch_table<decltype(Operators::p)...>;
+    if constexpr (table::enabled) {
+        return match_operator_dispatch<Kind>(s, min_precedence, table::lookup(s), on_match,
+                                             std::index_sequence_for<Operators...>(), ops...);
+    } else {
+        return (try_operator<Kind>(s, min_precedence, on_match, ops) || ...);
+    }
+}
+
+/**
+ * Precedence climbing for `operator_table`
+ */
+template <typename Value, typename State, typename Atom, typename... Operators>
+inline constexpr auto precedence_climb(State& s, int min_precedence, const Atom& atom, const Operators&... ops)
+        -> decltype(s.template return_fail<Value>()) {
+    constexpr bool has_prefix = ((Operators::kind == operator_kind::prefix) || ...);
+
+    auto operand = [&]() {
+        if constexpr (has_prefix) {
+            auto res = s.template return_fail<Value>();
+            if (match_operator<operator_kind::prefix>(s, std::numeric_limits<int>::min(), [&](const auto& op) {
+                if (auto operand = precedence_climb<Value>(s, op.precedence, atom, ops...)) {
+                    res = s.template return_success_emplace<Value>(op.f(*std::move(operand)));
+                } else {
+                    res = std::move(operand);
+                }
+                return true;
+            }, ops...)) {
+                return res;
+            }
+        }
+        return apply(atom, s);
+    }();
+
+    if (!operand) return operand;
+
+    Value value = *std::move(operand);
+    for (;;) {
+        bool matched = match_operator<operator_kind::postfix>(s, min_precedence, [&](const auto& op) {
+            value = op.f(std::move(value));
+            return true;
+        }, ops...) || match_operator<operator_kind::infix>(s, min_precedence, [&](const auto& op) {
+            auto next_precedence = op.right_associative ? op.precedence : op.precedence + 1;
+            if (auto rhs = precedence_climb<Value>(s, next_precedence, atom, ops...)) {
+                value = op.f(std::move(value), *std::move(rhs));
+                return true;
+            }
+            return false;
+        }, ops...);
+
+        if (!matched) return s.template return_success_emplace<Value>(std::move(value));
+    }
+}
+
 }
 
 #endif // PARSIMON_INTERNAL_COMBINATORS_INTERNAL_H
@@ -0,0 +1,287 @@
+#ifndef PARSIMON_INTERNAL_FIRST_SET_H
+#define PARSIMON_INTERNAL_FIRST_SET_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace anpa {
+
+template <typename P>
+struct parser;
+
+template <typename Parser, typename S>
+constexpr auto apply(Parser&& p, S& s);
+
+template <typename Parser, typename S>
+constexpr bool recognize(Parser&& p, S& s);
+
+}
+
+/**
+ * Compile time sets of the items that a parser may begin with (FIRST sets).
+ *
+ * A parser can only succeed if the next item is in its set, or if it is nullable,
+ * i.e. it may succeed without consuming anything. Alternatives use this to skip
+ * parsers that cannot match, so that the first item selects the branch directly.
+ *
+ * Primitive parsers and most combinators carry their set in their type, and the
+ * sets of composed parsers are computed from the sets of their parts. Parsers
+ * without a set (e.g. user provided lambdas) may begin with anything.
+ *
+ * Sets cover items with a value in `[0, 255]`. Parsers that may begin with other
+ * items are treated as beginning with any item.
+ */
+namespace anpa::internal {
+
+struct first_set {
+    std::array<std::uint64_t, 4> bits{};
+
+    /// The parser may begin with any item.
+    bool any = false;
+
+    /// The parser may succeed without consuming any items.
+    bool nullable = false;
+
+    /// Set for a parser that nothing is known about.
+    static constexpr first_set unknown() {
+        first_set set;
+        set.any = true;
+        set.nullable = true;
+        return set;
+    }
+
+    template <typename... Items>
+    static constexpr first_set of(Items... items) {
+        first_set set;
+        (set.insert(items), ...);
+        return set;
+    }
+
+    template <typename Item>
+    constexpr void insert(Item item) {
+        if constexpr (std::is_integral_v<Item> && !std::is_same_v<Item, bool>) {
+            auto index = static_cast<std::make_unsigned_t<Item>>(item);
+            if (index < 256) {
+                bits[index / 64] |= std::uint64_t(1) << (index % 64);
+                return;
+            }
+        }
+        any = true;
+    }
+
+    constexpr bool test(std::size_t index) const {
+        return any || nullable || ((bits[index / 64] >> (index % 64)) & 1);
+    }
+
+    /// Return whether a parser with this set may succeed when the next item is `item`.
+    template <typename Item>
+    constexpr bool contains(const Item& item) const {
+        if constexpr (std::is_integral_v<Item> && !std::is_same_v<Item, bool>) {
+            auto index = static_cast<std::make_unsigned_t<Item>>(item);
+            return index < 256 ? test(index) : any || nullable;
+        } else {
+            return true;
+        }
+    }
+
+    /// Return whether a parser with this set may succeed on the current state.
+    template <typename State>
+    constexpr bool accepts(const State& s) const {
+        return s.at_end() ? nullable : contains(s.front());
+    }
+
+    /// Return whether a parser with this set must be tried regardless of the next item.
+    constexpr bool is_unknown() const { return any && nullable; }
+
+    constexpr bool disjoint(const first_set& other) const {
+        if (any || other.any || nullable || other.nullable) return false;
+        for (std::size_t i = 0; i < bits.size(); ++i) {
+            if (bits[i] & other.bits[i]) return false;
+        }
+        return true;
+    }
+
+    constexpr first_set operator|(const first_set& other) const {
+        first_set set;
+        for (std::size_t i = 0; i < bits.size(); ++i) set.bits[i] = bits[i] | other.bits[i];
+        set.any = any || other.any;
+        set.nullable = nullable || other.nullable;
+        return set;
+    }
+};
+
+/// Set holding the provided items.
+template <auto... Items>
+struct first_items {
+    static constexpr first_set value = first_set::of(Items...);
+};
+
+/// Set for a parser that may begin with any item, but never succeeds without consuming.
+struct first_any {
+    static constexpr first_set value = []() {
+        first_set set;
+        set.any = true;
+        return set;
+    }();
+};
+
+/// Set for a parser that never consumes anything.
+struct first_nothing {
+    static constexpr first_set value = []() {
+        first_set set;
+        set.nullable = true;
+        return set;
+    }();
+};
+
+/// Set for parsers that nothing is known about.
+struct first_unknown {
+    static constexpr first_set value = first_set::unknown();
+};
+
+/// Set of the items that any of the sets may begin with.
+template <typename... Firsts>
+struct first_alternatives {
+    static constexpr first_set value = (first_set::of() | ... | Firsts::value);
+};
+
+/// Set for the sets applied in sequence.
+template <typename... Firsts>
+struct first_sequence {
+    static constexpr first_set value = []() {
+        first_set set;
+        set.nullable = true;
+        for (const auto& next : {first_nothing::value, Firsts::value...}) {
+            if (!set.nullable) break;
+            set = set | next;
+            set.nullable = next.nullable;
+        }
+        return set;
+    }();
+};
+
+/// Set for a parser that may also succeed without consuming.
+template <typename First>
+struct first_nullable {
+    static constexpr first_set value = First::value | first_nothing::value;
+};
+
+/// Set for a parser that never succeeds without consuming.
+template <typename First>
+struct first_not_nullable {
+    static constexpr first_set value = []() {
+        auto set = First::value;
+        set.nullable = false;
+        return set;
+    }();
+};
+
+/// Set for a parser followed by a parser that is not known until the first has been applied.
+template <typename First>
+struct first_then_unknown {
+    static constexpr first_set value = First::value.nullable ? first_set::unknown() : First::value;
+};
+
+/**
+ * A parser annotated with the set of items that it may begin with.
+ */
+template <typename First, typename P>
+struct first_annotated {
+    using first_type = First;
+
+    P p;
+
+    template <typename State>
+    constexpr auto operator()(State& s) const {
+        return apply(p, s);
+    }
+
+    template <typename State>
+    constexpr bool recognize(State& s) const {
+        return anpa::recognize(p, s);
+    }
+};
+
+/// Get the first set of a parser type. Parsers without annotation may begin with anything.
+template <typename P, typename = void>
+struct first_of_parser : first_unknown {};
+
+/// Parsers may also declare their set as the member type `first_type`.
+template <typename P>
+struct first_of_parser<P, std::void_t<typename P::first_type>> {
+    static constexpr first_set value = P::first_type::value;
+};
+
+template <typename P>
+struct first_of_parser<parser<P>> : first_of_parser<P> {};
+
+template <typename P>
+constexpr first_set first_set_v = first_of_parser<std::decay_t<P>>::value;
+
+/// Annotate a parser with a first set, unless nothing is known about the set.
+template <typename First, typename P>
+constexpr auto with_first(P p) {
+    if constexpr (First::value.is_unknown()) {
+        return parser<P>(p);
+    } else {
+        return parser<first_annotated<First, P>>(first_annotated<First, P>{p});
+    }
+}
+
+/**
+ * Table mapping an item to the alternatives (one bit each) that may begin with it.
+ */
+template <typename... Parsers>
+struct dispatch_table {
+    using mask_type = std::uint64_t;
+
+    static constexpr bool enabled = sizeof...(Parsers) <= 64 && (!first_set_v<Parsers>.is_unknown() || ...);
+
+    static constexpr std::array<first_set, sizeof...(Parsers)> sets{first_set_v<Parsers>...};
+
+    /// Alternatives to try at the end of input.
+    static constexpr mask_type at_end = []() {
+        mask_type mask = 0;
+        for (std::size_t i = 0; i < sets.size(); ++i) {
+            if (sets[i].nullable) mask |= mask_type(1) << i;
+        }
+        return mask;
+    }();
+
+    /// Alternatives to try for items outside of the table.
+    static constexpr mask_type other = []() {
+        mask_type mask = 0;
+        for (std::size_t i = 0; i < sets.size(); ++i) {
+            if (sets[i].any || sets[i].nullable) mask |= mask_type(1) << i;
+        }
+        return mask;
+    }();
+
+    static constexpr std::array<mask_type, 256> candidates = []() {
+        std::array<mask_type, 256> table{};
+        for (std::size_t c = 0; c < table.size(); ++c) {
+            for (std::size_t i = 0; i < sets.size(); ++i) {
+                if (sets[i].test(c)) table[c] |= mask_type(1) << i;
+            }
+        }
+        return table;
+    }();
+
+    template <typename State>
+    static constexpr mask_type lookup(const State& s) {
+        if (s.at_end()) return at_end;
+        using item_type = std::decay_t<decltype(s.front())>;
+        if constexpr (std::is_integral_v<item_type> && !std::is_same_v<item_type, bool>) {
+            auto index = static_cast<std::make_unsigned_t<item_type>>(s.front());
+            return index < 256 ? candidates[index] : other;
+        } else {
+            return ~mask_type(0);
+        }
+    }
+};
+
+}
+
+#endif // PARSIMON_INTERNAL_FIRST_SET_H
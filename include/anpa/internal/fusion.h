@@ -0,0 +1,294 @@
+#ifndef PARSIMON_INTERNAL_FUSION_H
+#define PARSIMON_INTERNAL_FUSION_H
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <tuple>
+#include <utility>
+#include "anpa/core.h"
+#include "anpa/options.h"
+#include "anpa/types.h"
+#include "anpa/internal/algorithm.h"
+#include "anpa/internal/first_set.h"
+#include "anpa/internal/parsers_internal.h"
+
+/**
+ * Parsers for literals and single items, and the compile time rewrites
+ * (fusion) of common combinations of them.
+ *
+ * The parsers are named types instead of lambdas, so that combinators can
+ * recognize them and replace a combination with an equivalent, cheaper parser:
+ *
+ * - `item<'a'>() >> seq<'b', 'c'>()` is applied as one literal `abc`
+ * - `seq(b1, e1) >> seq(b2, e2)` is applied as one comparison of both sequences
+ * - `many(item_if(pred))` is applied as `while_if(pred)`
+ * - `until(item<'a'>())` is applied as `until_item<'a'>()`
+ *
+ * A fused parser behaves exactly as the original combination, including the
+ * result, and the position and error upon failure.
+ */
+namespace anpa::internal {
+
+enum class literal_kind { item, seq };
+
+/**
+ * Parser for the items `Items` in sequence. `Parts` is an `std::index_sequence` with the
+ * lengths of the literals that were fused into this parser. The result is that of the last part,
+ * i.e. a single item for `literal_kind::item`, and the converted range for `literal_kind::seq`.
+ */
+template <literal_kind Kind, options Options, typename Parts, auto... Items>
+struct literal_parser;
+
+template <literal_kind Kind, options Options, std::size_t... Lengths, auto Item, auto... Items>
+struct literal_parser<Kind, Options, std::index_sequence<Lengths...>, Item, Items...> {
+    using first_type = first_items<Item>;
+
+    static constexpr std::size_t size = sizeof...(Items) + 1;
+    static constexpr std::size_t parts = sizeof...(Lengths);
+    static constexpr std::array<std::size_t, parts> lengths{Lengths...};
+
+    /// Offset of the last part, which holds the result.
+    static constexpr std::size_t result_offset = size - lengths[parts - 1];
+
+    static constexpr std::array<std::common_type_t<decltype(Item), decltype(Items)...>, size> items{Item, Items...};
+
+    static constexpr auto last_item = std::get<size - 1>(std::make_tuple(Item, Items...));
+
+    /**
+     * Return the number of items in the parts that match completely.
+     * This is where the unfused parsers would stop upon failure.
+     */
+    template <typename InputIt>
+    static constexpr std::size_t matched_parts(InputIt pos, InputIt end) {
+        std::size_t matched = 0;
+        bool equal = true;
+        auto match = [&](const auto& item) {
+            equal = equal && pos != end && *pos == item;
+            if (equal) ++pos, ++matched;
+        };
+        match(Item);
+        (match(Items), ...);
+        std::size_t boundary = 0, result = 0;
+        for (std::size_t i = 0; i + 1 < parts; ++i) {
+            boundary += lengths[i];
+            if (boundary <= matched) result = boundary;
+        }
+        return result;
+    }
+
+    /// Whether the literal can be compared with padded input without checking its length,
+    /// since the padding doesn't match it.
+    template <typename State>
+    static constexpr bool compare_padded = State::padded_input && size <= input_padding &&
+                                           ((Item != 0) && ... && (Items != 0));
+
+    template <typename State>
+    constexpr bool recognize(State& s) const {
+        auto start = s.position;
+        if ((compare_padded<State> || s.has_at_least(size)) && algorithm::equal<Item, Items...>(start)) {
+            s.advance(size);
+            return true;
+        }
+        if constexpr (parts > 1) {
+            s.advance(matched_parts(start, s.end));
+        }
+        return false;
+    }
+
+    template <typename State>
+    constexpr auto operator()(State& s) const {
+        auto start = s.position;
+        if (recognize(s)) {
+            if constexpr (Kind == literal_kind::item) {
+                if constexpr (has_options(Options, options::return_arg)) {
+                    return s.return_success(last_item);
+                } else {
+                    return s.return_success(s.get_at(std::next(start, result_offset)));
+                }
+            } else {
+                return s.return_success(s.convert(std::next(start, result_offset), s.position));
+            }
+        }
+
+        if constexpr (Kind == literal_kind::item) {
+            using return_type = std::conditional_t<has_options(Options, options::return_arg),
+                                                   decltype(last_item), decltype(s.front())>;
+            return s.template return_fail<return_type>();
+        } else {
+            return s.return_fail();
+        }
+    }
+};
+
+/**
+ * Parser for the sequences described by `[begin, end)` of each part, in sequence.
+ * The result is the last sequence.
+ */
+template <typename InputIt, std::size_t N>
+struct sequence_parser {
+    std::array<std::pair<InputIt, InputIt>, N> parts;
+    std::size_t size;
+
+    template <typename State>
+    constexpr bool recognize(State& s) const {
+        if (s.has_at_least(size)) {
+            auto pos = s.position;
+            bool equal = true;
+            for (std::size_t i = 0; i < N && equal; ++i) {
+                equal = algorithm::equal(parts[i].first, parts[i].second, pos);
+                std::advance(pos, std::distance(parts[i].first, parts[i].second));
+            }
+            if (equal) {
+                s.set_position(pos);
+                return true;
+            }
+        }
+
+        // Stop where the unfused parsers would have stopped.
+        for (std::size_t i = 0; i + 1 < N; ++i) {
+            auto length = std::distance(parts[i].first, parts[i].second);
+            if (!s.has_at_least(length) || !algorithm::equal(parts[i].first, parts[i].second, s.position)) break;
+            s.advance(length);
+        }
+        return false;
+    }
+
+    template <typename State>
+    constexpr auto operator()(State& s) const {
+        auto start = s.position;
+        if (recognize(s)) {
+            auto last_length = std::distance(parts[N - 1].first, parts[N - 1].second);
+            return s.return_success(s.convert(std::next(start, size - last_length), s.position));
+        }
+        return s.return_fail();
+    }
+};
+
+template <typename InputIt>
+constexpr auto make_sequence_parser(InputIt begin, InputIt end) {
+    auto size = static_cast<std::size_t>(std::distance(begin, end));
+    return sequence_parser<InputIt, 1>{{std::pair(std::move(begin), std::move(end))}, size};
+}
+
+/**
+ * Parser for a single item matching `pred`.
+ * `First` is the first set of the items matching the predicate, if known.
+ */
+template <typename Pred, typename First = first_any>
+struct item_if_parser {
+    using first_type = First;
+
+    Pred pred;
+
+    template <typename State>
+    constexpr auto operator()(State& s) const {
+        return item(s, pred);
+    }
+};
+
+template <typename P1, typename P2>
+struct fused_sequence {
+    static constexpr bool value = false;
+};
+
+template <literal_kind Kind1, options Options1, std::size_t... Lengths1, auto... Items1,
+          literal_kind Kind2, options Options2, std::size_t... Lengths2, auto... Items2>
+struct fused_sequence<literal_parser<Kind1, Options1, std::index_sequence<Lengths1...>, Items1...>,
+                      literal_parser<Kind2, Options2, std::index_sequence<Lengths2...>, Items2...>> {
+    static constexpr bool value = true;
+    using type = literal_parser<Kind2, Options2, std::index_sequence<Lengths1..., Lengths2...>, Items1..., Items2...>;
+
+    template <typename P1, typename P2>
+    static constexpr auto fuse(const P1&, const P2&) {
+        return type{};
+    }
+};
+
+template <typename InputIt, std::size_t N1, std::size_t N2>
+struct fused_sequence<sequence_parser<InputIt, N1>, sequence_parser<InputIt, N2>> {
+    static constexpr bool value = true;
+    using type = sequence_parser<InputIt, N1 + N2>;
+
+    template <typename P1, typename P2, std::size_t... I>
+    static constexpr auto fuse(const P1& p1, const P2& p2, std::index_sequence<I...>) {
+        return type{{(I < N1 ? p1.parts[I] : p2.parts[I - N1])...}, p1.size + p2.size};
+    }
+
+    template <typename P1, typename P2>
+    static constexpr auto fuse(const P1& p1, const P2& p2) {
+        return fuse(p1, p2, std::make_index_sequence<N1 + N2>());
+    }
+};
+
+/**
+ * Return whether `p1 >> p2` can be applied as a single parser.
+ */
+template <typename P1, typename P2>
+constexpr bool can_fuse_sequence = fused_sequence<P1, P2>::value;
+
+/**
+ * Fuse `p1 >> p2` into a single parser.
+ */
+template <typename P1, typename P2>
+constexpr auto fuse_sequence(const parser<P1>& p1, const parser<P2>& p2) {
+    using fused = fused_sequence<P1, P2>;
+    return parser<typename fused::type>(fused::fuse(p1.p, p2.p));
+}
+
+/// Return whether `many(p)` can be applied as `while_if`.
+template <typename P>
+constexpr bool can_fuse_many = false;
+
+template <typename Pred, typename First>
+constexpr bool can_fuse_many<parser<item_if_parser<Pred, First>>> = true;
+
+template <options Options, auto Item>
+constexpr bool can_fuse_many<parser<literal_parser<literal_kind::item, Options, std::index_sequence<1>, Item>>> = true;
+
+/**
+ * Fuse `many(p)`, where `p` parses a single item, into `while_if`.
+ */
+template <options Options, typename Pred, typename First>
+constexpr auto fuse_many(const parser<item_if_parser<Pred, First>>& p) {
+    return while_if<Options, First>(p.p.pred);
+}
+
+template <options Options, options ItemOptions, auto Item>
+constexpr auto fuse_many(const parser<literal_parser<literal_kind::item, ItemOptions, std::index_sequence<1>, Item>>&) {
+    return while_if<Options, first_items<Item>>([](const auto& c) { return c == Item; });
+}
+
+/// Return whether `until(p)` can be applied as `until_item` or `until_seq`.
+template <typename P>
+constexpr bool can_fuse_until = false;
+
+template <literal_kind Kind, options Options, std::size_t Length, auto... Items>
+constexpr bool can_fuse_until<parser<literal_parser<Kind, Options, std::index_sequence<Length>, Items...>>> = true;
+
+/**
+ * Fuse `until(p)`, where `p` is a literal, into `until_item` or `until_seq`.
+ */
+template <options Options, literal_kind Kind, options LiteralOptions, std::size_t Length, auto Item, auto... Items>
+constexpr auto fuse_until(const parser<literal_parser<Kind, LiteralOptions, std::index_sequence<Length>, Item, Items...>>&) {
+    using literal = literal_parser<Kind, LiteralOptions, std::index_sequence<Length>, Item, Items...>;
+    if constexpr (sizeof...(Items) == 0) {
+        return parser(with_recognizer([](auto& s, auto recognize_only) {
+            if constexpr (recognize_only) {
+                return until_item_recognize<Options>(s, Item);
+            } else {
+                return until_item<Options>(s, Item);
+            }
+        }));
+    } else {
+        return parser([](auto& s) {
+            return until_seq<Options>(s, [](auto b, auto e) {
+                return algorithm::search(b, e, literal::items.begin(), literal::items.end());
+            });
+        });
+    }
+}
+
+}
+
+#endif // PARSIMON_INTERNAL_FUSION_H
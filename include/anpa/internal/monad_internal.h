@@ -24,7 +24,7 @@ inline constexpr auto curry_n(Fn f) {
 }
 
 template <typename ResultType, typename State, typename Fn, typename Parser, typename... Ps>
-inline constexpr auto lift_internal(State& s, Fn f, Parser p, Ps... ps) {
+inline constexpr auto lift_internal(State& s, Fn f, const Parser& p, const Ps&... ps) {
     if (auto&& res = apply(p, s)) {
         if constexpr (sizeof...(ps) == 0) {
             return f(*std::forward<decltype(res)>(res));
@@ -37,19 +37,73 @@ inline constexpr auto lift_internal(State& s, Fn f, Parser p, Ps... ps) {
 }
 
 /**
- * Intermediate step for lifting
+ * Evaluate the parsers in sequence and apply `f` to the state and the results.
+ */
+template <typename State, typename Fn, typename... Parsers>
+inline constexpr auto lift_apply(State& s, const Fn& f, const Parsers&... ps) {
+    types::assert_functor_application_modify<decltype(s), Fn, decltype(s), Parsers...>();
+    using result_type = std::decay_t<decltype(*f(s, *apply(ps, s)...))>;
+    if constexpr (sizeof...(Parsers) == 0) {
+        return f(s);
+    } else {
+        return lift_internal<result_type>(s, curry_n<sizeof...(Parsers) + 1>(f)(s), ps...);
+    }
+}
+
+/**
+ * Parser for the result of `P` when only its success matters.
+ * The result is `empty_result`, and `P` is applied in recognizer mode unless its error is needed.
+ */
+template <typename P>
+struct recognized {
+    P p;
+
+    template <typename State>
+    constexpr auto operator()(State& s) const {
+        if constexpr (State::error_messages) {
+            if (auto&& result = apply(p, s); !result) {
+                return s.template return_fail_change_result<empty_result>(result);
+            }
+        } else if (!recognize(p, s)) {
+            return s.template return_fail<empty_result>();
+        }
+        return s.template return_success_emplace<empty_result>();
+    }
+};
+
+/**
+ * Intermediate step for lifting.
+ * In recognizer mode `f` is only called if the state doesn't skip functors.
  */
 template <typename Fn, typename... Parsers>
 inline constexpr auto lift_prepare(Fn f, Parsers... ps) {
-    return parser([=](auto& s) {
-        types::assert_functor_application_modify<decltype(s), Fn, decltype(s), Parsers...>();
-        using result_type = std::decay_t<decltype(*f(s, *apply(ps, s)...))>;
-        if constexpr (sizeof...(Parsers) == 0) {
-            return f(s);
+    return with_first<first_sequence<first_of_parser<Parsers>...>>(with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (!recognize_only) {
+            return lift_apply(s, f, ps...);
+        } else if (s.skip_functors) {
+            return (recognize(ps, s) && ...);
+        } else {
+            return bool(lift_apply(s, f, ps...));
+        }
+    }));
+}
+
+/**
+ * Wrap a functor so that its return value is put in the parser monad.
+ * `void` (or a missing functor) results in `empty_result`.
+ */
+template <typename Fn>
+inline constexpr auto lift_function(Fn f) {
+    return [f](auto& s, auto&&... rs) {
+        if constexpr (!types::has_arg<Fn>) {
+            return s.template return_success_emplace<empty_result>();
+        } else if constexpr (std::is_void_v<decltype(f(std::forward<decltype(rs)>(rs)...))>) {
+            f(std::forward<decltype(rs)>(rs)...);
+            return s.template return_success_emplace<empty_result>();
         } else {
-            return lift_internal<result_type>(s, curry_n<sizeof...(Parsers) + 1>(f)(s), ps...);
+            return s.template return_success(f(std::forward<decltype(rs)>(rs)...));
         }
-    });
+    };
 }
 
 /**
@@ -8,26 +8,41 @@
 
 namespace anpa::internal {
 
+/**
+ * Return whether the padding after the input (see `parser_settings::padded_input`) satisfies
+ * `stop`, so that a parser that stops at items satisfying `stop` doesn't need to check for the end.
+ */
+template <typename State, typename Predicate>
+inline constexpr bool stops_at_padding(const Predicate& stop) {
+    if constexpr (State::padded_input) {
+        using item_type = std::remove_cv_t<std::remove_pointer_t<decltype(std::declval<State&>().position)>>;
+        return stop(item_type{});
+    } else {
+        return false;
+    }
+}
+
 /**
  * Parser for a single item
  */
 template <options Options = options::none, typename State, typename Predicate, typename Item = no_arg>
-inline constexpr auto item(State& s, Predicate pred, const Item& i = no_arg()) {
+inline constexpr auto item(State& s, const Predicate& pred, const Item& i = no_arg()) {
     constexpr bool has_item_arg = types::has_arg<Item>;
     constexpr bool return_arg = has_options(Options, options::return_arg);
     static_assert (has_item_arg || !return_arg,
             "If return_arg is `true` then `Item` cannot be `no_arg`");
 
     using return_type = std::conditional_t<return_arg, Item, decltype(s.front())>;
-    if (!s.at_end()) {
+    auto matches = [&pred, &i](const auto& front) {
+        if constexpr (has_item_arg) {
+            return pred(front, i);
+        } else {
+            return pred(front);
+        }
+    };
+    if (stops_at_padding<State>([&](const auto& c) { return !matches(c); }) || !s.at_end()) {
         const auto& front = s.front();
-        bool success = [pred, &front, &i]() {
-            if constexpr (has_item_arg) {
-                return pred(front, i);
-            } else {
-                return pred(front);
-            }
-        }();
+        bool success = matches(front);
         if (success) {
             s.advance(1);
             if constexpr (return_arg) {
@@ -50,6 +65,15 @@ inline constexpr auto consume(State& s, const Length& l) {
     return s.return_fail();
 }
 
+template <options Options, typename State, typename ItemType>
+inline constexpr bool until_item_recognize(State& s, const ItemType& c) {
+    if (auto pos = algorithm::find(s.position, s.end, c); pos != s.end) {
+        s.set_position(std::next(pos, !has_options(Options, options::dont_eat)));
+        return true;
+    }
+    return false;
+}
+
 template <options Options, typename State, typename ItemType>
 inline constexpr auto until_item(State& s, const ItemType& c) {
     constexpr bool include = has_options(Options, options::include);
@@ -64,9 +88,14 @@ inline constexpr auto until_item(State& s, const ItemType& c) {
     }
 }
 
-template <options Options, typename Predicate>
+/**
+ * Parser for all items matching `predicate`.
+ * `Matching` is the first set of the items matching the predicate, if known.
+ */
+template <options Options, typename Matching = first_any, typename Predicate>
 inline constexpr auto while_if(Predicate predicate) {
-    return parser([=](auto& s) {
+    using first = std::conditional_t<has_options(Options, options::fail_on_no_parse), Matching, first_nullable<Matching>>;
+    return with_first<first>([=](auto& s) {
         auto start_pos = s.position;
         auto result = [&]() {
             if constexpr (has_options(Options, options::negate)) {
@@ -83,25 +112,11 @@ inline constexpr auto while_if(Predicate predicate) {
     });
 }
 
-/**
- * Helper for parsing of sequences
- */
-template <typename State, typename Eq>
-inline constexpr auto seq(State& s, size_t size, Eq equal) {
-    auto orig_pos = s.position;
-    if (s.has_at_least(size) && equal(orig_pos)) {
-        s.advance(size);
-        return s.return_success(s.convert(orig_pos, size));
-    } else {
-        return s.return_fail();
-    }
-}
-
 /**
  * Helper for parsing until a sequence
  */
 template <options Options, typename State, typename Search>
-inline constexpr auto until_seq(State& s, Search search) {
+inline constexpr auto until_seq(State& s, const Search& search) {
     if (auto [pos, new_end] = search(s.position, s.end); pos != s.end) {
         auto res_start = s.position;
         auto res_end = has_options(Options, options::include) ? new_end : pos;
@@ -0,0 +1,519 @@
+#ifndef PARSIMON_INTERNAL_PEG_H
+#define PARSIMON_INTERNAL_PEG_H
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include "anpa/internal/first_set.h"
+#include "anpa/internal/regex.h"
+
+/**
+ * Compile time parsing of PEG grammars to an abstract syntax tree.
+ *
+ * Syntax:
+ * ```
+ * grammar    <- definition+
+ * definition <- identifier '<-' expression
+ * expression <- sequence ('/' sequence)*
+ * sequence   <- prefix*
+ * prefix     <- ('&' / '!')? suffix
+ * suffix     <- primary ('?' / '*' / '+')?
+ * primary    <- identifier !'<-' / '(' expression ')' / literal / class / '.'
+ * ```
+ *
+ * Literals are quoted with `'` or `"`, and classes are written as `[a-z_]` or `[^"\\]`.
+ * `\n`, `\r`, `\t` and `\` followed by any other character may be used in both.
+ * Whitespace separates tokens, and `#` starts a comment that runs to the end of the line.
+ */
+namespace anpa::internal::peg {
+
+enum class node_kind {
+    choice,
+    sequence,
+    and_predicate,
+    not_predicate,
+    optional,
+    zero_or_more,
+    one_or_more,
+    literal,
+    char_class,
+    any,
+    reference
+};
+
+struct node {
+    node_kind kind = node_kind::sequence;
+
+    /**
+     * The offset of the children (choice, sequence), the child (predicates, repetition),
+     * the offset of the characters (literal), the class (char_class), or the rule (reference).
+     */
+    std::size_t first = 0;
+
+    /// The number of children (choice, sequence) or characters (literal).
+    std::size_t size = 0;
+
+    /// The name of a referenced rule.
+    std::string_view name{};
+};
+
+struct rule {
+    std::string_view name{};
+    std::size_t node = 0;
+};
+
+/**
+ * The syntax tree of a grammar. The first rule is the start rule.
+ * With all capacities 0 the tree is only measured.
+ */
+template <std::size_t Nodes, std::size_t Children, std::size_t Chars, std::size_t Classes, std::size_t Rules>
+struct ast {
+    static constexpr bool store = Rules > 0;
+
+    template <typename T, std::size_t N>
+    using storage = std::array<T, (N > 0 ? N : 1)>;
+
+    storage<node, Nodes> nodes{};
+    storage<std::size_t, Children> children{};
+    storage<char, Chars> chars{};
+    storage<regex::char_set, Classes> classes{};
+
+    /// Whether a class also matches the items outside of `[0, 255]`.
+    storage<bool, Classes> negated{};
+
+    storage<rule, Rules> rules{};
+
+    std::size_t node_count = 0;
+    std::size_t child_count = 0;
+    std::size_t char_count = 0;
+    std::size_t class_count = 0;
+    std::size_t rule_count = 0;
+
+    // Nodes that will become children of the node being parsed
+    storage<std::size_t, Nodes> stack{};
+    std::size_t stack_size = 0;
+
+    bool error = false;
+
+    constexpr std::size_t add_node(node_kind kind, std::size_t first = 0, std::size_t size = 0) {
+        if constexpr (store) {
+            nodes[node_count] = node{kind, first, size, {}};
+        }
+        return node_count++;
+    }
+
+    constexpr std::size_t add_reference(std::string_view name) {
+        if constexpr (store) {
+            nodes[node_count] = node{node_kind::reference, 0, 0, name};
+        }
+        return node_count++;
+    }
+
+    constexpr void add_char(char c) {
+        if constexpr (store) {
+            chars[char_count] = c;
+        }
+        ++char_count;
+    }
+
+    constexpr std::size_t add_class(const regex::char_set& set, bool negate) {
+        if constexpr (store) {
+            classes[class_count] = set;
+            negated[class_count] = negate;
+        }
+        return class_count++;
+    }
+
+    constexpr void add_rule(std::string_view name, std::size_t n) {
+        if constexpr (store) {
+            for (std::size_t i = 0; i < rule_count; ++i) {
+                if (rules[i].name == name) error = true;
+            }
+            rules[rule_count] = rule{name, n};
+        }
+        ++rule_count;
+    }
+
+    constexpr void push(std::size_t n) {
+        if constexpr (store) {
+            stack[stack_size] = n;
+        }
+        ++stack_size;
+    }
+
+    /// Make a node of the nodes pushed since `mark`, or return the node if there is only one.
+    constexpr std::size_t make_parent(node_kind kind, std::size_t mark) {
+        auto size = stack_size - mark;
+        if (size == 1) {
+            stack_size = mark;
+            if constexpr (store) {
+                return stack[mark];
+            } else {
+                return 0;
+            }
+        }
+        auto first = child_count;
+        for (std::size_t i = 0; i < size; ++i) {
+            if constexpr (store) {
+                children[child_count] = stack[mark + i];
+            }
+            ++child_count;
+        }
+        stack_size = mark;
+        return add_node(kind, first, size);
+    }
+
+    /// Bind references to the rules with their names.
+    constexpr void resolve() {
+        if constexpr (store) {
+            for (std::size_t n = 0; n < node_count; ++n) {
+                if (nodes[n].kind != node_kind::reference) continue;
+                bool found = false;
+                for (std::size_t r = 0; r < rule_count && !found; ++r) {
+                    if (rules[r].name == nodes[n].name) {
+                        nodes[n].first = r;
+                        found = true;
+                    }
+                }
+                if (!found) error = true;
+            }
+        }
+    }
+
+    /// Return the index of the rule `name`, or the number of rules if there is none.
+    constexpr std::size_t find_rule(std::string_view name) const {
+        for (std::size_t r = 0; r < rule_count; ++r) {
+            if (rules[r].name == name) return r;
+        }
+        return rule_count;
+    }
+};
+
+/**
+ * Recursive descent parser for a grammar, building the syntax tree.
+ */
+template <typename Ast>
+struct compiler {
+    std::string_view text;
+    Ast& tree;
+    std::size_t pos = 0;
+
+    constexpr bool at_end() const { return pos >= text.size(); }
+    constexpr char peek() const { return at_end() ? '\0' : text[pos]; }
+
+    constexpr void fail() {
+        tree.error = true;
+        pos = text.size();
+    }
+
+    static constexpr bool is_identifier_start(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    static constexpr bool is_identifier(char c) {
+        return is_identifier_start(c) || (c >= '0' && c <= '9');
+    }
+
+    constexpr void spacing() {
+        while (!at_end()) {
+            auto c = peek();
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                ++pos;
+            } else if (c == '#') {
+                while (!at_end() && peek() != '\n') ++pos;
+            } else {
+                break;
+            }
+        }
+    }
+
+    constexpr std::string_view identifier() {
+        auto start = pos;
+        if (is_identifier_start(peek())) {
+            while (!at_end() && is_identifier(peek())) ++pos;
+        }
+        return text.substr(start, pos - start);
+    }
+
+    constexpr bool arrow() const {
+        return pos + 1 < text.size() && text[pos] == '<' && text[pos + 1] == '-';
+    }
+
+    // Return whether a definition begins at the current position
+    constexpr bool at_definition() {
+        auto start = pos;
+        bool result = !identifier().empty();
+        spacing();
+        result = result && arrow();
+        pos = start;
+        return result;
+    }
+
+    constexpr void compile() {
+        spacing();
+        if (at_end()) fail();
+        while (!at_end()) {
+            definition();
+        }
+        tree.resolve();
+    }
+
+    constexpr void definition() {
+        auto name = identifier();
+        spacing();
+        if (name.empty() || !arrow()) return fail();
+        pos += 2;
+        spacing();
+        auto n = expression();
+        tree.add_rule(name, n);
+    }
+
+    constexpr std::size_t expression() {
+        auto mark = tree.stack_size;
+        tree.push(sequence());
+        while (peek() == '/') {
+            ++pos;
+            spacing();
+            tree.push(sequence());
+        }
+        return tree.make_parent(node_kind::choice, mark);
+    }
+
+    constexpr std::size_t sequence() {
+        auto mark = tree.stack_size;
+        while (!at_end() && peek() != '/' && peek() != ')' && !at_definition()) {
+            tree.push(prefix());
+        }
+        return tree.make_parent(node_kind::sequence, mark);
+    }
+
+    constexpr std::size_t prefix() {
+        auto c = peek();
+        if (c == '&' || c == '!') {
+            ++pos;
+            spacing();
+            auto child = suffix();
+            return tree.add_node(c == '&' ? node_kind::and_predicate : node_kind::not_predicate, child);
+        }
+        return suffix();
+    }
+
+    constexpr std::size_t suffix() {
+        auto child = primary();
+        auto c = peek();
+        auto kind = c == '?' ? node_kind::optional :
+                    c == '*' ? node_kind::zero_or_more :
+                    c == '+' ? node_kind::one_or_more : node_kind::sequence;
+        if (kind == node_kind::sequence) return child;
+        ++pos;
+        spacing();
+        return tree.add_node(kind, child);
+    }
+
+    constexpr std::size_t primary() {
+        auto c = peek();
+        if (is_identifier_start(c)) {
+            auto name = identifier();
+            spacing();
+            return tree.add_reference(name);
+        }
+        ++pos;
+        switch (c) {
+        case '(': {
+            spacing();
+            auto n = expression();
+            if (peek() != ')') fail();
+            ++pos;
+            spacing();
+            return n;
+        }
+        case '\'': case '"':
+            return literal(c);
+        case '[':
+            return char_class();
+        case '.':
+            spacing();
+            return tree.add_node(node_kind::any);
+        default:
+            fail();
+            return 0;
+        }
+    }
+
+    // The character after `\`
+    constexpr char escape() {
+        if (at_end()) {
+            fail();
+            return '\0';
+        }
+        auto c = text[pos++];
+        return c == 'n' ? '\n' : c == 'r' ? '\r' : c == 't' ? '\t' : c;
+    }
+
+    constexpr std::size_t literal(char quote) {
+        auto first = tree.char_count;
+        while (!at_end() && peek() != quote) {
+            auto c = text[pos++];
+            tree.add_char(c == '\\' ? escape() : c);
+        }
+        if (at_end()) fail();
+        ++pos;
+        spacing();
+        return tree.add_node(node_kind::literal, first, tree.char_count - first);
+    }
+
+    constexpr std::size_t char_class() {
+        regex::char_set set;
+        bool negate = peek() == '^';
+        if (negate) ++pos;
+        while (!at_end() && peek() != ']') {
+            auto c = text[pos++];
+            if (c == '\\') c = escape();
+            auto last = c;
+            if (peek() == '-' && pos + 1 < text.size() && text[pos + 1] != ']') {
+                ++pos;
+                last = text[pos++];
+                if (last == '\\') last = escape();
+            }
+            auto from = static_cast<unsigned char>(c);
+            auto to = static_cast<unsigned char>(last);
+            if (from > to) fail();
+            else set.set_range(from, to);
+        }
+        if (at_end()) fail();
+        ++pos;
+        spacing();
+        if (negate) set.invert();
+        return tree.add_node(node_kind::char_class, tree.add_class(set, negate));
+    }
+};
+
+/**
+ * The syntax tree of the grammar `Text`.
+ */
+template <auto& Text>
+struct compiled {
+    static constexpr std::string_view text{Text};
+
+    static constexpr auto sizes = []() {
+        ast<0, 0, 0, 0, 0> counter;
+        compiler<decltype(counter)> c{text, counter};
+        c.compile();
+        return std::array<std::size_t, 5>{counter.node_count, counter.child_count, counter.char_count,
+                                          counter.class_count, counter.rule_count};
+    }();
+
+    using ast_type = ast<sizes[0], sizes[1], sizes[2], sizes[3], sizes[4]>;
+
+    static constexpr ast_type value = []() {
+        ast_type tree;
+        compiler<ast_type> c{text, tree};
+        c.compile();
+        return tree;
+    }();
+
+    static_assert(!value.error, "Invalid grammar");
+};
+
+/**
+ * Return the first set of the node `n`, given the sets of the rules.
+ */
+template <typename Ast, typename Rules>
+constexpr first_set node_first(const Ast& tree, const Rules& rules, std::size_t n) {
+    const auto& current = tree.nodes[n];
+    first_set set;
+    switch (current.kind) {
+    case node_kind::literal:
+        if (current.size == 0) return first_nothing::value;
+        set.insert(tree.chars[current.first]);
+        return set;
+    case node_kind::char_class:
+        set.bits = tree.classes[current.first].bits;
+        set.any = tree.negated[current.first];
+        return set;
+    case node_kind::any:
+        return first_any::value;
+    case node_kind::reference:
+        return rules[current.first];
+    case node_kind::choice:
+        for (std::size_t i = 0; i < current.size; ++i) {
+            set = set | node_first(tree, rules, tree.children[current.first + i]);
+        }
+        return set;
+    case node_kind::sequence:
+        set.nullable = true;
+        for (std::size_t i = 0; i < current.size && set.nullable; ++i) {
+            auto next = node_first(tree, rules, tree.children[current.first + i]);
+            set = set | next;
+            set.nullable = next.nullable;
+        }
+        return set;
+    case node_kind::and_predicate:
+    case node_kind::optional:
+    case node_kind::zero_or_more:
+        return node_first(tree, rules, current.first) | first_nothing::value;
+    case node_kind::one_or_more:
+        return node_first(tree, rules, current.first);
+    case node_kind::not_predicate:
+    default:
+        return first_set::unknown();
+    }
+}
+
+/**
+ * First sets of the rules of the grammar `Text`, computed as the least fixed point
+ * of the (possibly recursive) rules.
+ */
+template <auto& Text>
+struct rule_firsts {
+    static constexpr auto value = []() {
+        const auto& tree = compiled<Text>::value;
+        std::array<first_set, compiled<Text>::sizes[4]> rules{};
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (std::size_t r = 0; r < rules.size(); ++r) {
+                auto set = node_first(tree, rules, tree.rules[r].node);
+                bool same = set.any == rules[r].any && set.nullable == rules[r].nullable;
+                for (std::size_t i = 0; i < set.bits.size(); ++i) same = same && set.bits[i] == rules[r].bits[i];
+                if (!same) {
+                    rules[r] = set;
+                    changed = true;
+                }
+            }
+        }
+        return rules;
+    }();
+};
+
+/// First set of the rule `Rule` in the grammar `Text`.
+template <auto& Text, std::size_t Rule>
+struct first_of_rule {
+    static constexpr first_set value = rule_firsts<Text>::value[Rule];
+};
+
+/// First set of the class `Class` in the grammar `Text`.
+template <auto& Text, std::size_t Class>
+struct first_of_class {
+    static constexpr first_set value = []() {
+        first_set set;
+        set.bits = compiled<Text>::value.classes[Class].bits;
+        set.any = compiled<Text>::value.negated[Class];
+        return set;
+    }();
+};
+
+/// Predicate for the items in the class `Class` in the grammar `Text`.
+template <auto& Text, std::size_t Class>
+struct class_predicate {
+    template <typename Item>
+    constexpr bool operator()(const Item& item) const {
+        static_assert(std::is_integral_v<Item>, "Grammars require integral items");
+        auto i = static_cast<std::make_unsigned_t<Item>>(item);
+        return i < 256 ? compiled<Text>::value.classes[Class].test(static_cast<unsigned>(i))
+                       : compiled<Text>::value.negated[Class];
+    }
+};
+
+}
+
+#endif // PARSIMON_INTERNAL_PEG_H
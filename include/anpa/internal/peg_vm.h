@@ -0,0 +1,831 @@
+#ifndef PARSIMON_INTERNAL_PEG_VM_H
+#define PARSIMON_INTERNAL_PEG_VM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "anpa/internal/first_set.h"
+#include "anpa/internal/peg.h"
+#include "anpa/internal/regex.h"
+
+/**
+ * Compilation of PEG grammars at runtime to bytecode, and a virtual machine
+ * that executes it.
+ *
+ * The grammar is parsed with the same parser as the compile time grammars,
+ * into a syntax tree with dynamic storage. Each rule is compiled to a
+ * subroutine, and alternatives are implemented with a stack of backtrack
+ * entries, as in LPeg:
+ *
+ * - `choice L` saves the position, so that a failure continues at `L`
+ * - `commit L` discards the saved position once an alternative has matched
+ * - `call` and `ret` enter and leave rules, with return addresses on the same stack
+ *
+ * Alternatives whose first item does not match the next item are skipped
+ * without saving the position, or selected with a table if they begin with
+ * different items. Alternatives of only literals are matched with a trie,
+ * repeated classes are consumed in a single instruction, and small rules that
+ * aren't recursive are inlined.
+ *
+ * Ranges of captured rules are recorded on a capture stack that is truncated
+ * upon backtracking, so that only the captures of the successful parse remain.
+ */
+namespace anpa::internal::peg {
+
+/**
+ * Syntax tree with dynamic storage, for grammars that are parsed at runtime.
+ * Has the same interface as `ast`.
+ */
+struct dynamic_ast {
+    std::vector<node> nodes;
+    std::vector<std::size_t> children;
+    std::vector<char> chars;
+    std::vector<regex::char_set> classes;
+    std::vector<bool> negated;
+    std::vector<rule> rules;
+
+    std::size_t node_count = 0;
+    std::size_t child_count = 0;
+    std::size_t char_count = 0;
+    std::size_t class_count = 0;
+    std::size_t rule_count = 0;
+
+    std::vector<std::size_t> stack;
+    std::size_t stack_size = 0;
+
+    bool error = false;
+
+    std::size_t add_node(node_kind kind, std::size_t first = 0, std::size_t size = 0) {
+        nodes.push_back(node{kind, first, size, {}});
+        return node_count++;
+    }
+
+    std::size_t add_reference(std::string_view name) {
+        nodes.push_back(node{node_kind::reference, 0, 0, name});
+        return node_count++;
+    }
+
+    void add_char(char c) {
+        chars.push_back(c);
+        ++char_count;
+    }
+
+    std::size_t add_class(const regex::char_set& set, bool negate) {
+        classes.push_back(set);
+        negated.push_back(negate);
+        return class_count++;
+    }
+
+    void add_rule(std::string_view name, std::size_t n) {
+        if (find_rule(name) != rule_count) error = true;
+        rules.push_back(rule{name, n});
+        ++rule_count;
+    }
+
+    void push(std::size_t n) {
+        stack.resize(stack_size);
+        stack.push_back(n);
+        ++stack_size;
+    }
+
+    std::size_t make_parent(node_kind kind, std::size_t mark) {
+        auto size = stack_size - mark;
+        stack_size = mark;
+        if (size == 1) return stack[mark];
+        auto first = child_count;
+        children.insert(children.end(), stack.begin() + mark, stack.begin() + mark + size);
+        child_count += size;
+        return add_node(kind, first, size);
+    }
+
+    void resolve() {
+        for (auto& n : nodes) {
+            if (n.kind != node_kind::reference) continue;
+            n.first = find_rule(n.name);
+            if (n.first == rule_count) error = true;
+        }
+    }
+
+    std::size_t find_rule(std::string_view name) const {
+        for (std::size_t r = 0; r < rule_count; ++r) {
+            if (rules[r].name == name) return r;
+        }
+        return rule_count;
+    }
+};
+
+enum class opcode : std::uint8_t {
+    end,            // the parse succeeded
+    any,            // match any item
+    item,           // match the item `arg`
+    set,            // match an item in the class `arg`
+    span,           // consume all items in the class `arg`
+    string,         // match the `aux` items at `arg` in the literal pool
+    trie,           // match the first literal of a choice, using the trie rooted at `arg`
+    test_set,       // jump to `target` unless the next item is in the class `arg`
+    dispatch,       // jump to the alternative for the next item in the table `arg`, or fail
+    jump,           // jump to `target`
+    choice,         // save the position, to continue at `target` upon failure
+    commit,         // discard the saved position and jump to `target`
+    partial_commit, // update the saved position and jump to `target`
+    back_commit,    // restore the saved position, discard it and jump to `target`
+    fail_twice,     // discard the saved position and fail
+    fail,           // fail
+    call,           // call the rule at `target`
+    ret,            // return from a rule
+    capture_begin,  // begin capturing the rule `arg`
+    capture_end     // end capturing the rule `arg`
+};
+
+struct instruction {
+    opcode op = opcode::end;
+    std::uint16_t aux = 0;
+    std::uint32_t arg = 0;
+    std::uint32_t target = 0;
+};
+
+/**
+ * Trie for a choice of literals. `terminal` is the index of the first
+ * alternative that ends at a node, or `no_terminal`.
+ */
+struct trie_node {
+    static constexpr std::uint32_t no_terminal = ~std::uint32_t(0);
+
+    std::uint32_t edges = 0;
+    std::uint32_t edge_count = 0;
+    std::uint32_t terminal = no_terminal;
+};
+
+struct trie_edge {
+    unsigned char item;
+    std::uint32_t next;
+};
+
+/**
+ * A compiled grammar.
+ */
+struct program {
+    std::vector<instruction> code;
+    std::vector<std::array<bool, 256>> classes;
+    std::vector<bool> classes_negated;
+    std::vector<char> literals;
+    std::vector<trie_node> trie_nodes;
+    std::vector<trie_edge> trie_edges;
+
+    /// Targets of `dispatch`, indexed by item. `no_target` fails.
+    std::vector<std::array<std::uint32_t, 256>> dispatch_tables;
+    static constexpr std::uint32_t no_target = ~std::uint32_t(0);
+
+    /// The names of the rules, for the captures.
+    std::vector<std::string_view> rule_names;
+
+    bool valid = false;
+
+    /// Why the program is invalid.
+    std::string_view error = "Invalid grammar";
+};
+
+/**
+ * Compiler from a syntax tree to bytecode.
+ */
+class bytecode_compiler {
+    const dynamic_ast& tree;
+    const std::vector<bool>& captured;
+    program& result;
+    std::vector<first_set> rule_firsts;
+    std::vector<std::uint32_t> rule_addresses;
+    std::vector<std::size_t> calls;
+
+    // Rules whose bodies are compiled in place of a call
+    std::vector<bool> inlined;
+
+    /// Maximum number of nodes in an inlined rule, including the rules it inlines.
+    static constexpr std::size_t max_inline_size = 64;
+
+    std::uint32_t here() const { return static_cast<std::uint32_t>(result.code.size()); }
+
+    std::uint32_t emit(opcode op, std::uint32_t arg = 0, std::uint32_t target = 0, std::uint16_t aux = 0) {
+        result.code.push_back(instruction{op, aux, arg, target});
+        return here() - 1;
+    }
+
+    std::uint32_t add_class(const regex::char_set& set, bool negated) {
+        std::array<bool, 256> table{};
+        for (unsigned c = 0; c < 256; ++c) table[c] = set.test(c);
+        result.classes.push_back(table);
+        result.classes_negated.push_back(negated);
+        return static_cast<std::uint32_t>(result.classes.size() - 1);
+    }
+
+    const node& child(const node& n, std::size_t i) const {
+        return tree.nodes[tree.children[n.first + i]];
+    }
+
+    first_set first_of(const node& n) const {
+        return node_first(tree, rule_firsts, static_cast<std::size_t>(&n - tree.nodes.data()));
+    }
+
+    static bool is_known(const first_set& first) {
+        return !first.any && !first.nullable;
+    }
+
+    // Skip `n` unless the next item may begin it. Returns the test to patch, or `no_target`.
+    std::uint32_t emit_test(const node& n) {
+        auto first = first_of(n);
+        if (!is_known(first)) return program::no_target;
+        regex::char_set set;
+        set.bits = first.bits;
+        return emit(opcode::test_set, add_class(set, false));
+    }
+
+    void patch_test(std::uint32_t test) {
+        if (test != program::no_target) result.code[test].target = here();
+    }
+
+    // Call `f` for every node in the subtree of `n`
+    template <typename Fn>
+    void visit(const node& n, Fn&& f) const {
+        f(n);
+        switch (n.kind) {
+        case node_kind::choice:
+        case node_kind::sequence:
+            for (std::size_t i = 0; i < n.size; ++i) visit(child(n, i), f);
+            break;
+        case node_kind::and_predicate:
+        case node_kind::not_predicate:
+        case node_kind::optional:
+        case node_kind::zero_or_more:
+        case node_kind::one_or_more:
+            visit(tree.nodes[n.first], f);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Call `f` for the rules that `n` may refer to before it consumes any items
+    template <typename Fn>
+    void visit_left(const node& n, Fn&& f) const {
+        switch (n.kind) {
+        case node_kind::reference:
+            f(n.first);
+            break;
+        case node_kind::choice:
+            for (std::size_t i = 0; i < n.size; ++i) visit_left(child(n, i), f);
+            break;
+        case node_kind::sequence:
+            for (std::size_t i = 0; i < n.size; ++i) {
+                visit_left(child(n, i), f);
+                if (!first_of(child(n, i)).nullable) break;
+            }
+            break;
+        case node_kind::and_predicate:
+        case node_kind::not_predicate:
+        case node_kind::optional:
+        case node_kind::zero_or_more:
+        case node_kind::one_or_more:
+            visit_left(tree.nodes[n.first], f);
+            break;
+        default:
+            break;
+        }
+    }
+
+    bool left_reaches(std::size_t from, std::size_t to, std::vector<bool>& visited) const {
+        if (visited[from]) return false;
+        visited[from] = true;
+        bool found = false;
+        visit_left(tree.nodes[tree.rules[from].node], [&](std::size_t r) {
+            found = found || r == to || left_reaches(r, to, visited);
+        });
+        return found;
+    }
+
+    // Reject the grammars that would make the machine loop forever, as LPeg does:
+    // repetitions that may not consume any items, and rules that may refer to
+    // themselves before consuming any items. Returns the error, or an empty view.
+    std::string_view check() const {
+        for (std::size_t r = 0; r < tree.rule_count; ++r) {
+            std::vector<bool> visited(tree.rule_count);
+            if (left_reaches(r, r, visited)) return "Left recursive rule";
+        }
+        for (const auto& n : tree.nodes) {
+            bool repetition = n.kind == node_kind::zero_or_more || n.kind == node_kind::one_or_more;
+            if (repetition && first_of(tree.nodes[n.first]).nullable) {
+                return "Repetition of an expression that may match the empty string";
+            }
+        }
+        return {};
+    }
+
+    bool reaches(std::size_t from, std::size_t to, std::vector<bool>& visited) const {
+        if (visited[from]) return false;
+        visited[from] = true;
+        bool found = false;
+        visit(tree.nodes[tree.rules[from].node], [&](const node& n) {
+            if (n.kind == node_kind::reference && !found) {
+                found = n.first == to || reaches(n.first, to, visited);
+            }
+        });
+        return found;
+    }
+
+    // Number of nodes of a rule that isn't recursive, with its inlined rules
+    std::size_t inline_size(std::size_t r, std::vector<std::size_t>& sizes) {
+        if (sizes[r] > 0) return sizes[r];
+        std::size_t size = 0;
+        visit(tree.nodes[tree.rules[r].node], [&](const node& n) {
+            ++size;
+            if (n.kind == node_kind::reference && inlined[n.first]) size += inline_size(n.first, sizes);
+        });
+        return sizes[r] = size;
+    }
+
+    void compute_inlined() {
+        std::vector<bool> recursive(tree.rule_count);
+        for (std::size_t r = 0; r < tree.rule_count; ++r) {
+            std::vector<bool> visited(tree.rule_count);
+            recursive[r] = reaches(r, r, visited);
+        }
+
+        // A rule that isn't recursive only refers to rules that don't refer back to it,
+        // so the sizes can be computed recursively. The sizes are computed as if all
+        // such rules were inlined.
+        inlined.assign(tree.rule_count, false);
+        for (std::size_t r = 0; r < tree.rule_count; ++r) inlined[r] = !recursive[r];
+        std::vector<std::size_t> sizes(tree.rule_count);
+        std::vector<bool> small(tree.rule_count);
+        for (std::size_t r = 0; r < tree.rule_count; ++r) {
+            small[r] = !recursive[r] && inline_size(r, sizes) <= max_inline_size;
+        }
+        inlined = small;
+    }
+
+    bool is_literal(const node& n) const {
+        return n.kind == node_kind::literal && n.size > 0;
+    }
+
+    // Class matching the same items as a single item parser, if it is one
+    bool single_item_class(const node& n, regex::char_set& set, bool& negated) const {
+        if (n.kind == node_kind::char_class) {
+            set = tree.classes[n.first];
+            negated = tree.negated[n.first];
+            return true;
+        }
+        if (n.kind == node_kind::literal && n.size == 1) {
+            set = regex::char_set{};
+            set.set(static_cast<unsigned char>(tree.chars[n.first]));
+            negated = false;
+            return true;
+        }
+        return false;
+    }
+
+    std::uint32_t add_trie(const node& n) {
+        auto root = static_cast<std::uint32_t>(result.trie_nodes.size());
+        std::vector<std::vector<trie_edge>> edges(1);
+        std::vector<std::uint32_t> terminals(1, trie_node::no_terminal);
+        for (std::size_t i = 0; i < n.size; ++i) {
+            const auto& literal = child(n, i);
+            std::uint32_t current = 0;
+            for (std::size_t k = 0; k < literal.size; ++k) {
+                auto c = static_cast<unsigned char>(tree.chars[literal.first + k]);
+                auto it = std::find_if(edges[current].begin(), edges[current].end(),
+                                       [c](const trie_edge& e) { return e.item == c; });
+                if (it != edges[current].end()) {
+                    current = it->next;
+                } else {
+                    auto next = static_cast<std::uint32_t>(edges.size());
+                    edges[current].push_back(trie_edge{c, next});
+                    edges.emplace_back();
+                    terminals.push_back(trie_node::no_terminal);
+                    current = next;
+                }
+            }
+            terminals[current] = std::min(terminals[current], static_cast<std::uint32_t>(i));
+        }
+
+        for (std::size_t i = 0; i < edges.size(); ++i) {
+            auto offset = static_cast<std::uint32_t>(result.trie_edges.size());
+            for (auto e : edges[i]) {
+                e.next += root;
+                result.trie_edges.push_back(e);
+            }
+            result.trie_nodes.push_back(trie_node{offset, static_cast<std::uint32_t>(edges[i].size()), terminals[i]});
+        }
+        return root;
+    }
+
+    void compile_repetition(const node& body) {
+        regex::char_set set;
+        bool negated = false;
+        if (single_item_class(body, set, negated)) {
+            emit(opcode::span, add_class(set, negated));
+            return;
+        }
+        if (is_known(first_of(body))) {
+            // Leave the loop without backtracking when the next item can't begin `body`
+            auto loop = here();
+            auto test = emit_test(body);
+            auto choice = emit(opcode::choice);
+            compile(body);
+            emit(opcode::commit, 0, loop);
+            result.code[choice].target = here();
+            patch_test(test);
+        } else {
+            auto choice = emit(opcode::choice);
+            auto loop = here();
+            compile(body);
+            emit(opcode::partial_commit, 0, loop);
+            result.code[choice].target = here();
+        }
+    }
+
+    // Select the alternative with a table, if they all begin with different items.
+    bool compile_dispatch(const node& n) {
+        if (n.size < 3) return false;
+        first_set seen;
+        for (std::size_t i = 0; i < n.size; ++i) {
+            auto first = first_of(child(n, i));
+            if (!is_known(first) || !first.disjoint(seen)) return false;
+            seen = seen | first;
+        }
+
+        std::array<std::uint32_t, 256> table;
+        table.fill(program::no_target);
+        auto table_index = static_cast<std::uint32_t>(result.dispatch_tables.size());
+        result.dispatch_tables.emplace_back();
+        emit(opcode::dispatch, table_index);
+
+        std::vector<std::uint32_t> jumps;
+        for (std::size_t i = 0; i < n.size; ++i) {
+            auto first = first_of(child(n, i));
+            for (std::size_t c = 0; c < table.size(); ++c) {
+                if (first.test(c)) table[c] = here();
+            }
+            compile(child(n, i));
+            jumps.push_back(emit(opcode::jump));
+        }
+        for (auto jump : jumps) result.code[jump].target = here();
+        result.dispatch_tables[table_index] = table;
+        return true;
+    }
+
+    void compile_choice(const node& n) {
+        bool literals = true;
+        for (std::size_t i = 0; i < n.size; ++i) literals = literals && is_literal(child(n, i));
+        if (literals) {
+            emit(opcode::trie, add_trie(n));
+            return;
+        }
+        if (compile_dispatch(n)) return;
+
+        std::vector<std::uint32_t> commits;
+        for (std::size_t i = 0; i + 1 < n.size; ++i) {
+            auto alternative = tree.children[n.first + i];
+            auto first = node_first(tree, rule_firsts, alternative);
+            std::uint32_t test = 0;
+            bool skip = !first.any && !first.nullable;
+            if (skip) {
+                regex::char_set set;
+                set.bits = first.bits;
+                test = emit(opcode::test_set, add_class(set, false));
+            }
+            auto choice = emit(opcode::choice);
+            compile(tree.nodes[alternative]);
+            commits.push_back(emit(opcode::commit));
+            result.code[choice].target = here();
+            if (skip) result.code[test].target = here();
+        }
+        compile(child(n, n.size - 1));
+        for (auto commit : commits) result.code[commit].target = here();
+    }
+
+    void compile(const node& n) {
+        switch (n.kind) {
+        case node_kind::literal:
+            if (n.size == 1) {
+                emit(opcode::item, static_cast<unsigned char>(tree.chars[n.first]));
+            } else if (n.size > 1) {
+                auto offset = static_cast<std::uint32_t>(result.literals.size());
+                result.literals.insert(result.literals.end(), tree.chars.begin() + n.first,
+                                       tree.chars.begin() + n.first + n.size);
+                emit(opcode::string, offset, 0, static_cast<std::uint16_t>(n.size));
+            }
+            break;
+        case node_kind::char_class:
+            emit(opcode::set, add_class(tree.classes[n.first], tree.negated[n.first]));
+            break;
+        case node_kind::any:
+            emit(opcode::any);
+            break;
+        case node_kind::reference: {
+            auto rule = static_cast<std::uint32_t>(n.first);
+            if (captured[rule]) emit(opcode::capture_begin, rule);
+            if (inlined[rule]) {
+                compile(tree.nodes[tree.rules[rule].node]);
+            } else {
+                calls.push_back(emit(opcode::call, rule));
+            }
+            if (captured[rule]) emit(opcode::capture_end, rule);
+            break;
+        }
+        case node_kind::sequence:
+            for (std::size_t i = 0; i < n.size; ++i) compile(child(n, i));
+            break;
+        case node_kind::choice:
+            compile_choice(n);
+            break;
+        case node_kind::optional: {
+            auto test = emit_test(tree.nodes[n.first]);
+            auto choice = emit(opcode::choice);
+            compile(tree.nodes[n.first]);
+            auto commit = emit(opcode::commit);
+            result.code[choice].target = result.code[commit].target = here();
+            patch_test(test);
+            break;
+        }
+        case node_kind::zero_or_more:
+            compile_repetition(tree.nodes[n.first]);
+            break;
+        case node_kind::one_or_more:
+            compile(tree.nodes[n.first]);
+            compile_repetition(tree.nodes[n.first]);
+            break;
+        case node_kind::and_predicate: {
+            auto choice = emit(opcode::choice);
+            compile(tree.nodes[n.first]);
+            auto back_commit = emit(opcode::back_commit);
+            result.code[choice].target = emit(opcode::fail);
+            result.code[back_commit].target = here();
+            break;
+        }
+        case node_kind::not_predicate: {
+            auto choice = emit(opcode::choice);
+            compile(tree.nodes[n.first]);
+            emit(opcode::fail_twice);
+            result.code[choice].target = here();
+            break;
+        }
+        }
+    }
+
+    void compute_firsts() {
+        rule_firsts.assign(tree.rule_count, first_set{});
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (std::size_t r = 0; r < tree.rule_count; ++r) {
+                auto set = node_first(tree, rule_firsts, tree.rules[r].node);
+                if (set.bits != rule_firsts[r].bits || set.any != rule_firsts[r].any ||
+                    set.nullable != rule_firsts[r].nullable) {
+                    rule_firsts[r] = set;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+public:
+    bytecode_compiler(const dynamic_ast& tree, const std::vector<bool>& captured, program& result)
+        : tree{tree}, captured{captured}, result{result} {}
+
+    /// Compile the grammar, starting at the rule `start`.
+    void compile(std::size_t start) {
+        compute_firsts();
+        result.error = check();
+        if (!result.error.empty()) return;
+        compute_inlined();
+        for (const auto& r : tree.rules) result.rule_names.push_back(r.name);
+
+        if (captured[start]) emit(opcode::capture_begin, static_cast<std::uint32_t>(start));
+        calls.push_back(emit(opcode::call, static_cast<std::uint32_t>(start)));
+        if (captured[start]) emit(opcode::capture_end, static_cast<std::uint32_t>(start));
+        emit(opcode::end);
+
+        for (const auto& r : tree.rules) {
+            rule_addresses.push_back(here());
+            compile(tree.nodes[r.node]);
+            emit(opcode::ret);
+        }
+
+        for (auto call : calls) result.code[call].target = rule_addresses[result.code[call].arg];
+        result.valid = true;
+    }
+};
+
+/**
+ * Compile the grammar `text` to a program, starting at the rule `start`, or the first
+ * rule if it is empty. The ranges of the rules in `captures` are recorded.
+ * The program is invalid if the grammar or any of the names are, or if the grammar
+ * may loop forever (see `bytecode_compiler::check`).
+ */
+template <typename Names>
+program compile_program(std::string_view text, std::string_view start, const Names& captures) {
+    program result;
+    dynamic_ast tree;
+    compiler<dynamic_ast> c{text, tree};
+    c.compile();
+    if (tree.error) return result;
+
+    auto start_rule = start.empty() ? 0 : tree.find_rule(start);
+    if (start_rule == tree.rule_count) {
+        result.error = "Unknown start rule";
+        return result;
+    }
+
+    std::vector<bool> captured(tree.rule_count);
+    for (const auto& name : captures) {
+        auto rule = tree.find_rule(name);
+        if (rule == tree.rule_count) {
+            result.error = "Unknown captured rule";
+            return result;
+        }
+        captured[rule] = true;
+    }
+
+    bytecode_compiler(tree, captured, result).compile(start_rule);
+    return result;
+}
+
+template <typename InputIt>
+struct capture {
+    std::uint32_t rule;
+    bool begin;
+    InputIt position;
+};
+
+/**
+ * The stacks of `run`, which keep their capacity between runs, so that a buffer
+ * that is reused does not allocate once it has grown to the size of the input.
+ */
+template <typename InputIt>
+struct run_buffers {
+    // A backtrack point, or the return address of a rule
+    struct entry {
+        std::uint32_t target;
+        bool call;
+        InputIt position;
+        std::size_t captures;
+    };
+
+    std::vector<capture<InputIt>> captures;
+    std::vector<entry> stack;
+};
+
+/**
+ * Execute `code` on `[begin, end)`. Returns the end of the match, and whether it
+ * succeeded. Upon success, `buffers.captures` holds the captures in order.
+ * Returns failure if more than `max_depth` rules are nested, unless it is 0.
+ */
+template <typename InputIt>
+std::pair<bool, InputIt> run(const program& p, InputIt begin, InputIt end,
+                             run_buffers<InputIt>& buffers, std::size_t max_depth) {
+    using entry = typename run_buffers<InputIt>::entry;
+
+    static_assert(std::is_integral_v<std::decay_t<decltype(*begin)>>, "Grammars require integral items");
+
+    auto in_class = [&p](std::uint32_t k, const auto& item) {
+        auto i = static_cast<std::make_unsigned_t<std::decay_t<decltype(item)>>>(item);
+        return i < 256 ? p.classes[k][i] : bool(p.classes_negated[k]);
+    };
+
+    auto& captures = buffers.captures;
+    auto& stack = buffers.stack;
+    captures.clear();
+    stack.clear();
+    std::size_t depth = 0;
+    auto pos = begin;
+    std::uint32_t pc = 0;
+    const auto* code = p.code.data();
+
+    for (;;) {
+        const auto& ins = code[pc];
+        switch (ins.op) {
+        case opcode::end:
+            return {true, pos};
+        case opcode::any:
+            if (pos == end) break;
+            ++pos;
+            ++pc;
+            continue;
+        case opcode::item:
+            if (pos == end || *pos != static_cast<std::decay_t<decltype(*pos)>>(ins.arg)) break;
+            ++pos;
+            ++pc;
+            continue;
+        case opcode::set:
+            if (pos == end || !in_class(ins.arg, *pos)) break;
+            ++pos;
+            ++pc;
+            continue;
+        case opcode::span:
+            while (pos != end && in_class(ins.arg, *pos)) ++pos;
+            ++pc;
+            continue;
+        case opcode::string: {
+            auto it = pos;
+            std::size_t i = 0;
+            for (; i < ins.aux && it != end && *it == p.literals[ins.arg + i]; ++i) ++it;
+            if (i < ins.aux) break;
+            pos = it;
+            ++pc;
+            continue;
+        }
+        case opcode::trie: {
+            auto best = trie_node::no_terminal;
+            auto best_end = pos;
+            auto current = ins.arg;
+            for (auto it = pos;;) {
+                const auto& n = p.trie_nodes[current];
+                if (n.terminal < best) {
+                    best = n.terminal;
+                    best_end = it;
+                }
+                if (it == end) break;
+                auto i = static_cast<std::make_unsigned_t<std::decay_t<decltype(*it)>>>(*it);
+                auto edge = p.trie_edges.begin() + n.edges;
+                auto edges_end = edge + n.edge_count;
+                while (edge != edges_end && edge->item != i) ++edge;
+                if (edge == edges_end) break;
+                current = edge->next;
+                ++it;
+            }
+            if (best == trie_node::no_terminal) break;
+            pos = best_end;
+            ++pc;
+            continue;
+        }
+        case opcode::test_set:
+            pc = pos != end && in_class(ins.arg, *pos) ? pc + 1 : ins.target;
+            continue;
+        case opcode::dispatch: {
+            if (pos == end) break;
+            auto i = static_cast<std::make_unsigned_t<std::decay_t<decltype(*pos)>>>(*pos);
+            if (i >= 256 || p.dispatch_tables[ins.arg][i] == program::no_target) break;
+            pc = p.dispatch_tables[ins.arg][i];
+            continue;
+        }
+        case opcode::jump:
+            pc = ins.target;
+            continue;
+        case opcode::choice:
+            stack.push_back(entry{ins.target, false, pos, captures.size()});
+            ++pc;
+            continue;
+        case opcode::commit:
+            stack.pop_back();
+            pc = ins.target;
+            continue;
+        case opcode::partial_commit:
+            stack.back().position = pos;
+            stack.back().captures = captures.size();
+            pc = ins.target;
+            continue;
+        case opcode::back_commit:
+            pos = stack.back().position;
+            captures.resize(stack.back().captures);
+            stack.pop_back();
+            pc = ins.target;
+            continue;
+        case opcode::fail_twice:
+            stack.pop_back();
+            break;
+        case opcode::fail:
+            break;
+        case opcode::call:
+            if (max_depth > 0 && depth == max_depth) break;
+            ++depth;
+            stack.push_back(entry{pc + 1, true, pos, 0});
+            pc = ins.target;
+            continue;
+        case opcode::ret:
+            --depth;
+            pc = stack.back().target;
+            stack.pop_back();
+            continue;
+        case opcode::capture_begin:
+        case opcode::capture_end:
+            captures.push_back(capture<InputIt>{ins.arg, ins.op == opcode::capture_begin, pos});
+            ++pc;
+            continue;
+        }
+
+        // Every instruction that fails ends up here
+        while (!stack.empty() && stack.back().call) {
+            --depth;
+            stack.pop_back();
+        }
+        if (stack.empty()) return {false, pos};
+        pos = stack.back().position;
+        captures.resize(stack.back().captures);
+        pc = stack.back().target;
+        stack.pop_back();
+    }
+}
+
+}
+
+#endif // PARSIMON_INTERNAL_PEG_VM_H
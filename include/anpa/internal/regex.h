@@ -0,0 +1,643 @@
+#ifndef PARSIMON_INTERNAL_REGEX_H
+#define PARSIMON_INTERNAL_REGEX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "anpa/internal/first_set.h"
+
+/**
+ * Compile time compilation of regular expressions to DFA tables.
+ *
+ * The pattern is parsed to an NFA (Thompson's construction), which is then
+ * converted to a DFA with the subset construction. Items are grouped into
+ * classes of items that behave the same in every state, so that the table
+ * has one column per class instead of one per item.
+ *
+ * Supported syntax:
+ * - literals, and `\` to escape special characters
+ * - `.` (any item except `\n`)
+ * - classes `[abc]`, `[a-z]`, `[^abc]`
+ * - `\d`, `\w`, `\s` and their negations `\D`, `\W`, `\S`, also within classes
+ * - `\n`, `\r`, `\t`
+ * - grouping `(...)` and `(?:...)`
+ * - alternation `|`
+ * - repetition `*`, `+`, `?`, `{n}`, `{n,}` and `{n,m}`
+ *
+ * Only items with a value in `[0, 255]` can be matched.
+ */
+namespace anpa::internal::regex {
+
+struct char_set {
+    std::array<std::uint64_t, 4> bits{};
+
+    constexpr void set(unsigned c) { bits[c / 64] |= std::uint64_t(1) << (c % 64); }
+
+    constexpr void set_range(unsigned first, unsigned last) {
+        for (auto c = first; c <= last; ++c) set(c);
+    }
+
+    constexpr bool test(unsigned c) const { return (bits[c / 64] >> (c % 64)) & 1; }
+
+    constexpr void invert() {
+        for (auto& b : bits) b = ~b;
+    }
+
+    constexpr void merge(const char_set& other) {
+        for (std::size_t i = 0; i < bits.size(); ++i) bits[i] |= other.bits[i];
+    }
+};
+
+constexpr int no_state = -1;
+
+/**
+ * NFA with at most one item transition and two epsilon transitions per state.
+ * With `Capacity` 0 the states are only counted.
+ */
+template <std::size_t Capacity>
+struct nfa {
+    struct state {
+        char_set set{};
+        int next = no_state;
+        std::array<int, 2> epsilon{no_state, no_state};
+    };
+
+    std::array<state, (Capacity > 0 ? Capacity : 1)> states{};
+    std::size_t size = 0;
+
+    constexpr int add() {
+        return static_cast<int>(size++);
+    }
+
+    constexpr void add_epsilon(int from, int to) {
+        if constexpr (Capacity > 0) {
+            auto& epsilon = states[from].epsilon;
+            epsilon[epsilon[0] == no_state ? 0 : 1] = to;
+        }
+    }
+
+    constexpr void add_transition(int from, const char_set& set, int to) {
+        if constexpr (Capacity > 0) {
+            states[from].set = set;
+            states[from].next = to;
+        }
+    }
+};
+
+/**
+ * Recursive descent parser for a pattern, building an NFA.
+ */
+template <typename Nfa>
+struct compiler {
+    struct fragment {
+        int start;
+        int end;
+    };
+
+    std::string_view pattern;
+    Nfa& automaton;
+    std::size_t pos = 0;
+    bool error = false;
+
+    constexpr bool at_end() const { return pos >= pattern.size(); }
+    constexpr char peek() const { return at_end() ? '\0' : pattern[pos]; }
+
+    constexpr fragment compile() {
+        auto f = alternation();
+        if (!at_end()) error = true;
+        return f;
+    }
+
+    constexpr fragment alternation() {
+        auto f = sequence();
+        while (!error && peek() == '|') {
+            ++pos;
+            auto g = sequence();
+            int start = automaton.add();
+            int end = automaton.add();
+            automaton.add_epsilon(start, f.start);
+            automaton.add_epsilon(start, g.start);
+            automaton.add_epsilon(f.end, end);
+            automaton.add_epsilon(g.end, end);
+            f = {start, end};
+        }
+        return f;
+    }
+
+    constexpr fragment sequence() {
+        int start = automaton.add();
+        fragment f{start, start};
+        while (!error && !at_end() && peek() != '|' && peek() != ')') {
+            auto g = repetition();
+            automaton.add_epsilon(f.end, g.start);
+            f.end = g.end;
+        }
+        return f;
+    }
+
+    constexpr fragment star(fragment f) {
+        int start = automaton.add();
+        int end = automaton.add();
+        automaton.add_epsilon(start, f.start);
+        automaton.add_epsilon(start, end);
+        automaton.add_epsilon(f.end, f.start);
+        automaton.add_epsilon(f.end, end);
+        return {start, end};
+    }
+
+    constexpr fragment optional(fragment f) {
+        int start = automaton.add();
+        int end = automaton.add();
+        automaton.add_epsilon(start, f.start);
+        automaton.add_epsilon(start, end);
+        automaton.add_epsilon(f.end, end);
+        return {start, end};
+    }
+
+    constexpr std::size_t number() {
+        if (at_end() || peek() < '0' || peek() > '9') error = true;
+        std::size_t n = 0;
+        while (!at_end() && peek() >= '0' && peek() <= '9') n = n * 10 + static_cast<std::size_t>(pattern[pos++] - '0');
+        return n;
+    }
+
+    // `{n}`, `{n,}` or `{n,m}` of the atom in `[atom_begin, atom_end)`
+    constexpr fragment counted(std::size_t atom_begin, std::size_t atom_end) {
+        auto min = number();
+        auto max = min;
+        bool unbounded = false;
+        if (peek() == ',') {
+            ++pos;
+            if (peek() == '}') {
+                unbounded = true;
+            } else {
+                max = number();
+            }
+        }
+        if (peek() != '}' || max < min) {
+            error = true;
+            return {0, 0};
+        }
+        ++pos;
+        auto after = pos;
+
+        // Each repetition is compiled from the pattern of the atom
+        auto copy = [&]() {
+            pos = atom_begin;
+            auto f = atom();
+            pos = atom_end;
+            return f;
+        };
+
+        int start = automaton.add();
+        fragment f{start, start};
+        auto append = [&](fragment g) {
+            automaton.add_epsilon(f.end, g.start);
+            f.end = g.end;
+        };
+        for (std::size_t i = 0; i < min; ++i) append(copy());
+        if (unbounded) {
+            append(star(copy()));
+        } else {
+            for (std::size_t i = min; i < max; ++i) append(optional(copy()));
+        }
+        pos = after;
+        return f;
+    }
+
+    constexpr fragment repetition() {
+        auto atom_begin = pos;
+        auto f = atom();
+        auto atom_end = pos;
+        bool first = true;
+        while (!error && !at_end()) {
+            auto c = peek();
+            if (c == '*') {
+                ++pos;
+                f = star(f);
+            } else if (c == '+') {
+                ++pos;
+                int end = automaton.add();
+                automaton.add_epsilon(f.end, f.start);
+                automaton.add_epsilon(f.end, end);
+                f.end = end;
+            } else if (c == '?') {
+                ++pos;
+                f = optional(f);
+            } else if (c == '{' && first) {
+                ++pos;
+                // The single copy compiled above is left unreachable
+                f = counted(atom_begin, atom_end);
+            } else {
+                break;
+            }
+            first = false;
+        }
+        return f;
+    }
+
+    constexpr fragment set_fragment(const char_set& set) {
+        int start = automaton.add();
+        int end = automaton.add();
+        automaton.add_transition(start, set, end);
+        return {start, end};
+    }
+
+    // Escaped item or class after `\`. Return `true` if it was a class.
+    constexpr bool escape(char_set& set) {
+        if (at_end()) {
+            error = true;
+            return false;
+        }
+        char c = pattern[pos++];
+        char_set escaped;
+        switch (c) {
+        case 'd': case 'D':
+            escaped.set_range('0', '9');
+            break;
+        case 'w': case 'W':
+            escaped.set_range('a', 'z');
+            escaped.set_range('A', 'Z');
+            escaped.set_range('0', '9');
+            escaped.set('_');
+            break;
+        case 's': case 'S':
+            for (char w : {' ', '\t', '\n', '\r', '\f', '\v'}) escaped.set(static_cast<unsigned char>(w));
+            break;
+        case 'n': set.set('\n'); return false;
+        case 'r': set.set('\r'); return false;
+        case 't': set.set('\t'); return false;
+        default:
+            set.set(static_cast<unsigned char>(c));
+            return false;
+        }
+        if (c == 'D' || c == 'W' || c == 'S') escaped.invert();
+        set.merge(escaped);
+        return true;
+    }
+
+    constexpr fragment char_class() {
+        char_set set;
+        bool negate = peek() == '^';
+        if (negate) ++pos;
+        bool first = true;
+        while (!at_end() && (peek() != ']' || first)) {
+            first = false;
+            char c = pattern[pos++];
+            if (c == '\\') {
+                char_set single;
+                if (escape(single) || peek() != '-' || pos + 1 >= pattern.size() || pattern[pos + 1] == ']') {
+                    set.merge(single);
+                    continue;
+                }
+                for (unsigned i = 0; i < 256; ++i) {
+                    if (single.test(i)) c = static_cast<char>(i);
+                }
+            }
+            if (peek() == '-' && pos + 1 < pattern.size() && pattern[pos + 1] != ']') {
+                ++pos;
+                char last = pattern[pos++];
+                if (last == '\\') {
+                    char_set single;
+                    if (escape(single)) error = true;
+                    for (unsigned i = 0; i < 256; ++i) {
+                        if (single.test(i)) last = static_cast<char>(i);
+                    }
+                }
+                auto from = static_cast<unsigned char>(c);
+                auto to = static_cast<unsigned char>(last);
+                if (from > to) error = true;
+                else set.set_range(from, to);
+            } else {
+                set.set(static_cast<unsigned char>(c));
+            }
+        }
+        if (at_end()) {
+            error = true;
+        } else {
+            ++pos;
+        }
+        if (negate) set.invert();
+        return set_fragment(set);
+    }
+
+    constexpr fragment atom() {
+        if (at_end()) {
+            error = true;
+            return {0, 0};
+        }
+        char c = pattern[pos++];
+        char_set set;
+        switch (c) {
+        case '(': {
+            if (peek() == '?') {
+                if (pos + 1 >= pattern.size() || pattern[pos + 1] != ':') error = true;
+                pos += 2;
+            }
+            auto f = alternation();
+            if (peek() != ')') error = true;
+            ++pos;
+            return f;
+        }
+        case '[':
+            return char_class();
+        case '.':
+            set.invert();
+            set.bits[0] &= ~(std::uint64_t(1) << '\n');
+            return set_fragment(set);
+        case '\\':
+            escape(set);
+            return set_fragment(set);
+        case ')': case '|': case '*': case '+': case '?': case '{': case '}': case '^': case '$':
+            error = true;
+            return {0, 0};
+        default:
+            set.set(static_cast<unsigned char>(c));
+            return set_fragment(set);
+        }
+    }
+};
+
+/// Number of NFA states needed for a pattern.
+constexpr std::size_t nfa_size(std::string_view pattern) {
+    nfa<0> counter;
+    compiler<nfa<0>> c{pattern, counter};
+    c.compile();
+    return counter.size;
+}
+
+/// Return whether a pattern is valid.
+constexpr bool is_valid(std::string_view pattern) {
+    nfa<0> counter;
+    compiler<nfa<0>> c{pattern, counter};
+    c.compile();
+    return !c.error;
+}
+
+/// Maximum number of DFA states for a pattern.
+constexpr std::size_t max_dfa_states = 256;
+
+/**
+ * The DFA for a pattern, with room for `max_dfa_states` states.
+ * State 0 is the dead state, and state 1 the start state.
+ */
+template <std::size_t NfaSize>
+struct dfa_builder {
+    using state_set = std::array<std::uint64_t, (NfaSize + 63) / 64>;
+
+    nfa<NfaSize> automaton{};
+    int nfa_start = 0;
+    int nfa_end = 0;
+
+    std::array<std::uint8_t, 256> classes{};
+    std::size_t class_count = 0;
+
+    std::array<state_set, max_dfa_states> sets{};
+    std::array<bool, max_dfa_states> accepting{};
+    std::array<std::array<std::uint16_t, 256>, max_dfa_states> transitions{};
+    std::size_t size = 0;
+    bool overflow = false;
+
+    constexpr dfa_builder(std::string_view pattern) {
+        compiler<nfa<NfaSize>> c{pattern, automaton};
+        auto f = c.compile();
+        nfa_start = f.start;
+        nfa_end = f.end;
+        build_classes();
+        build_states();
+    }
+
+    // Group the items into classes that are in the same item sets of the NFA
+    constexpr void build_classes() {
+        std::array<unsigned, 256> representatives{};
+        for (unsigned c = 0; c < 256; ++c) {
+            bool found = false;
+            for (std::size_t k = 0; k < class_count && !found; ++k) {
+                bool same = true;
+                for (std::size_t i = 0; i < automaton.size && same; ++i) {
+                    const auto& state = automaton.states[i];
+                    if (state.next != no_state) same = state.set.test(c) == state.set.test(representatives[k]);
+                }
+                if (same) {
+                    classes[c] = static_cast<std::uint8_t>(k);
+                    found = true;
+                }
+            }
+            if (!found) {
+                representatives[class_count] = c;
+                classes[c] = static_cast<std::uint8_t>(class_count++);
+            }
+        }
+    }
+
+    constexpr void closure(state_set& set) const {
+        std::array<int, NfaSize> stack{};
+        std::size_t top = 0;
+        for (std::size_t i = 0; i < automaton.size; ++i) {
+            if ((set[i / 64] >> (i % 64)) & 1) stack[top++] = static_cast<int>(i);
+        }
+        while (top > 0) {
+            auto i = stack[--top];
+            for (auto next : automaton.states[i].epsilon) {
+                if (next != no_state && !((set[next / 64] >> (next % 64)) & 1)) {
+                    set[next / 64] |= std::uint64_t(1) << (next % 64);
+                    stack[top++] = next;
+                }
+            }
+        }
+    }
+
+    constexpr std::size_t add_state(const state_set& set) {
+        for (std::size_t i = 0; i < size; ++i) {
+            bool equal = true;
+            for (std::size_t w = 0; w < set.size() && equal; ++w) equal = sets[i][w] == set[w];
+            if (equal) return i;
+        }
+        if (size == max_dfa_states) {
+            overflow = true;
+            return 0;
+        }
+        sets[size] = set;
+        accepting[size] = (set[nfa_end / 64] >> (nfa_end % 64)) & 1;
+        return size++;
+    }
+
+    constexpr void build_states() {
+        add_state(state_set{});
+        state_set start{};
+        start[nfa_start / 64] |= std::uint64_t(1) << (nfa_start % 64);
+        closure(start);
+        add_state(start);
+
+        // Representative item of each class
+        std::array<unsigned, 256> representatives{};
+        for (unsigned c = 256; c-- > 0;) representatives[classes[c]] = c;
+
+        for (std::size_t d = 1; d < size && !overflow; ++d) {
+            for (std::size_t k = 0; k < class_count; ++k) {
+                state_set next{};
+                for (std::size_t i = 0; i < automaton.size; ++i) {
+                    const auto& state = automaton.states[i];
+                    if (((sets[d][i / 64] >> (i % 64)) & 1) && state.next != no_state && state.set.test(representatives[k])) {
+                        next[state.next / 64] |= std::uint64_t(1) << (state.next % 64);
+                    }
+                }
+                closure(next);
+                transitions[d][k] = static_cast<std::uint16_t>(add_state(next));
+            }
+        }
+    }
+};
+
+/**
+ * Compact DFA for a pattern, with exactly the states and item classes needed.
+ */
+template <std::size_t States, std::size_t Classes>
+struct dfa {
+    using index_type = std::conditional_t<(States <= 256), std::uint8_t, std::uint16_t>;
+
+    std::array<std::uint8_t, 256> classes{};
+    std::array<bool, States> accepting{};
+    std::array<index_type, States * Classes> transitions{};
+
+    constexpr std::size_t next(std::size_t state, unsigned item) const {
+        return transitions[state * Classes + classes[item]];
+    }
+};
+
+template <std::size_t States, std::size_t Classes, std::size_t NfaSize>
+constexpr auto make_dfa(const dfa_builder<NfaSize>& builder) {
+    dfa<States, Classes> result;
+    result.classes = builder.classes;
+    for (std::size_t d = 0; d < States; ++d) {
+        result.accepting[d] = builder.accepting[d];
+        for (std::size_t k = 0; k < Classes; ++k) {
+            result.transitions[d * Classes + k] = static_cast<typename dfa<States, Classes>::index_type>(builder.transitions[d][k]);
+        }
+    }
+    return result;
+}
+
+/**
+ * The compiled DFA of the pattern `Pattern`.
+ *
+ * The builder is only used during constant evaluation, so that only the
+ * compact tables end up in the program.
+ */
+template <auto& Pattern>
+struct compiled {
+    static constexpr std::string_view pattern{Pattern};
+    static_assert(is_valid(pattern), "Invalid regular expression");
+
+    using builder = dfa_builder<nfa_size(pattern)>;
+
+    static constexpr auto sizes = []() {
+        builder b{pattern};
+        return std::array<std::size_t, 3>{b.size, b.class_count, b.overflow};
+    }();
+    static_assert(!sizes[2], "Regular expression is too complex");
+
+    static constexpr auto value = []() {
+        builder b{pattern};
+        return make_dfa<sizes[0], sizes[1]>(b);
+    }();
+
+    static constexpr std::size_t start = 1;
+};
+
+/// Set of the items that the pattern `Pattern` may begin with.
+template <auto& Pattern>
+struct first_of_pattern {
+    static constexpr first_set value = []() {
+        const auto& dfa = compiled<Pattern>::value;
+        constexpr auto start = compiled<Pattern>::start;
+        first_set set;
+        for (unsigned c = 0; c < 256; ++c) {
+            if (dfa.next(start, c) != 0) set.insert(c);
+        }
+        set.nullable = dfa.accepting[start];
+        return set;
+    }();
+};
+
+}
+
+namespace anpa::internal {
+
+/**
+ * Parser for the longest prefix of the input matching the pattern `Pattern`.
+ * The result is the converted range of the match.
+ */
+template <auto& Pattern>
+struct regex_parser {
+    using first_type = regex::first_of_pattern<Pattern>;
+
+    /// Index of an item in the tables, or 256 if it is outside of them.
+    template <typename Item>
+    static constexpr unsigned index(const Item& item) {
+        static_assert(std::is_integral_v<Item>, "Regular expressions require integral items");
+        auto i = static_cast<std::make_unsigned_t<Item>>(item);
+        return i < 256 ? static_cast<unsigned>(i) : 256;
+    }
+
+    /// Whether no state has a transition on the item `0`, so that a match
+    /// of padded input ends before the padding (see `parser_settings::padded_input`).
+    static constexpr bool stops_at_zero = []() {
+        const auto& dfa = regex::compiled<Pattern>::value;
+        for (std::size_t state = 1; state < regex::compiled<Pattern>::sizes[0]; ++state) {
+            if (dfa.next(state, 0) != 0) return false;
+        }
+        return true;
+    }();
+
+    /// Return whether there is a match, and the end of the longest match.
+    /// If `Unbounded`, the input must be followed by an item that stops the match.
+    template <bool Unbounded = false, typename InputIt>
+    static constexpr std::pair<bool, InputIt> longest_match(InputIt pos, InputIt end) {
+        const auto& dfa = regex::compiled<Pattern>::value;
+        std::size_t state = regex::compiled<Pattern>::start;
+        bool matched = dfa.accepting[state];
+        auto last = pos;
+        while (Unbounded || pos != end) {
+            auto i = index(*pos);
+            if (i == 256) break;
+            auto next = dfa.next(state, i);
+            if (next == 0) break;
+            ++pos;
+            if (next == state) {
+                // Consume a run of items that stay in this state. The lookups
+                // in the run do not depend on each other, unlike the transitions.
+                while ((Unbounded || pos != end) && (i = index(*pos)) != 256 && dfa.next(state, i) == state) ++pos;
+            }
+            state = next;
+            if (dfa.accepting[state]) {
+                matched = true;
+                last = pos;
+            }
+        }
+        return {matched, last};
+    }
+
+    template <typename State>
+    constexpr bool recognize(State& s) const {
+        auto [matched, last] = longest_match<State::padded_input && stops_at_zero>(s.position, s.end);
+        if (matched) s.set_position(last);
+        return matched;
+    }
+
+    template <typename State>
+    constexpr auto operator()(State& s) const {
+        auto start = s.position;
+        if (recognize(s)) {
+            return s.return_success(s.convert(start, s.position));
+        }
+        return s.return_fail();
+    }
+};
+
+}
+
+#endif // PARSIMON_INTERNAL_REGEX_H
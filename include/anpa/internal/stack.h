@@ -0,0 +1,195 @@
+#ifndef PARSIMON_INTERNAL_STACK_H
+#define PARSIMON_INTERNAL_STACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <exception>
+
+#if __has_include(<ucontext.h>)
+#include <ucontext.h>
+#define ANPA_HAS_HEAP_STACK 1
+#else
+#define ANPA_HAS_HEAP_STACK 0
+#endif
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+/**
+ * Support for evaluating deeply recursive parsers on heap allocated stack segments.
+ *
+ * When the stack used by a recursion exceeds the size of a segment, the recursion
+ * continues on a new segment. This bounds the recursion depth by the available
+ * memory instead of the size of the native stack.
+ *
+ * Stack switching uses `<ucontext.h>`. On platforms without it, recursion always
+ * happens on the native stack.
+ *
+ * On the native stack, the recursion switches to a segment once it has used half
+ * of the stack that was left when the parse started, so that threads with small
+ * stacks switch early. Where the bounds of the native stack are unknown, the
+ * budget of a segment is used.
+ */
+namespace anpa::internal {
+
+/// Size of each heap allocated stack segment.
+constexpr std::size_t heap_stack_segment_size = std::size_t(1) << 18;
+
+/// Stack that may be used before switching to a new segment. The rest of the
+/// segment is kept as headroom for the frames of a single recursion level.
+constexpr std::size_t heap_stack_budget = heap_stack_segment_size / 2;
+
+/// The lowest address of the native stack of the calling thread, or 0 if it is unknown.
+inline std::uintptr_t native_stack_limit() {
+    // Finding the bounds may be slow (e.g. for the main thread), so they are cached
+    thread_local const std::uintptr_t limit = []() -> std::uintptr_t {
+#if defined(__GLIBC__)
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0) return 0;
+        void* address = nullptr;
+        std::size_t size = 0;
+        bool found = pthread_attr_getstack(&attr, &address, &size) == 0;
+        pthread_attr_destroy(&attr);
+        return found ? reinterpret_cast<std::uintptr_t>(address) : 0;
+#elif defined(__APPLE__)
+        auto self = pthread_self();
+        return reinterpret_cast<std::uintptr_t>(pthread_get_stackaddr_np(self)) - pthread_get_stacksize_np(self);
+#else
+        return 0;
+#endif
+    }();
+    return limit;
+}
+
+/**
+ * Book-keeping for a recursive parser evaluated on heap allocated stack segments.
+ * Segments are kept for the duration of the parse so that they can be reused when
+ * the recursion goes up and down around a segment boundary.
+ */
+struct heap_stack {
+    std::vector<std::unique_ptr<char[]>> segments;
+    std::size_t current_segment = 0;
+
+    /// Approximate address where the stack of the current segment begins.
+    std::uintptr_t base = 0;
+
+    /// Stack that may be used in the current segment.
+    std::size_t budget = heap_stack_budget;
+
+    /// Return the number of bytes of stack used in the current segment.
+    std::size_t used() const {
+        char marker;
+        auto position = reinterpret_cast<std::uintptr_t>(&marker);
+        // The stack grows downward on all supported platforms.
+        return base > position ? base - position : position - base;
+    }
+
+    bool exhausted() const {
+        return base != 0 && used() > budget;
+    }
+
+    /// Begin a segment here.
+    void set_base() {
+        char marker;
+        base = reinterpret_cast<std::uintptr_t>(&marker);
+        budget = heap_stack_budget;
+    }
+
+    /// Begin the recursion here on the native stack, with half of the stack that is left as budget.
+    void set_native_base() {
+        set_base();
+        auto limit = native_stack_limit();
+        if (limit != 0 && limit < base) budget = (base - limit) / 2;
+    }
+};
+
+#if ANPA_HAS_HEAP_STACK
+
+struct heap_stack_call {
+    ucontext_t caller;
+    ucontext_t callee;
+    void (*invoke)(void*);
+    void* fn;
+    std::exception_ptr exception;
+};
+
+inline thread_local heap_stack_call* current_heap_stack_call = nullptr;
+
+inline void heap_stack_entry() {
+    auto call = current_heap_stack_call;
+    try {
+        call->invoke(call->fn);
+    } catch (...) {
+        call->exception = std::current_exception();
+    }
+    // Returning resumes the caller through `uc_link`.
+}
+
+/**
+ * Call `f` on the next stack segment of `stack`.
+ */
+template <typename Fn>
+inline void call_on_heap_stack(heap_stack& stack, Fn& f) {
+    if (stack.current_segment == stack.segments.size()) {
+        stack.segments.emplace_back(new char[heap_stack_segment_size]);
+    }
+
+    heap_stack_call call;
+    call.fn = &f;
+    call.invoke = [](void* fn) { (*static_cast<Fn*>(fn))(); };
+
+    getcontext(&call.callee);
+    call.callee.uc_stack.ss_sp = stack.segments[stack.current_segment].get();
+    call.callee.uc_stack.ss_size = heap_stack_segment_size;
+    call.callee.uc_link = &call.caller;
+    makecontext(&call.callee, heap_stack_entry, 0);
+
+    auto old_base = stack.base;
+    auto old_budget = stack.budget;
+    ++stack.current_segment;
+    auto previous_call = current_heap_stack_call;
+    current_heap_stack_call = &call;
+    swapcontext(&call.caller, &call.callee);
+    current_heap_stack_call = previous_call;
+    --stack.current_segment;
+    stack.base = old_base;
+    stack.budget = old_budget;
+
+    if (call.exception) std::rethrow_exception(call.exception);
+}
+
+#else
+
+template <typename Fn>
+inline void call_on_heap_stack(heap_stack&, Fn& f) {
+    f();
+}
+
+#endif
+
+/**
+ * Call `f` and return its result. If the current stack segment is exhausted,
+ * `f` is called on a new segment.
+ */
+template <typename Fn>
+inline auto call_with_heap_stack(heap_stack& stack, Fn f) {
+    if (!stack.exhausted()) {
+        return f();
+    }
+
+    std::optional<decltype(f())> result;
+    auto call = [&]() {
+        stack.set_base();
+        result.emplace(f());
+    };
+    call_on_heap_stack(stack, call);
+    return *std::move(result);
+}
+
+}
+
+#endif // PARSIMON_INTERNAL_STACK_H
@@ -0,0 +1,155 @@
+#ifndef PARSIMON_INTERNAL_STRUCTURAL_H
+#define PARSIMON_INTERNAL_STRUCTURAL_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ANPA_STRUCTURAL_SSE2
+#endif
+
+namespace anpa::internal::structural {
+
+/// The number of items that are classified at once, one bit each.
+constexpr std::size_t block_size = 64;
+
+inline unsigned count_trailing_zeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+    unsigned n = 0;
+    for (; !(x & 1); x >>= 1) ++n;
+    return n;
+#endif
+}
+
+inline unsigned count_ones(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcountll(x));
+#else
+    unsigned n = 0;
+    for (; x; x &= x - 1) ++n;
+    return n;
+#endif
+}
+
+/// Bit `i` of the result is the xor of bits `0` to `i` of `x`.
+inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/// The items of a block that are structural, quotes and escapes, as bit masks.
+struct block_masks {
+    uint64_t structural;
+    uint64_t quote;
+    uint64_t escape;
+};
+
+/**
+ * Classifies the items of 64 item blocks.
+ */
+class classifier {
+    std::string_view structurals;
+    char quote;
+    char escape;
+
+#ifdef ANPA_STRUCTURAL_SSE2
+    // The bits of the items of `block` that are equal to `c`
+    static uint64_t equal(const __m128i (&block)[4], char c) {
+        const auto v = _mm_set1_epi8(c);
+        uint64_t mask = 0;
+        for (int i = 0; i < 4; ++i) {
+            mask |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block[i], v)))) << (16 * i);
+        }
+        return mask;
+    }
+#else
+    enum : unsigned char { is_structural = 1, is_quote = 2, is_escape = 4 };
+    std::array<unsigned char, 256> table{};
+#endif
+
+public:
+    classifier(std::string_view structurals, char quote, char escape)
+        : structurals{structurals}, quote{quote}, escape{escape} {
+#ifndef ANPA_STRUCTURAL_SSE2
+        for (unsigned char c : structurals) table[c] |= is_structural;
+        table[static_cast<unsigned char>(quote)] |= is_quote;
+        table[static_cast<unsigned char>(escape)] |= is_escape;
+#endif
+    }
+
+    block_masks classify(const char* block) const {
+#ifdef ANPA_STRUCTURAL_SSE2
+        __m128i items[4];
+        for (int i = 0; i < 4; ++i) {
+            items[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        }
+        block_masks masks{0, equal(items, quote), equal(items, escape)};
+        for (char c : structurals) masks.structural |= equal(items, c);
+        return masks;
+#else
+        block_masks masks{0, 0, 0};
+        for (std::size_t i = 0; i < block_size; ++i) {
+            auto kind = table[static_cast<unsigned char>(block[i])];
+            masks.structural |= uint64_t(kind & is_structural) << i;
+            masks.quote |= uint64_t((kind & is_quote) >> 1) << i;
+            masks.escape |= uint64_t((kind & is_escape) >> 2) << i;
+        }
+        return masks;
+#endif
+    }
+};
+
+/**
+ * Finds the structural items of a sequence of blocks, i.e. quotes that are not escaped,
+ * and structural items outside of quotes.
+ */
+class scanner {
+    bool escaped_carry = false;
+    uint64_t in_string_carry = 0;
+
+public:
+    /// The bits of the items that are escaped, given the bits of the escape items.
+    uint64_t escaped(uint64_t escapes) {
+        uint64_t result = escaped_carry ? 1 : 0;
+        escaped_carry = false;
+        escapes &= ~result;
+        // Escapes escape the next item, unless they are escaped themselves
+        for (; escapes; escapes &= escapes - 1) {
+            auto bit = escapes & (~escapes + 1);
+            if (result & bit) continue;
+            if (bit << 1) {
+                result |= bit << 1;
+            } else {
+                escaped_carry = true;
+            }
+        }
+        return result;
+    }
+
+    /// The bits of the structural items of a block.
+    uint64_t structurals(const block_masks& masks) {
+        auto quotes = masks.quote & ~escaped(masks.escape);
+        auto in_string = prefix_xor(quotes) ^ in_string_carry;
+        in_string_carry = in_string >> 63 ? ~uint64_t(0) : 0;
+        return (masks.structural & ~in_string) | quotes;
+    }
+
+    /// True if the last block ended inside a string.
+    bool in_string() const {
+        return in_string_carry != 0;
+    }
+};
+
+}
+
+#endif // PARSIMON_INTERNAL_STRUCTURAL_H
@@ -6,6 +6,7 @@
 #include <memory>
 #include "anpa/internal/monad_internal.h"
 #include "anpa/core.h"
+#include "anpa/internal/fusion.h"
 
 namespace anpa {
 
@@ -14,9 +15,28 @@ namespace anpa {
  */
 template <typename P1, typename P2>
 inline constexpr auto operator>>(parser<P1> p1, parser<P2> p2) {
-    return p1 >>= [=](auto&&) {
-        return p2;
-    };
+    if constexpr (internal::can_fuse_sequence<P1, P2>) {
+        return internal::fuse_sequence(p1, p2);
+    } else {
+        using first = internal::first_sequence<internal::first_of_parser<P1>, internal::first_of_parser<P2>>;
+        return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+            if constexpr (recognize_only) {
+                return recognize(p1, s) && recognize(p2, s);
+            } else {
+                // The result of `p1` is not needed, unless it holds the error
+                if constexpr (std::decay_t<decltype(s)>::error_messages) {
+                    if (auto&& result = apply(p1, s); !result) {
+                        return s.template return_fail_change_result<decltype(*apply(p2, s))>(result);
+                    }
+                } else {
+                    if (!recognize(p1, s)) {
+                        return s.template return_fail<decltype(*apply(p2, s))>();
+                    }
+                }
+                return apply(p2, s);
+            }
+        }));
+    }
 }
 
 /**
@@ -32,19 +52,16 @@ inline constexpr auto operator>=(parser<P> p, Value&& v) {
  */
 template <typename P1, typename P2>
 inline constexpr auto operator<<(parser<P1> p1, parser<P2> p2) {
-#if defined(__clang__) || __GNUG__ >= 9
-    return lift([](auto&& r, auto&&) {return std::forward<decltype(r)>(r);}, p1, p2);
-#else
-    return parser([=](auto& s) {
-        auto result = apply(p1, s);
-        if (result) {
-            if (auto result2 = apply(p2, s); !result2) {
-                return s.template return_fail_change_result<decltype(*result)>(result2);
-            }
+    using first = internal::first_sequence<internal::first_of_parser<P1>, internal::first_of_parser<P2>>;
+    return internal::with_first<first>(internal::with_recognizer([=](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return recognize(p1, s) && recognize(p2, s);
+        } else {
+            return internal::lift_apply(s, [](auto& state, auto&& r, auto&&) {
+                return state.return_success(std::forward<decltype(r)>(r));
+            }, p1, internal::recognized<P2>{p2.p});
         }
-        return result;
-    });
-#endif
+    }));
 }
 
 /**
@@ -74,22 +91,15 @@ inline constexpr auto bind(Fn f, Parsers... ps) {
  * It's also possible to pass zero parsers to lift an object (even non-copyable)
  * to the parser monad by having `f` returning it.
  *
+ * `f` is not called by `validate`. Use `apply_to_state` for side effects that must also
+ * happen there.
+ *
  * @param f a functor with the following signature:
  *            `ReturnType(auto&&... results)`
  */
 template <typename Fn, typename... Parsers>
 inline constexpr auto lift(Fn f, Parsers... ps) {
-    auto fun = [f](auto& s, auto&&... rs) {
-        if constexpr (!types::has_arg<Fn>) {
-            return s.template return_success_emplace<empty_result>();
-        } else if constexpr (std::is_void_v<decltype(f(std::forward<decltype(rs)>(rs)...))>) {
-            f(std::forward<decltype(rs)>(rs)...);
-            return s.template return_success_emplace<empty_result>();
-        } else {
-            return s.template return_success(f(std::forward<decltype(rs)>(rs)...));
-        }
-    };
-    return internal::lift_prepare(fun, ps...);
+    return internal::lift_prepare(internal::lift_function(f), ps...);
 }
 
 /**
@@ -29,6 +29,8 @@ enum class options : uint64_t {
     no_trailing_separator = 1 << 13,
     ordered               = 1 << 14,
     replace               = 1 << 15,
+    heap_stack            = 1 << 16,
+    right_associative     = 1 << 17,
 };
 
 /**
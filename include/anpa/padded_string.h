@@ -0,0 +1,62 @@
+#ifndef PARSIMON_PADDED_STRING_H
+#define PARSIMON_PADDED_STRING_H
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include "anpa/settings.h"
+
+namespace anpa {
+
+/**
+ * A string that is followed by `input_padding` items of padding with value `0`,
+ * for parsing with `padded_parser_settings`.
+ *
+ * Example:
+ * ```
+ * padded_string input(read_file());
+ * auto res = p.parse<padded_parser_settings>(input);
+ * ```
+ */
+class padded_string {
+    std::unique_ptr<char[]> buffer;
+    std::size_t length = 0;
+
+public:
+    padded_string() : padded_string(std::string_view()) {}
+
+    explicit padded_string(std::string_view str)
+        : buffer{new char[str.size() + input_padding]}, length{str.size()} {
+        if (!str.empty()) std::memcpy(buffer.get(), str.data(), str.size());
+        std::memset(buffer.get() + str.size(), 0, input_padding);
+    }
+
+    padded_string(const padded_string& other) : padded_string(std::string_view(other)) {}
+    padded_string(padded_string&& other) noexcept
+        : buffer{std::move(other.buffer)}, length{std::exchange(other.length, 0)} {}
+
+    padded_string& operator=(const padded_string& other) {
+        if (this != &other) *this = padded_string(other);
+        return *this;
+    }
+    padded_string& operator=(padded_string&& other) noexcept {
+        buffer = std::move(other.buffer);
+        length = std::exchange(other.length, 0);
+        return *this;
+    }
+
+    const char* data() const { return buffer.get(); }
+    std::size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    const char* begin() const { return data(); }
+    const char* end() const { return data() + length; }
+
+    operator std::string_view() const { return {data(), length}; }
+};
+
+}
+
+#endif // PARSIMON_PADDED_STRING_H
@@ -0,0 +1,383 @@
+#ifndef PARSIMON_PARALLEL_H
+#define PARSIMON_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "anpa/settings.h"
+#include "anpa/internal/algorithm.h"
+
+namespace anpa {
+
+/**
+ * The number of records of a parse with `parse_records_parallel`, and how many of them failed.
+ */
+struct records_result {
+    std::size_t records = 0;
+    std::size_t failed = 0;
+};
+
+namespace internal {
+
+// The records of `[begin, end)` separated by `delimiter`, without a trailing empty record
+template <typename Fn>
+void for_each_record(const char* begin, const char* end, char delimiter, Fn f) {
+    while (begin != end) {
+        auto record_end = algorithm::find(begin, end, delimiter);
+        f(std::string_view(begin, static_cast<std::size_t>(record_end - begin)));
+        begin = record_end == end ? end : record_end + 1;
+    }
+}
+
+// The start of the first record that begins after `position`
+inline const char* next_record(const char* position, const char* end, char delimiter) {
+    auto record_end = algorithm::find(position, end, delimiter);
+    return record_end == end ? end : record_end + 1;
+}
+
+}
+
+/**
+ * Parse the records of `buffer` that are separated by `delimiter` (e.g. lines of a log
+ * or NDJSON file) with `p`, in parallel.
+ *
+ * The buffer is split into chunks at record boundaries, and the chunks are parsed on
+ * `threads` threads (including the calling thread). Each chunk is parsed with its own user
+ * state from `state_factory`, and the states are passed to `merger` in input order once all
+ * chunks are parsed, on the calling thread. `state_factory` may be called concurrently.
+ * A trailing delimiter does not start an empty record. The records are not padded, so
+ * `Settings` can't use `padded_input`.
+ *
+ * Delimiters are searched with `std::memchr`. If a parser throws, the first exception is
+ * rethrown once all threads have finished.
+ *
+ * Example:
+ * ```
+ * std::vector<entry> entries;
+ * parse_records_parallel(entry_parser, file_contents, '\n',
+ *     []() { return std::vector<entry>(); },
+ *     [&](std::vector<entry>&& chunk) { entries.insert(entries.end(), chunk.begin(), chunk.end()); });
+ * ```
+ *
+ * @param state_factory a functor with the signature `UserState()`
+ * @param merger a functor with the signature `void(UserState&&)`
+ * @param threads the number of threads, by default the number of hardware threads
+ * @return the number of records, and the number of records that failed to parse
+ */
+template <typename Settings = default_parser_settings, typename Parser, typename StateFactory, typename Merger>
+records_result parse_records_parallel(const Parser& p,
+                                      std::string_view buffer,
+                                      char delimiter,
+                                      StateFactory state_factory,
+                                      Merger merger,
+                                      std::size_t threads = std::thread::hardware_concurrency()) {
+    static_assert(!Settings::padded_input, "Records are followed by the rest of the input, not by padding");
+    using user_state = decltype(state_factory());
+
+    threads = std::max<std::size_t>(threads, 1);
+    // More chunks than threads, so that threads that finish early take over remaining chunks
+    constexpr std::size_t chunks_per_thread = 4;
+    constexpr std::size_t min_chunk_size = 64 * 1024;
+    auto chunk_count = std::clamp<std::size_t>(buffer.size() / min_chunk_size, 1, threads * chunks_per_thread);
+    threads = std::min(threads, chunk_count);
+
+    const char* begin = buffer.data();
+    const char* end = begin + buffer.size();
+    std::vector<const char*> bounds{begin};
+    for (std::size_t i = 1; i < chunk_count; ++i) {
+        auto approximate = std::max(begin + buffer.size() / chunk_count * i, bounds.back());
+        bounds.push_back(internal::next_record(approximate, end, delimiter));
+    }
+    bounds.push_back(end);
+
+    struct chunk_result {
+        std::optional<user_state> state;
+        records_result counts;
+    };
+    std::vector<chunk_result> results(chunk_count);
+    std::atomic<std::size_t> next_chunk{0};
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+
+    auto work = [&]() {
+        try {
+            for (std::size_t i; !failed && (i = next_chunk++) < chunk_count;) {
+                auto& result = results[i];
+                auto& state = result.state.emplace(state_factory());
+                internal::for_each_record(bounds[i], bounds[i + 1], delimiter, [&](std::string_view record) {
+                    ++result.counts.records;
+                    if (!p.template parse_with_state<Settings>(record, state).second) ++result.counts.failed;
+                });
+            }
+        } catch (...) {
+            if (!failed.exchange(true)) error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (std::size_t i = 1; i < threads; ++i) workers.emplace_back(work);
+    work();
+    for (auto& w : workers) w.join();
+    if (error) std::rethrow_exception(error);
+
+    records_result total;
+    for (auto& result : results) {
+        total.records += result.counts.records;
+        total.failed += result.counts.failed;
+        merger(std::move(*result.state));
+    }
+    return total;
+}
+
+
+/**
+ * A pool of threads with work stealing, for `parse_batch`.
+ *
+ * Every worker has a queue of tasks. Workers take tasks from the back of their own
+ * queue, and steal from the front of the other queues when theirs is empty. The thread
+ * that runs a batch is worker 0, and the threads of the pool are the other workers.
+ * The threads and queues are reused across batches, and one batch runs at a time.
+ */
+class work_stealing_pool {
+public:
+    /// A task: the items `[begin, end)` of a batch.
+    struct task {
+        std::size_t begin;
+        std::size_t end;
+    };
+
+private:
+    struct job {
+        void (*invoke)(void* f, std::size_t worker, task t);
+        void* f;
+        std::atomic<std::size_t> remaining;
+        std::exception_ptr error;
+        std::atomic<bool> failed{false};
+    };
+
+    struct entry {
+        task t;
+        job* j;
+    };
+
+    struct alignas(64) queue {
+        std::mutex mutex;
+        std::vector<entry> entries;
+        std::size_t head = 0;
+    };
+
+    std::size_t workers;
+    std::unique_ptr<queue[]> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+    std::atomic<std::size_t> queued{0};
+    bool stop = false;
+
+    std::mutex batch_mutex;
+    std::vector<task> task_buffer;
+
+    bool take(std::size_t worker, entry& e) {
+        {
+            auto& own = queues[worker];
+            std::lock_guard lock(own.mutex);
+            if (own.head < own.entries.size()) {
+                e = own.entries.back();
+                own.entries.pop_back();
+                --queued;
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i < workers; ++i) {
+            auto& other = queues[(worker + i) % workers];
+            std::lock_guard lock(other.mutex);
+            if (other.head < other.entries.size()) {
+                e = other.entries[other.head++];
+                --queued;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(std::size_t worker, const entry& e) {
+        auto& j = *e.j;
+        if (!j.failed) {
+            try {
+                j.invoke(j.f, worker, e.t);
+            } catch (...) {
+                if (!j.failed.exchange(true)) j.error = std::current_exception();
+            }
+        }
+        if (--j.remaining == 0) {
+            std::lock_guard lock(mutex);
+            work_done.notify_all();
+        }
+    }
+
+    void work(std::size_t worker) {
+        for (;;) {
+            {
+                std::unique_lock lock(mutex);
+                work_available.wait(lock, [this] { return stop || queued > 0; });
+                if (stop) return;
+            }
+            for (entry e; take(worker, e);) execute(worker, e);
+        }
+    }
+
+public:
+    /// A pool with `threads` workers in total, including the thread that runs a batch.
+    explicit work_stealing_pool(std::size_t threads = std::thread::hardware_concurrency())
+        : workers{std::max<std::size_t>(threads, 1)}, queues{new queue[workers]} {
+        this->threads.reserve(workers - 1);
+        for (std::size_t i = 1; i < workers; ++i) {
+            this->threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    ~work_stealing_pool() {
+        {
+            std::lock_guard lock(mutex);
+            stop = true;
+        }
+        work_available.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    /// The number of workers, including the thread that runs a batch.
+    std::size_t size() const { return workers; }
+
+    /**
+     * Call `f(worker, task)` for the tasks, and return once all are done.
+     * The first exception thrown by `f` is rethrown, and the remaining tasks are skipped.
+     */
+    template <typename Fn>
+    void run(const std::vector<task>& tasks, Fn& f) {
+        if (tasks.empty()) return;
+        job j{[](void* f, std::size_t worker, task t) { (*static_cast<Fn*>(f))(worker, t); },
+              &f, {tasks.size()}, nullptr};
+        // Counted first, so that the count never drops below the number of queued tasks
+        queued += tasks.size();
+        for (std::size_t i = 0; i < tasks.size(); ++i) {
+            auto& q = queues[i % workers];
+            std::lock_guard lock(q.mutex);
+            if (q.head == q.entries.size()) {
+                q.entries.clear();
+                q.head = 0;
+            }
+            q.entries.push_back({tasks[i], &j});
+        }
+        {
+            // Workers check `queued` under the mutex, so that they can't miss the notification
+            std::lock_guard lock(mutex);
+            work_available.notify_all();
+        }
+
+        for (entry e; take(0, e);) execute(0, e);
+        {
+            std::unique_lock lock(mutex);
+            work_done.wait(lock, [&j] { return j.remaining == 0; });
+        }
+        if (j.error) std::rethrow_exception(j.error);
+    }
+
+    /**
+     * Group the items `[0, items)` of a batch, where item `i` has size `size(i)`,
+     * into tasks of similar total size, and call `f(worker, task)` for them with `run`.
+     */
+    template <typename Size, typename Fn>
+    void run_batch(std::size_t items, Size size, Fn& f) {
+        std::lock_guard lock(batch_mutex);
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < items; ++i) total += size(i);
+
+        // Several tasks per worker for balance, but not so small that queueing dominates
+        constexpr std::size_t tasks_per_worker = 8;
+        constexpr std::size_t min_task_size = 16 * 1024;
+        constexpr std::size_t max_task_items = 256;
+        auto target = std::max(total / (workers * tasks_per_worker), min_task_size);
+
+        task_buffer.clear();
+        std::size_t begin = 0;
+        std::size_t task_size = 0;
+        for (std::size_t i = 0; i < items; ++i) {
+            task_size += size(i);
+            if (task_size >= target || i + 1 - begin == max_task_items) {
+                task_buffer.push_back({begin, i + 1});
+                begin = i + 1;
+                task_size = 0;
+            }
+        }
+        if (begin != items) task_buffer.push_back({begin, items});
+        run(task_buffer, f);
+    }
+};
+
+/**
+ * Parse each sequence of `inputs` with `p` on the workers of `pool`, and store the result
+ * for `inputs[i]` (the second element of what `parse` returns) in `results[i]`.
+ *
+ * Inputs are grouped into tasks by size, so that many small inputs are parsed per task,
+ * and large inputs are parsed on their own. Idle workers steal tasks from busy ones.
+ *
+ * Example:
+ * ```
+ * work_stealing_pool pool;
+ * std::vector<decltype(p.parse(messages[0]).second)> results(messages.size());
+ * parse_batch(p, messages, results.begin(), pool);
+ * ```
+ *
+ * @param inputs a random access range of sequences
+ * @param results a random access iterator to at least `std::size(inputs)` results
+ */
+template <typename Settings = default_parser_settings, typename Parser, typename Inputs, typename ResultIt>
+void parse_batch(const Parser& p, const Inputs& inputs, ResultIt results, work_stealing_pool& pool) {
+    auto first = std::begin(inputs);
+    auto parse_task = [&](std::size_t, work_stealing_pool::task t) {
+        for (auto i = t.begin; i != t.end; ++i) {
+            results[i] = p.template parse<Settings>(first[i]).second;
+        }
+    };
+    pool.run_batch(std::size(inputs), [first](std::size_t i) { return std::size(first[i]); }, parse_task);
+}
+
+/**
+ * Like `parse_batch`, but parse with user state. The worker with index `w` parses
+ * with `states[w]`, so the states (e.g. with reusable storage) are shared by all the
+ * inputs that the worker parses, and may be reused for the next batch.
+ *
+ * @param states a random access range of at least `pool.size()` user states
+ */
+template <typename Settings = default_parser_settings, typename Parser, typename Inputs, typename ResultIt, typename States>
+void parse_batch_with_state(const Parser& p, const Inputs& inputs, ResultIt results,
+                            States& states, work_stealing_pool& pool) {
+    auto first = std::begin(inputs);
+    auto first_state = std::begin(states);
+    auto parse_task = [&](std::size_t worker, work_stealing_pool::task t) {
+        auto& state = first_state[worker];
+        for (auto i = t.begin; i != t.end; ++i) {
+            results[i] = p.template parse_with_state<Settings>(first[i], state).second;
+        }
+    };
+    pool.run_batch(std::size(inputs), [first](std::size_t i) { return std::size(first[i]); }, parse_task);
+}
+
+}
+
+#endif // PARSIMON_PARALLEL_H
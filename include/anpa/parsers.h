@@ -7,7 +7,9 @@
 #include "anpa/types.h"
 #include "anpa/combinators.h"
 #include "anpa/internal/parsers_internal.h"
+#include "anpa/internal/fusion.h"
 #include "anpa/internal/pow10.h"
+#include "anpa/internal/regex.h"
 
 namespace anpa {
 
@@ -15,7 +17,7 @@ namespace anpa {
  * Parser that always succeeds.
  */
 inline constexpr auto success() {
-    return parser([](auto& s) {
+    return internal::with_first<internal::first_nothing>([](auto& s) {
         return s.template return_success_emplace<empty_result>();
     });
 }
@@ -27,7 +29,8 @@ inline constexpr auto success() {
  */
 template <typename T = empty_result>
 inline constexpr auto fail() {
-    return parser([](auto& s) {
+    // Never succeeds, so it begins with nothing
+    return internal::with_first<internal::first_items<>>([](auto& s) {
         return s.template return_fail<T>();
     });
 }
@@ -52,7 +55,7 @@ inline constexpr auto fail() {
  * @param condition the condition.
  */
 inline constexpr auto cond(bool condition) {
-    return parser([=](auto& s) {
+    return internal::with_first<internal::first_nothing>([=](auto& s) {
         return condition ? s.template return_success_emplace<empty_result>() : s.template return_fail<empty_result>();
     });
 }
@@ -61,7 +64,7 @@ inline constexpr auto cond(bool condition) {
  * Parser for the empty sequence.
  */
 inline constexpr auto empty() {
-    return parser([](auto& s) {
+    return internal::with_first<internal::first_nothing>([](auto& s) {
         return s.at_end() ? s.return_success(s.convert(s.position)) :
                             s.return_fail();
     });
@@ -71,7 +74,7 @@ inline constexpr auto empty() {
  * Parser for any item
  */
 inline constexpr auto any_item() {
-    return parser([](auto& s) {
+    return internal::with_first<internal::first_any>([](auto& s) {
         return internal::item(s, [](const auto&) {return true;});
     });
 }
@@ -87,7 +90,7 @@ inline constexpr auto any_item() {
  */
 template <options Options = options::none, typename ItemType>
 inline constexpr auto item(ItemType&& item) {
-    return parser([i = std::forward<ItemType>(item)](auto& s) {
+    return internal::with_first<internal::first_any>([i = std::forward<ItemType>(item)](auto& s) {
         return internal::item<Options>(s, [](const auto &c, const auto& i) {return c == i;}, i);
     });
 }
@@ -106,9 +109,8 @@ inline constexpr auto item(ItemType&& item) {
  */
 template <auto Item, options Options = options::none>
 inline constexpr auto item() {
-    return parser([](auto& s) {
-        return internal::item<Options>(s, [](const auto &c, const auto& i) {return c == i;}, Item);
-    });
+    using namespace internal;
+    return parser(literal_parser<literal_kind::item, Options, std::index_sequence<1>, Item>());
 }
 
 /**
@@ -118,7 +120,7 @@ inline constexpr auto item() {
  */
 template <typename ItemType>
 inline constexpr auto not_item(ItemType&& item) {
-    return parser([i = std::forward<ItemType>(item)](auto& s) {
+    return internal::with_first<internal::first_any>([i = std::forward<ItemType>(item)](auto& s) {
         return internal::item(s, [](const auto &c, const auto& i) {return c != i;}, i);
     });
 }
@@ -133,7 +135,7 @@ inline constexpr auto not_item(ItemType&& item) {
  */
 template <auto Item>
 inline constexpr auto not_item() {
-    return parser([](auto& s) {
+    return internal::with_first<internal::first_any>([](auto& s) {
         return internal::item(s, [](const auto& c, const auto& i) {return c != i;}, Item);
     });
 }
@@ -146,9 +148,7 @@ inline constexpr auto not_item() {
  */
 template <typename Pred>
 inline constexpr auto item_if(Pred pred) {
-    return parser([=](auto& s) {
-        return internal::item(s, pred);
-    });
+    return parser(internal::item_if_parser<Pred>{pred});
 }
 
 /**
@@ -159,20 +159,38 @@ inline constexpr auto item_if(Pred pred) {
  */
 template <typename Pred>
 inline constexpr auto item_if_not(Pred pred) {
-    return parser([=](auto& s) {
-        return internal::item(s, [=](const auto& p) {return !pred(p);});
+    return internal::with_first<internal::first_any>([=](auto& s) {
+        return internal::item(s, [&pred](const auto& p) {return !pred(p);});
     });
 }
 
+/**
+ * Parser for the longest match of the regular expression `Pattern`, compiled
+ * to a DFA at compile time. Fails if no prefix of the input matches.
+ * The result is the matched range, converted with the conversion function
+ * of the state.
+ *
+ * Example:
+ * ```
+ * static constexpr char identifier[] = "[A-Za-z_][A-Za-z0-9_]*";
+ * constexpr auto p = regex<identifier>();
+ * ```
+ *
+ * See `anpa/internal/regex.h` for the supported syntax.
+ *
+ * @tparam Pattern a null-terminated array with static storage duration
+ */
+template <auto& Pattern>
+inline constexpr auto regex() {
+    return parser(internal::regex_parser<Pattern>());
+}
+
 /**
  * Parser for the sequence described by `[begin, end)`
  */
 template <typename InputIt>
 inline constexpr auto seq(InputIt begin, InputIt end) {
-    return parser([b = std::move(begin), e = std::move(end)](auto& s) {
-        return internal::seq(s, std::distance(b, e),
-                             [=](auto i) {return algorithm::equal(b, e, i);});
-    });
+    return parser(internal::make_sequence_parser(std::move(begin), std::move(end)));
 }
 
 /**
@@ -181,10 +199,8 @@ inline constexpr auto seq(InputIt begin, InputIt end) {
  */
 template <auto V, auto... Vs>
 inline constexpr auto seq() {
-    return parser([](auto& s) {
-        return internal::seq(s, sizeof...(Vs) + 1,
-                             [](auto i){return algorithm::equal<V, Vs...>(i);});
-    });
+    using namespace internal;
+    return parser(literal_parser<literal_kind::seq, options::none, std::index_sequence<sizeof...(Vs) + 1>, V, Vs...>());
 }
 
 /**
@@ -218,9 +234,10 @@ inline constexpr auto any_of(const ItemType (&set)[N]) {
  */
 template <auto V, auto... Vs>
 inline constexpr auto any_of() {
-    return item_if([](const auto& c) {
+    constexpr auto pred = [](const auto& c) {
         return algorithm::contains<V, Vs...>(c);
-    });
+    };
+    return parser(internal::item_if_parser<decltype(pred), internal::first_items<V, Vs...>>{pred});
 }
 
 /**
@@ -238,7 +255,8 @@ inline constexpr auto consume(size_t n) {
  */
 template <size_t N>
 inline constexpr auto consume() {
-    return parser([](auto& s) {
+    using first = std::conditional_t<N == 0, internal::first_nothing, internal::first_any>;
+    return internal::with_first<first>([](auto& s) {
         return internal::consume(s, N);
     });
 }
@@ -253,9 +271,13 @@ inline constexpr auto consume() {
  */
 template <options Options = options::none, typename ItemType>
 inline constexpr auto until_item(ItemType&& c) {
-    return parser([c = std::forward<ItemType>(c)](auto& s) {
-        return internal::until_item<Options>(s, c);
-    });
+    return parser(internal::with_recognizer([c](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return internal::until_item_recognize<Options>(s, c);
+        } else {
+            return internal::until_item<Options>(s, c);
+        }
+    }));
 }
 
 /**
@@ -268,9 +290,13 @@ inline constexpr auto until_item(ItemType&& c) {
  */
 template <auto Item, options Options = options::none>
 inline constexpr auto until_item() {
-    return parser([](auto& s) {
-        return internal::until_item<Options>(s, Item);
-    });
+    return parser(internal::with_recognizer([](auto& s, auto recognize_only) {
+        if constexpr (recognize_only) {
+            return internal::until_item_recognize<Options>(s, Item);
+        } else {
+            return internal::until_item<Options>(s, Item);
+        }
+    }));
 }
 
 /**
@@ -286,7 +312,7 @@ template <options Options = options::none, typename InputIt>
 inline constexpr auto until_seq(InputIt begin, InputIt end) {
     return parser([=](auto& s) {
         return internal::until_seq<Options>(s,
-                    [=](auto b, auto e) {return algorithm::search(b, e, begin, end);});
+                    [&begin, &end](auto b, auto e) {return algorithm::search(b, e, begin, end);});
     });
 }
 
@@ -344,7 +370,7 @@ inline constexpr auto while_if(Predicate predicate) {
  */
 template <options Options = options::none, typename Predicate>
 inline constexpr auto while_if_not(Predicate predicate) {
-    return while_if_not<Options | options::negate>(predicate);
+    return while_if<Options | options::negate>(predicate);
 }
 
 /**
@@ -375,7 +401,9 @@ inline constexpr auto while_in(const ItemType (&items)[N]) {
  */
 template <auto V, auto... Vs>
 inline constexpr auto while_in() {
-    return while_if([](const auto& val){return algorithm::contains<V, Vs...>(val);});
+    return internal::while_if<options::none, internal::first_items<V, Vs...>>([](const auto& val) {
+        return algorithm::contains<V, Vs...>(val);
+    });
 }
 
 /**
@@ -499,11 +527,16 @@ inline constexpr auto integer() {
     using leading_plus = std::bool_constant<has_options(Options, options::leading_plus)>;
     using leading_minus = std::bool_constant<std::is_signed_v<Integral> && !has_options(Options, options::no_negative)>;
 
+    using first = internal::first_alternatives<
+            internal::first_items<'0', '1', '2', '3', '4', '5', '6', '7', '8', '9'>,
+            std::conditional_t<leading_plus::value, internal::first_items<'+'>, internal::first_items<>>,
+            std::conditional_t<leading_minus::value, internal::first_items<'-'>, internal::first_items<>>>;
+
     if constexpr (!leading_plus() && !leading_minus()) {
-        return res_parser(false);
+        return internal::with_first<first>(res_parser(false));
     } else {
         // We need try_parser here to not consume a token if input is "-" or "+"
-        return try_parser([](){
+        return internal::with_first<first>(try_parser([](){
             constexpr auto dash = item<'-'>();
             constexpr auto minus = dash >> mreturn<true>();
             constexpr auto plus  = succeed(item<'+'>()) >> mreturn<false>();
@@ -514,7 +547,7 @@ inline constexpr auto integer() {
             } else {
                 return plus;
             }
-        }() >>= res_parser);
+        }() >>= res_parser));
     }
 }
 
@@ -564,7 +597,10 @@ inline constexpr auto floating() {
  */
 template <options Options = options::none>
 inline constexpr auto trim() {
-    return while_if<Options>([](const auto& c) {
+    using whitespace = std::conditional_t<has_options(Options, options::negate),
+                                          internal::first_any,
+                                          internal::first_items<' ', '\t', '\n', '\v', '\f', '\r'>>;
+    return internal::while_if<Options, whitespace>([](const auto& c) {
         return c == ' ' || (c >= '\t' && c <= '\r');
     });
 }
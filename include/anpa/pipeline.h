@@ -0,0 +1,306 @@
+#ifndef PARSIMON_PIPELINE_H
+#define PARSIMON_PIPELINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "anpa/settings.h"
+#include "anpa/parallel.h"
+#include "anpa/internal/bounded_queue.h"
+
+namespace anpa {
+
+/**
+ * The configuration of `parse_pipeline`.
+ */
+struct pipeline_config {
+    /// The initial size of the buffers. A buffer grows when a record does not fit.
+    std::size_t buffer_size = std::size_t(1) << 20;
+
+    /// The number of buffers, which bounds the memory that is used and the number of chunks in flight.
+    std::size_t buffers = 8;
+
+    /// The number of parser threads, by default the hardware threads that are left by the reader and the consumer.
+    std::size_t parsers = std::max<std::size_t>(std::thread::hardware_concurrency(), 3) - 2;
+
+    /// Pass the user states to the consumer in input order, instead of in the order the chunks are parsed.
+    bool ordered = true;
+};
+
+/**
+ * The statistics of a parse with `parse_pipeline`.
+ */
+struct pipeline_stats : records_result {
+    std::size_t bytes = 0;
+    std::size_t chunks = 0;
+    std::chrono::nanoseconds elapsed{0};
+
+    /// The time the reader waited for a free buffer, i.e. was held back by the parsers or the consumer.
+    std::chrono::nanoseconds reader_stall{0};
+
+    /// The total time the parsers waited for chunks.
+    std::chrono::nanoseconds parser_stall{0};
+
+    /// The time the consumer waited for parsed chunks.
+    std::chrono::nanoseconds consumer_stall{0};
+
+    /// The largest number of chunks that waited for a parser.
+    std::size_t max_parse_queue_depth = 0;
+
+    /// The largest number of parsed chunks that waited for the consumer.
+    std::size_t max_consume_queue_depth = 0;
+
+    double bytes_per_second() const {
+        auto seconds = std::chrono::duration<double>(elapsed).count();
+        return seconds > 0 ? bytes / seconds : 0;
+    }
+};
+
+/**
+ * A reader for `parse_pipeline` that reads from a `std::FILE`, which is not closed.
+ *
+ * `std::fread` waits until the buffer is full or the file ends. For sources where data
+ * arrives slowly (e.g. pipes), use a reader that returns the data that is available.
+ */
+class file_reader {
+    std::FILE* file;
+
+public:
+    explicit file_reader(std::FILE* file) : file{file} {}
+
+    std::size_t operator()(char* data, std::size_t size) {
+        auto n = std::fread(data, 1, size, file);
+        if (n == 0 && std::ferror(file)) throw std::runtime_error("anpa::file_reader: read failed");
+        return n;
+    }
+};
+
+namespace internal {
+
+// The end of the last record in `[begin, end)` that ends with `delimiter`, or `nullptr`
+inline const char* last_record_end(const char* begin, const char* end, char delimiter) {
+    auto it = std::find(std::make_reverse_iterator(end), std::make_reverse_iterator(begin), delimiter);
+    return it.base() == begin ? nullptr : it.base();
+}
+
+}
+
+/**
+ * Parse the records that are separated by `delimiter` (e.g. lines of a log) of the input
+ * from `read` with `p`, with reading, parsing and consuming overlapped in a pipeline.
+ *
+ * A reader thread fills buffers of a fixed size with `read`, and passes the complete
+ * records of each buffer as a chunk to the parser threads. The rest of a buffer is copied
+ * to the next one. Each chunk is parsed with its own user state from `state_factory`, and
+ * the states are passed to `consumer` on the calling thread, in input order if
+ * `config.ordered` is set. A buffer is reused once its state is consumed, so the results
+ * may refer to the input until then. When all buffers are in use, the reader waits, so
+ * slow parsers or a slow consumer hold back the reading (backpressure).
+ *
+ * The buffers are passed between the threads through lock-free queues. A trailing delimiter
+ * does not start an empty record, and `Settings` can't use `padded_input`. If `read`, a
+ * parser or `consumer` throws, the pipeline stops and the first exception is rethrown once
+ * all threads have finished.
+ *
+ * Example:
+ * ```
+ * auto stats = parse_pipeline(entry_parser, file_reader(stdin), '\n',
+ *     []() { return std::vector<entry>(); },
+ *     [&](std::vector<entry>&& entries) { process(entries); });
+ * ```
+ *
+ * @param read a functor with the signature `std::size_t(char* data, std::size_t size)` that
+ *             reads at most `size` items to `data`, and returns the number of items read,
+ *             or 0 at the end of the input
+ * @param state_factory a functor with the signature `UserState()`, which may be called concurrently
+ * @param consumer a functor with the signature `void(UserState&&)`
+ * @return the number of records and how many failed to parse, and the statistics of the pipeline
+ */
+template <typename Settings = default_parser_settings, typename Parser, typename Reader,
+          typename StateFactory, typename Consumer>
+pipeline_stats parse_pipeline(const Parser& p,
+                              Reader read,
+                              char delimiter,
+                              StateFactory state_factory,
+                              Consumer consumer,
+                              const pipeline_config& config = {}) {
+    static_assert(!Settings::padded_input, "Records are followed by the rest of the input, not by padding");
+    using user_state = decltype(state_factory());
+    using clock = std::chrono::steady_clock;
+    constexpr auto none = std::size_t(-1);
+
+    const auto start = clock::now();
+    const auto buffer_size = std::max<std::size_t>(config.buffer_size, 1);
+    const auto buffer_count = std::max<std::size_t>(config.buffers, 2);
+    const auto parsers = std::max<std::size_t>(config.parsers, 1);
+
+    struct slot {
+        std::vector<char> data;
+        std::size_t size = 0;
+        std::size_t sequence = 0;
+        std::optional<user_state> state;
+        records_result counts;
+    };
+    std::vector<slot> slots(buffer_count);
+
+    // The indices of the buffers go from the reader to the parsers to the consumer, and back
+    internal::bounded_queue<std::size_t> free_buffers(buffer_count);
+    internal::bounded_queue<std::size_t> parse_queue(buffer_count + parsers);
+    internal::bounded_queue<std::size_t> consume_queue(buffer_count);
+    for (std::size_t i = 0; i < buffer_count; ++i) free_buffers.try_push(i);
+
+    pipeline_stats stats;
+    std::atomic<std::size_t> total_chunks{none};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    auto fail = [&]() {
+        if (!failed.exchange(true)) error = std::current_exception();
+    };
+
+    // Pop from `queue`, and add the time spent waiting to `stall`. Fail if the pipeline failed or is `done`.
+    auto pop = [&failed](auto& queue, std::size_t& value, std::chrono::nanoseconds& stall, auto done) {
+        if (queue.try_pop(value)) return true;
+        auto wait_start = clock::now();
+        internal::backoff b;
+        bool popped = false;
+        while (!failed && !done() && !(popped = queue.try_pop(value))) b.wait();
+        stall += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - wait_start);
+        return popped;
+    };
+    // The queues hold all buffers, but a push may have to wait for a pop that is in progress
+    auto push = [&failed](auto& queue, std::size_t value) {
+        internal::backoff b;
+        while (!queue.try_push(value) && !failed) b.wait();
+    };
+    auto never = []() { return false; };
+
+    auto reader = [&]() {
+        try {
+            std::vector<char> carry;
+            std::size_t sequence = 0;
+            for (bool end = false; !end;) {
+                std::size_t index;
+                if (!pop(free_buffers, index, stats.reader_stall, never)) return;
+                auto& s = slots[index];
+                auto size = carry.size();
+                if (s.data.size() < std::max(buffer_size, 2 * size)) s.data.resize(std::max(buffer_size, 2 * size));
+                std::copy(carry.begin(), carry.end(), s.data.data());
+
+                // Read until the buffer is full or the input has no more data for now,
+                // and the buffer has a complete record
+                const char* records_end = nullptr;
+                for (;;) {
+                    auto requested = s.data.size() - size;
+                    auto n = read(s.data.data() + size, requested);
+                    if (n == 0) {
+                        end = true;
+                        records_end = s.data.data() + size;
+                        break;
+                    }
+                    auto data = s.data.data();
+                    if (auto e = internal::last_record_end(data + size, data + size + n, delimiter)) records_end = e;
+                    size += n;
+                    if (records_end && (n < requested || size == s.data.size())) break;
+                    // A record that does not fit
+                    if (size == s.data.size()) s.data.resize(2 * size);
+                }
+
+                s.size = static_cast<std::size_t>(records_end - s.data.data());
+                carry.assign(s.data.begin() + s.size, s.data.begin() + size);
+                if (s.size == 0) {
+                    push(free_buffers, index);
+                    continue;
+                }
+                s.sequence = sequence++;
+                stats.bytes += s.size;
+                push(parse_queue, index);
+                stats.max_parse_queue_depth = std::max(stats.max_parse_queue_depth, parse_queue.size());
+            }
+            total_chunks.store(sequence, std::memory_order_release);
+            for (std::size_t i = 0; i < parsers; ++i) push(parse_queue, none);
+        } catch (...) {
+            fail();
+        }
+    };
+
+    auto parse = [&](std::chrono::nanoseconds& stall) {
+        try {
+            for (std::size_t index; pop(parse_queue, index, stall, never) && index != none;) {
+                auto& s = slots[index];
+                auto& state = s.state.emplace(state_factory());
+                s.counts = {};
+                internal::for_each_record(s.data.data(), s.data.data() + s.size, delimiter, [&](std::string_view record) {
+                    ++s.counts.records;
+                    if (!p.template parse_with_state<Settings>(record, state).second) ++s.counts.failed;
+                });
+                push(consume_queue, index);
+            }
+        } catch (...) {
+            fail();
+        }
+    };
+
+    std::vector<std::chrono::nanoseconds> parser_stalls(parsers, std::chrono::nanoseconds(0));
+    std::vector<std::thread> threads;
+    threads.reserve(parsers + 1);
+    threads.emplace_back(reader);
+    for (std::size_t i = 0; i < parsers; ++i) threads.emplace_back(parse, std::ref(parser_stalls[i]));
+
+    // Chunks that are parsed ahead of their turn, by sequence modulo the number of buffers.
+    // All chunks in flight are within that many of the next one, as they hold a buffer each.
+    std::vector<std::size_t> pending(buffer_count, none);
+    std::size_t waiting = 0;
+    std::size_t consumed = 0;
+    auto consume = [&](std::size_t index) {
+        auto& s = slots[index];
+        consumer(std::move(*s.state));
+        s.state.reset();
+        stats.records += s.counts.records;
+        stats.failed += s.counts.failed;
+        ++consumed;
+        push(free_buffers, index);
+    };
+    auto done = [&]() { return consumed == total_chunks.load(std::memory_order_acquire); };
+
+    try {
+        for (std::size_t index; pop(consume_queue, index, stats.consumer_stall, done);) {
+            stats.max_consume_queue_depth = std::max(stats.max_consume_queue_depth, consume_queue.size() + waiting + 1);
+            if (!config.ordered) {
+                consume(index);
+                continue;
+            }
+            pending[slots[index].sequence % buffer_count] = index;
+            ++waiting;
+            while ((index = pending[consumed % buffer_count]) != none) {
+                pending[consumed % buffer_count] = none;
+                --waiting;
+                consume(index);
+            }
+        }
+    } catch (...) {
+        fail();
+    }
+
+    for (auto& t : threads) t.join();
+    if (error) std::rethrow_exception(error);
+
+    stats.chunks = consumed;
+    for (auto stall : parser_stalls) stats.parser_stall += stall;
+    stats.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+    return stats;
+}
+
+}
+
+#endif // PARSIMON_PIPELINE_H
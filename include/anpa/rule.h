@@ -0,0 +1,250 @@
+#ifndef PARSIMON_RULE_H
+#define PARSIMON_RULE_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "anpa/core.h"
+#include "anpa/result.h"
+#include "anpa/settings.h"
+#include "anpa/state.h"
+
+namespace anpa::internal {
+
+/**
+ * Type erased storage for a parser of `State` with result type `Result`.
+ *
+ * Parsers up to `buffer_size` bytes are stored in place, larger ones on the heap.
+ * Parsing is a single indirect call through `invoke`, and recognizing through `recognize`.
+ */
+template <typename State, typename Result>
+class erased_parser {
+public:
+    using result_type = result<Result, typename State::error_type>;
+
+private:
+    static constexpr std::size_t buffer_size = 4 * sizeof(void*);
+
+    struct operations {
+        void (*copy)(void* to, const void* from);
+        void (*destroy)(void* storage);
+    };
+
+    template <typename P>
+    static constexpr bool in_place = sizeof(P) <= buffer_size &&
+                                     alignof(P) <= alignof(std::max_align_t) &&
+                                     std::is_nothrow_copy_constructible_v<P>;
+
+    template <typename P>
+    static const P& get(const void* storage) {
+        if constexpr (in_place<P>) {
+            return *static_cast<const P*>(storage);
+        } else {
+            return **static_cast<P* const*>(storage);
+        }
+    }
+
+    template <typename P>
+    static result_type invoke_parser(const void* storage, State& s) {
+        return apply_as<Result>(get<P>(storage), s);
+    }
+
+    template <typename P>
+    static bool recognize_parser(const void* storage, State& s) {
+        return anpa::recognize(get<P>(storage), s);
+    }
+
+    template <typename P>
+    static void construct(void* storage, const P& p) {
+        if constexpr (in_place<P>) {
+            new (storage) P(p);
+        } else {
+            *static_cast<P**>(storage) = new P(p);
+        }
+    }
+
+    template <typename P>
+    static constexpr operations operations_for = {
+        [](void* to, const void* from) {
+            construct(to, get<P>(from));
+        },
+        [](void* storage) {
+            if constexpr (in_place<P>) {
+                static_cast<P*>(storage)->~P();
+            } else {
+                delete *static_cast<P**>(storage);
+            }
+        }
+    };
+
+    static result_type invoke_empty(const void*, State& s) {
+        return s.template return_fail<Result>();
+    }
+
+    static bool recognize_empty(const void*, State&) {
+        return false;
+    }
+
+    alignas(std::max_align_t) unsigned char buffer[buffer_size];
+    result_type (*invoke)(const void*, State&) = invoke_empty;
+    bool (*recognize_function)(const void*, State&) = recognize_empty;
+    const operations* ops = nullptr;
+
+    void reset() {
+        if (ops) ops->destroy(buffer);
+        invoke = invoke_empty;
+        recognize_function = recognize_empty;
+        ops = nullptr;
+    }
+
+public:
+    erased_parser() = default;
+
+    erased_parser(const erased_parser& other) {
+        *this = other;
+    }
+
+    erased_parser& operator=(const erased_parser& other) {
+        if (this == &other) return *this;
+        reset();
+        if (other.ops) other.ops->copy(buffer, other.buffer);
+        invoke = other.invoke;
+        recognize_function = other.recognize_function;
+        ops = other.ops;
+        return *this;
+    }
+
+    ~erased_parser() {
+        reset();
+    }
+
+    template <typename P>
+    void assign(const P& p) {
+        // Copy first, in case `p` refers to the parser that is replaced
+        erased_parser copy;
+        construct(copy.buffer, p);
+        copy.ops = &operations_for<P>;
+        copy.invoke = invoke_parser<P>;
+        copy.recognize_function = recognize_parser<P>;
+        *this = copy;
+    }
+
+    result_type operator()(State& s) const {
+        return invoke(buffer, s);
+    }
+
+    bool recognize(State& s) const {
+        return recognize_function(buffer, s);
+    }
+};
+
+/**
+ * Parser that refers to the definition of a `rule`.
+ */
+template <typename State, typename Result>
+struct rule_reference {
+    const erased_parser<State, Result>* definition;
+
+    template <typename S>
+    static constexpr void assert_state() {
+        static_assert(std::is_same_v<S, State>,
+                      "A rule can only be applied to the iterator type and settings it was declared with");
+    }
+
+    template <typename S>
+    auto operator()(S& s) const {
+        assert_state<S>();
+        constexpr auto max_depth = S::settings::max_depth;
+        if constexpr (max_depth > 0) {
+            if (s.depth == max_depth) {
+                return s.template return_fail<Result>("Maximum recursion depth exceeded");
+            }
+        }
+
+        depth_guard<S> guard(s);
+        return (*definition)(s);
+    }
+
+    template <typename S>
+    bool recognize(S& s) const {
+        assert_state<S>();
+        constexpr auto max_depth = S::settings::max_depth;
+        if constexpr (max_depth > 0) {
+            if (s.depth == max_depth) return false;
+        }
+
+        depth_guard<S> guard(s);
+        return definition->recognize(s);
+    }
+};
+
+}
+
+namespace anpa {
+
+/**
+ * A type erased parser for items of type `InputIt` with result type `Result`.
+ *
+ * A rule hides the type of its definition, so that a grammar can be split into
+ * rules that are declared in headers and defined in separate translation units,
+ * and so that each rule is only instantiated once. Applying a rule costs an
+ * indirect call, and parsers are stored in place up to the size of four pointers.
+ *
+ * Combinators refer to a rule instead of copying it, so a rule can be used before
+ * it is defined, and recursive rules don't need `recursive`. The rule must outlive
+ * the parsers that refer to it. Copying a rule copies its definition.
+ * Use `ref()` to pass a reference to a function that takes its parser as `auto`.
+ *
+ * A rule only applies to states with iterator type `InputIt` and settings `Settings`,
+ * and not to states with user state.
+ *
+ * Example:
+ * ```
+ * rule<const char*, int> expr;
+ * expr = integer() || (item<'('>() >> expr << item<')'>());
+ * ```
+ *
+ * The nesting depth of rules can be limited with the `MaxDepth` parameter of `parser_settings`.
+ */
+template <typename InputIt, typename Result, typename Settings = default_parser_settings>
+class rule : public parser<internal::rule_reference<parser_state_simple<InputIt, Settings>, Result>> {
+    using state_type = parser_state_simple<InputIt, Settings>;
+    using reference = internal::rule_reference<state_type, Result>;
+
+    internal::erased_parser<state_type, Result> definition;
+
+public:
+    /// A rule without a definition, which always fails.
+    rule() : parser<reference>(reference{&definition}) {}
+
+    template <typename P>
+    rule(const parser<P>& p) : rule() {
+        definition.assign(p);
+    }
+
+    rule(const rule& other) : rule() {
+        definition = other.definition;
+    }
+
+    rule& operator=(const rule& other) {
+        definition = other.definition;
+        return *this;
+    }
+
+    /// Define the rule as `p`. Parsers that refer to this rule will use the new definition.
+    template <typename P>
+    rule& operator=(const parser<P>& p) {
+        definition.assign(p);
+        return *this;
+    }
+
+    /// A parser that refers to this rule.
+    parser<reference> ref() const {
+        return parser<reference>(reference{&definition});
+    }
+};
+
+}
+
+#endif // PARSIMON_RULE_H
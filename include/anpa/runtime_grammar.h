@@ -0,0 +1,112 @@
+#ifndef PARSIMON_RUNTIME_GRAMMAR_H
+#define PARSIMON_RUNTIME_GRAMMAR_H
+
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+#include "anpa/core.h"
+#include "anpa/internal/peg_vm.h"
+
+namespace anpa {
+
+/**
+ * A PEG grammar that is loaded at runtime.
+ *
+ * The grammar uses the same syntax as `grammar` (see `anpa/internal/peg.h`), and is
+ * compiled to bytecode that is executed by a virtual machine. This is slower than the
+ * parsers of `grammar`, but the grammar may be changed without rebuilding.
+ *
+ * Example:
+ * ```
+ * runtime_grammar g(load_grammar_file(), {"key", "value"});
+ * auto p = g.parser([](std::string_view rule, auto range) { ... });
+ * ```
+ */
+class runtime_grammar {
+    internal::peg::program program;
+
+public:
+    /**
+     * Compile the grammar `text`.
+     *
+     * @param text the grammar. Must outlive this object.
+     * @param captures the names of the rules whose ranges are passed to the callback
+     * @param start the rule to start at, or the first rule if it is empty
+     */
+    runtime_grammar(std::string_view text,
+                    std::initializer_list<std::string_view> captures = {},
+                    std::string_view start = {})
+        : program{internal::peg::compile_program(text, start, captures)} {}
+
+    runtime_grammar(std::string_view text, const std::vector<std::string_view>& captures, std::string_view start = {})
+        : program{internal::peg::compile_program(text, start, captures)} {}
+
+    /// Return whether the grammar, the start rule and all captured rules are valid.
+    bool valid() const { return program.valid; }
+
+    /**
+     * Return why the grammar is invalid, or an empty view if it is valid. Grammars that
+     * could loop forever are invalid: repetitions of expressions that may match the empty
+     * string, and left recursive rules.
+     */
+    std::string_view error() const { return program.error; }
+
+    /**
+     * Create a parser for the grammar. A parser of an invalid grammar always fails.
+     * The result is the range matched by the start rule.
+     *
+     * Upon success, `f` is called with the name and range of every match of a captured rule,
+     * in the order the matches end. Matches that were undone by backtracking are not reported.
+     * The nesting depth of rules can be limited with the `MaxDepth` parameter of `parser_settings`.
+     * The stacks of the virtual machine are kept per thread, and reused by later parses.
+     *
+     * The grammar must outlive the parser.
+     *
+     * @param f a functor with the signature:
+     *            `void(std::string_view rule, auto range)`
+     */
+    template <typename Fn>
+    auto parser(Fn f) const {
+        return anpa::parser([this, f](auto& s) {
+            using range_type = decltype(s.convert(s.position, s.position));
+            if (!program.valid) return s.template return_fail<range_type>();
+
+            using iterator = std::decay_t<decltype(s.position)>;
+            struct buffers_type : internal::peg::run_buffers<iterator> {
+                std::vector<const internal::peg::capture<iterator>*> open;
+            };
+
+            // The buffers are reused by the parses on each thread. A parse in `f` takes
+            // the cached buffers when they are free, and starts with empty ones otherwise.
+            static thread_local buffers_type cache;
+            auto buffers = std::move(cache);
+            auto start = s.position;
+            auto [success, end] = internal::peg::run(program, s.position, s.end, buffers,
+                                                     std::decay_t<decltype(s)>::settings::max_depth);
+            if (success) {
+                buffers.open.clear();
+                for (const auto& c : buffers.captures) {
+                    if (c.begin) {
+                        buffers.open.push_back(&c);
+                    } else {
+                        f(program.rule_names[c.rule], s.convert(buffers.open.back()->position, c.position));
+                        buffers.open.pop_back();
+                    }
+                }
+            }
+            cache = std::move(buffers);
+            if (!success) return s.template return_fail<range_type>();
+            s.set_position(end);
+            return s.return_success(s.convert(start, end));
+        });
+    }
+
+    /// Create a parser for the grammar that doesn't report any captures.
+    auto parser() const {
+        return parser([](std::string_view, const auto&) {});
+    }
+};
+
+}
+
+#endif // PARSIMON_RUNTIME_GRAMMAR_H
@@ -9,7 +9,7 @@
 namespace anpa {
 
 /// Conversion function that returns a `range`
-constexpr auto range_convert = [](auto begin, auto end) {
+inline constexpr auto range_convert = [](auto begin, auto end) {
     return range(begin, end);
 };
 
@@ -20,11 +20,19 @@ constexpr auto range_convert = [](auto begin, auto end) {
  * @tparam Convert the functor to be used to create results for parsed ranges.
  *         It should have the following signature:
  *           `ResultType(auto begin_iterator, auto end_iterator)`
+ * @tparam MaxDepth the maximum nesting depth of recursive parsers (see `recursive`).
+ *         A parse that nests deeper fails. Use 0 for no limit.
+ * @tparam PaddedInput set if the input is followed by at least `input_padding` readable
+ *         items that compare equal to `0` (see `padded_string`). Parsers then read past
+ *         the end instead of checking for it, where that can't change the result.
+ *         Only for pointers to byte sized items.
  */
-template <bool ErrorMessages = false, auto& Convert = range_convert>
+template <bool ErrorMessages = false, auto& Convert = range_convert, size_t MaxDepth = 0, bool PaddedInput = false>
 struct parser_settings {
     constexpr static bool error_messages = ErrorMessages;
     constexpr static auto conversion_function = Convert;
+    constexpr static size_t max_depth = MaxDepth;
+    constexpr static bool padded_input = PaddedInput;
 };
 
 /**
@@ -34,6 +42,26 @@ struct parser_settings {
 
 using default_parser_settings = parser_settings<>;
 
+/**
+ * The default parser settings for padded input (see `padded_string`).
+ */
+using padded_parser_settings = parser_settings<false, range_convert, 0, true>;
+
+/// The number of items of padding required by `parser_settings::padded_input`
+inline constexpr size_t input_padding = 64;
+
+/**
+ * `Settings` without `padded_input`, for parses of a part of the input (e.g. with
+ * `parse_result`), which is followed by the rest of the input instead of padding.
+ */
+template <typename Settings>
+struct unpadded_settings : Settings {
+    constexpr static bool padded_input = false;
+};
+
+template <typename Settings>
+using unpadded_settings_t = std::conditional_t<Settings::padded_input, unpadded_settings<Settings>, Settings>;
+
 }
 
 #endif // PARSIMON_SETTINGS_H
@@ -2,6 +2,7 @@
 #define PARSIMON_STATE_H
 
 #include <iterator>
+#include <type_traits>
 #include "anpa/result.h"
 #include "anpa/parse_error.h"
 #include "anpa/internal/algorithm.h"
@@ -20,9 +21,20 @@ struct parser_state_simple {
     /// The end of the range to be parsed
     const InputIt end;
 
+    /// The current nesting depth of recursive parsers
+    size_t depth = 0;
+
+    /// Set by `validate`, so that functors passed to `lift` and friends are not called
+    /// in recognizer mode. Otherwise they are called, and only their result is dropped.
+    bool skip_functors = false;
+
     using settings = Settings;
     constexpr static bool error_messages = Settings::error_messages;
     constexpr static bool has_user_state = false;
+    constexpr static bool padded_input = Settings::padded_input;
+
+    static_assert(!padded_input || (std::is_pointer_v<InputIt> && sizeof(*std::declval<InputIt>()) == 1),
+                  "Padded input requires pointers to byte sized items");
 
     using default_error_type = parse_error<const char*, InputIt>;
 
@@ -135,6 +147,49 @@ template <typename InputIt, typename Settings, typename UserState>
 parser_state(InputIt, InputIt, UserState&&, Settings) ->
 parser_state<InputIt, Settings, UserState>;
 
+namespace internal {
+
+/**
+ * Increments the nesting depth of a state for its lifetime, so that the depth
+ * is restored when a nested parser throws.
+ */
+template <typename State>
+class depth_guard {
+    State& s;
+
+public:
+    explicit depth_guard(State& s) : s{s} { ++s.depth; }
+    ~depth_guard() { --s.depth; }
+
+    depth_guard(const depth_guard&) = delete;
+    depth_guard& operator=(const depth_guard&) = delete;
+};
+
+template <typename State, typename Fn>
+auto call_guarded(State& s, const Fn& f) {
+    depth_guard<State> guard(s);
+    return f();
+}
+
+/**
+ * Return `f()`, called one nesting level deeper than `s`.
+ *
+ * `depth_guard` can't be used in constant evaluation, as it has a destructor.
+ * Nothing is thrown in constant evaluation, so the depth is restored directly there.
+ */
+template <typename State, typename Fn>
+constexpr auto call_nested(State& s, const Fn& f) {
+    if (algorithm::is_constant_evaluated()) {
+        ++s.depth;
+        auto result = f();
+        --s.depth;
+        return result;
+    }
+    return call_guarded(s, f);
+}
+
+}
+
 }
 
 #endif // PARSIMON_STATE_H
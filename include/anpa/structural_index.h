@@ -0,0 +1,203 @@
+#ifndef PARSIMON_STRUCTURAL_INDEX_H
+#define PARSIMON_STRUCTURAL_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "anpa/core.h"
+#include "anpa/options.h"
+#include "anpa/internal/structural.h"
+
+namespace anpa {
+
+/**
+ * The positions of the structural items of an input, e.g. brackets and separators,
+ * for parsers that jump between them instead of examining every item.
+ *
+ * The input is scanned in blocks of 64 items (with SSE2 where available), and the
+ * offsets of the structural items are stored in a compact array. Structural items
+ * between quotes are ignored, and quotes that follow an escape item don't end a string.
+ * The quotes themselves are structural.
+ *
+ * The parsers `until_structural` and `between_structural` use the index in the user state:
+ * ```
+ * structural_index index(input);
+ * auto res = between_structural<'{', '}'>().parse_with_state(input, index);
+ * ```
+ *
+ * Inputs are limited to 4 GiB. An index is used by one parse at a time.
+ */
+class structural_index {
+    const char* data = nullptr;
+    std::size_t length = 0;
+    std::vector<uint32_t> structural_offsets;
+
+    // The index of the last structural item that was looked up, as a starting point
+    mutable std::size_t hint = 0;
+
+public:
+    structural_index() = default;
+
+    /**
+     * Index the contiguous sequence `seq` of `char`, which must outlive the index.
+     *
+     * @param structurals the structural items
+     * @param quote the item that begins and ends strings
+     * @param escape the item that escapes the next item in strings
+     */
+    template <typename Sequence>
+    explicit structural_index(const Sequence& seq,
+                              std::string_view structurals = "{}[]:,",
+                              char quote = '"',
+                              char escape = '\\') {
+        build(std::data(seq), std::size(seq), structurals, quote, escape);
+    }
+
+    void build(const char* begin, std::size_t size,
+               std::string_view structurals = "{}[]:,", char quote = '"', char escape = '\\') {
+        using namespace internal::structural;
+        data = begin;
+        length = size;
+        hint = 0;
+        structural_offsets.clear();
+        structural_offsets.reserve(size / 8);
+
+        const classifier c(structurals, quote, escape);
+        scanner scan;
+        auto add = [this](uint64_t bits, uint32_t offset) {
+            auto count = structural_offsets.size();
+            structural_offsets.resize(count + count_ones(bits));
+            for (auto out = structural_offsets.data() + count; bits; bits &= bits - 1) {
+                *out++ = offset + count_trailing_zeros(bits);
+            }
+        };
+
+        std::size_t offset = 0;
+        for (; offset + block_size <= size; offset += block_size) {
+            add(scan.structurals(c.classify(begin + offset)), static_cast<uint32_t>(offset));
+        }
+        if (offset < size) {
+            char last[block_size] = {};
+            std::memcpy(last, begin + offset, size - offset);
+            auto bits = scan.structurals(c.classify(last));
+            add(bits & ((uint64_t(1) << (size - offset)) - 1), static_cast<uint32_t>(offset));
+        }
+    }
+
+    /// The offsets of the structural items, in increasing order.
+    const std::vector<uint32_t>& offsets() const { return structural_offsets; }
+
+    std::size_t size() const { return structural_offsets.size(); }
+
+    /// The position of the first structural item at or after `position`, or the end of the input.
+    const char* next(const char* position) const {
+        auto i = find(position);
+        return i == structural_offsets.size() ? data + length : data + structural_offsets[i];
+    }
+
+    /**
+     * The position of the item `close` that matches the item `open` at `position`,
+     * counting the nesting of `open` and `close` among the structural items,
+     * or the end of the input if there is none.
+     */
+    const char* matching(const char* position, char open, char close) const {
+        std::size_t depth = 0;
+        for (auto i = find(position); i < structural_offsets.size(); ++i) {
+            auto c = data[structural_offsets[i]];
+            if (c == open) {
+                ++depth;
+            } else if (c == close && --depth == 0) {
+                hint = i;
+                return data + structural_offsets[i];
+            }
+        }
+        return data + length;
+    }
+
+private:
+    // The index of the first structural item at or after `position`
+    std::size_t find(const char* position) const {
+        auto offset = static_cast<uint32_t>(position - data);
+        auto size = structural_offsets.size();
+        auto at = [this](std::size_t i) { return structural_offsets[i]; };
+        // Parsers mostly move forward by a few structural items at a time
+        if (hint < size && at(hint) <= offset) {
+            for (auto i = hint; i < size && i < hint + 8; ++i) {
+                if (at(i) >= offset) return hint = i;
+            }
+        } else if (hint <= size && (hint == 0 || at(hint - 1) < offset)) {
+            return hint;
+        }
+        auto it = std::lower_bound(structural_offsets.begin(), structural_offsets.end(), offset);
+        return hint = static_cast<std::size_t>(it - structural_offsets.begin());
+    }
+};
+
+namespace internal {
+
+template <typename State>
+constexpr void assert_structural_state() {
+    static_assert(std::is_pointer_v<decltype(std::declval<State>().position)>,
+                  "Structural parsers parse contiguous sequences of `char`");
+    static_assert(std::is_convertible_v<decltype((std::declval<State&>().user_state)), const structural_index&>,
+                  "Structural parsers require a `structural_index` as user state");
+}
+
+}
+
+/**
+ * Parser for consuming all items up until the structural item `Item` (see `structural_index`).
+ * Unlike `until_item`, items between quotes are skipped, and the index is used to jump
+ * between structural items.
+ *
+ * @tparam Options available options:
+ * 				     `options::dont_eat`: do not consume the successful parse
+ * 				     `options::include`: include the parsed sequence in the result
+ */
+template <char Item, options Options = options::none>
+inline constexpr auto until_structural() {
+    return parser([](auto& s) {
+        internal::assert_structural_state<std::decay_t<decltype(s)>>();
+        const structural_index& index = s.user_state;
+        auto pos = index.next(s.position);
+        while (pos < s.end && *pos != Item) pos = index.next(pos + 1);
+        if (pos >= s.end) return s.return_fail();
+
+        auto res_start = s.position;
+        auto res_end = pos + has_options(Options, options::include);
+        s.set_position(pos + !has_options(Options, options::dont_eat));
+        return s.return_success(s.convert(res_start, res_end));
+    });
+}
+
+/**
+ * Parser for the items between the structural item `Open` at the position and its matching
+ * `Close`, like `between_items<options::nested>`, but nesting is counted among the structural
+ * items only, by jumping between them with the index (see `structural_index`).
+ *
+ * @tparam Options available options:
+ * 				     `options::include`: include `Open` and `Close` in the result
+ */
+template <char Open, char Close, options Options = options::none>
+inline constexpr auto between_structural() {
+    return parser([](auto& s) {
+        internal::assert_structural_state<std::decay_t<decltype(s)>>();
+        if (s.at_end() || *s.position != Open) return s.return_fail();
+
+        const structural_index& index = s.user_state;
+        auto close = index.matching(s.position, Open, Close);
+        if (close >= s.end) return s.return_fail();
+
+        constexpr bool include = has_options(Options, options::include);
+        auto res_start = s.position + !include;
+        s.set_position(close + 1);
+        return s.return_success(s.convert(res_start, close + include));
+    });
+}
+
+}
+
+#endif // PARSIMON_STRUCTURAL_INDEX_H
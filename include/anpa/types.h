@@ -42,6 +42,16 @@ template <typename Iterator, typename Tag>
 constexpr bool iterator_is_category_v =
     std::is_same_v<typename std::iterator_traits<std::decay_t<Iterator>>::iterator_category, Tag>;
 
+/**
+ * True for sequences whose items are stored contiguously, i.e. that provide `std::data` and `std::size`.
+ */
+template <typename Sequence, typename = void>
+constexpr bool is_contiguous_sequence = false;
+
+template <typename Sequence>
+constexpr bool is_contiguous_sequence<Sequence, std::void_t<decltype(std::data(std::declval<const Sequence&>())),
+                                                            decltype(std::size(std::declval<const Sequence&>()))>> = true;
+
 template <typename... Parsers>
 inline constexpr auto assert_parsers_not_empty() {
     static_assert(sizeof...(Parsers) > 0, "At least one parser must be provided");
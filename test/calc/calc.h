@@ -1,7 +1,7 @@
 #ifndef CALC_H
 #define CALC_H
 
-#include <sstream>
+#include <functional>
 #include "anpa/anpa.h"
 
 
@@ -12,30 +12,30 @@ constexpr auto const_pow(T a, T b) {
     return result;
 }
 
+template <typename T>
+constexpr auto factorial(T a) {
+    T result = 1;
+    for (T i = 2; i <= a; ++i) result *= i;
+    return result;
+}
+
 // A parser for arithmetic expressions. It does not support any whitespace.
+// Supports `+`, `-`, `*`, `/`, `^` (right associative), unary `-` and `!` (factorial).
 constexpr auto expr = anpa::recursive<int>([](auto p) {
     using namespace anpa;
-    constexpr auto ops = [](auto c) {
-        return [c](auto a, auto b) {
-            switch (c) {
-            case '+': return a + b;
-            case '-': return a - b;
-            case '*': return a * b;
-            case '/': return a / b;
-            case '^': return const_pow(a, b);
-            default: return 0; // This can never happen
-            }
-        };
-    };
-
-    constexpr auto addOp = lift(ops, item<'+'>() || item<'-'>());
-    constexpr auto mulOp = lift(ops, item<'*'>() || item<'/'>());
-    constexpr auto expOp = lift(ops, item<'^'>());
-
-    auto atom = integer() || (item<'('>() >> p << item<')'>());
-    auto exp = chain(atom, expOp);
-    auto factor = chain(exp, mulOp);
-    return chain(factor, addOp);
+
+    auto atom = integer<int, options::no_negative>() || (item<'('>() >> p << item<')'>());
+
+    return operator_table(atom,
+                          infix<1>(item<'+'>(), std::plus<>()),
+                          infix<1>(item<'-'>(), std::minus<>()),
+                          infix<2>(item<'*'>(), std::multiplies<>()),
+                          infix<2>(item<'/'>(), std::divides<>()),
+                          prefix<3>(item<'-'>(), std::negate<>()),
+                          infix<4, options::right_associative>(item<'^'>(), [](auto a, auto b) {
+                              return const_pow(a, b);
+                          }),
+                          postfix<5>(item<'!'>(), [](auto a) { return factorial(a); }));
 });
 
 #endif //CALC_H
@@ -0,0 +1,234 @@
+#ifndef JSON_BIND_H
+#define JSON_BIND_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "json_parser.h"
+
+/**
+ * A member of `Class` that is decoded from the JSON member `name`.
+ */
+template <typename Class, typename Member>
+struct json_field {
+    std::string_view name;
+    Member Class::* member;
+};
+
+template <typename Class, typename Member>
+json_field(const char*, Member Class::*) -> json_field<Class, Member>;
+
+/**
+ * Specialize for types that are decoded from JSON objects by `json_bind`, with a
+ * `static constexpr` tuple `fields` of `json_field`:
+ * ```
+ * template <>
+ * struct json_fields<point> {
+ *     static constexpr auto fields = std::tuple(json_field{"x", &point::x}, json_field{"y", &point::y});
+ * };
+ * ```
+ */
+template <typename T>
+struct json_fields;
+
+namespace json_bind_internal {
+
+template <typename T, typename = void>
+constexpr bool has_fields = false;
+
+template <typename T>
+constexpr bool has_fields<T, std::void_t<decltype(json_fields<T>::fields)>> = true;
+
+template <typename T>
+constexpr bool is_optional = false;
+
+template <typename T>
+constexpr bool is_optional<std::optional<T>> = true;
+
+template <typename T>
+constexpr bool is_vector = false;
+
+template <typename T, typename Alloc>
+constexpr bool is_vector<std::vector<T, Alloc>> = true;
+
+template <typename>
+constexpr bool always_false = false;
+
+constexpr uint32_t hash(std::string_view key, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : key) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+constexpr size_t table_size(size_t fields) {
+    size_t size = 1;
+    while (size < 4 * fields) size *= 2;
+    return size;
+}
+
+/**
+ * A perfect hash of the field names of `T`, found at compile time, that maps a key to
+ * the index of the field with that name, or to the number of fields if there is none.
+ */
+template <typename T>
+struct field_table {
+    static constexpr auto& fields = json_fields<T>::fields;
+    static constexpr size_t count = std::tuple_size_v<std::decay_t<decltype(fields)>>;
+    static constexpr size_t size = table_size(count);
+
+    static constexpr auto names = std::apply([](const auto&... f) {
+        return std::array<std::string_view, count>{f.name...};
+    }, fields);
+
+    struct table {
+        uint32_t seed = 0;
+        std::array<size_t, size> slots{};
+    };
+
+    static constexpr table find_table() {
+        for (uint32_t seed = 0; seed < (uint32_t(1) << 16); ++seed) {
+            table t{seed, {}};
+            for (auto& slot : t.slots) slot = count;
+            bool perfect = true;
+            for (size_t i = 0; i < count && perfect; ++i) {
+                auto& slot = t.slots[hash(names[i], seed) & (size - 1)];
+                perfect = slot == count;
+                slot = i;
+            }
+            if (perfect) return t;
+        }
+        return {uint32_t(-1), {}};
+    }
+
+    static constexpr table lookup_table = find_table();
+    static_assert(lookup_table.seed != uint32_t(-1), "No perfect hash of the field names was found (duplicate names?)");
+
+    static size_t find(const json_string_view& key) {
+        std::string buffer;
+        auto decoded = key.get(buffer);
+        auto index = lookup_table.slots[hash(decoded, lookup_table.seed) & (size - 1)];
+        return index != count && names[index] == decoded ? index : count;
+    }
+};
+
+template <typename T, typename State>
+bool decode(State& s, T& out);
+
+// Decode the result of `p` to `out`, converted by `convert`
+template <typename State, typename Parser, typename T, typename Convert>
+bool decode_with(State& s, const Parser& p, T& out, Convert convert) {
+    if (auto result = anpa::apply(eat(p), s)) {
+        out = convert(*result);
+        return true;
+    }
+    return false;
+}
+
+template <char Item, typename State>
+bool skip_item(State& s) {
+    return anpa::recognize(eat(item<Item>()), s);
+}
+
+template <typename T, typename State, size_t I>
+bool decode_field(State& s, T& out) {
+    return decode(s, out.*(std::get<I>(json_fields<T>::fields).member));
+}
+
+template <typename T, typename State, size_t... Is>
+constexpr auto field_decoders(std::index_sequence<Is...>) {
+    return std::array<bool (*)(State&, T&), sizeof...(Is)>{decode_field<T, State, Is>...};
+}
+
+template <typename T, typename State>
+bool decode_object(State& s, T& out) {
+    using table = field_table<T>;
+    static constexpr auto decoders = field_decoders<T, State>(std::make_index_sequence<table::count>());
+
+    if (!skip_item<'{'>(s)) return false;
+    if (skip_item<'}'>(s)) return true;
+    do {
+        auto key = anpa::apply(eat(string_view_parser), s);
+        if (!key || !skip_item<':'>(s)) return false;
+        if (auto index = table::find(*key); index != table::count) {
+            if (!decoders[index](s, out)) return false;
+        } else if (!anpa::recognize(json_parser, s)) {
+            return false;
+        }
+    } while (skip_item<','>(s));
+    return skip_item<'}'>(s);
+}
+
+template <typename T, typename State>
+bool decode_array(State& s, T& out) {
+    out.clear();
+    if (!skip_item<'['>(s)) return false;
+    if (skip_item<']'>(s)) return true;
+    do {
+        if (!decode(s, out.emplace_back())) return false;
+    } while (skip_item<','>(s));
+    return skip_item<']'>(s);
+}
+
+template <typename T, typename State>
+bool decode(State& s, T& out) {
+    constexpr auto identity = [](const auto& r) { return r; };
+    if constexpr (has_fields<T>) {
+        return decode_object(s, out);
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return decode_with(s, bool_parser, out, identity);
+    } else if constexpr (std::is_integral_v<T>) {
+        return decode_with(s, integer<T>(), out, identity);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        return decode_with(s, floating<T, options::no_leading_zero>(), out, identity);
+    } else if constexpr (std::is_same_v<T, json_string_view>) {
+        return decode_with(s, string_view_parser, out, identity);
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return decode_with(s, string_view_parser, out, [](const json_string_view& r) { return r.str(); });
+    } else if constexpr (is_optional<T>) {
+        if (anpa::recognize(eat(null_parser), s)) {
+            out.reset();
+            return true;
+        }
+        return decode(s, out.emplace());
+    } else if constexpr (is_vector<T>) {
+        return decode_array(s, out);
+    } else {
+        static_assert(always_false<T>, "The type can not be decoded from JSON (specialize json_fields?)");
+    }
+}
+
+}
+
+/**
+ * Parser that decodes JSON directly to an object of type `T`, without a DOM.
+ *
+ * `T` may be `bool`, an arithmetic type, `std::string`, `json_string_view`, an `std::optional`
+ * (which is empty for `null`) or `std::vector` of such types, or a type with `json_fields`.
+ * The members of objects are dispatched to the fields through a perfect hash of the
+ * field names that is found at compile time. Members without a field are validated and
+ * skipped, and fields without a member keep their default value.
+ *
+ * Example:
+ * ```
+ * auto res = json_bind<point>.parse(R"({"x": 1, "y": 2})");
+ * ```
+ */
+template <typename T>
+constexpr auto json_bind = parser([](auto& s) {
+    T t{};
+    if (json_bind_internal::decode(s, t)) {
+        return s.return_success(std::move(t));
+    }
+    return s.template return_fail<T>();
+});
+
+#endif // JSON_BIND_H
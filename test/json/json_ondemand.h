@@ -0,0 +1,324 @@
+#ifndef JSON_ONDEMAND_H
+#define JSON_ONDEMAND_H
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+#include "json_parser.h"
+
+// The items that end a run of items that `json_skip_parser` passes over
+constexpr auto json_structural_items = []() {
+    std::array<bool, 256> table{};
+    for (unsigned char c : std::string_view("\"{}[], \t\n\r")) table[c] = true;
+    return table;
+}();
+
+// Skip a JSON value, tracking only the nesting depth and whether the position is in a string.
+// Nothing but the structure is checked, and the result is the skipped range.
+constexpr auto json_skip_parser = custom([](auto begin, auto end) {
+    auto pos = begin;
+    size_t depth = 0;
+    while (pos != end) {
+        if (!json_structural_items[static_cast<unsigned char>(*pos)]) {
+            ++pos;
+            continue;
+        }
+        switch (*pos) {
+        case '"':
+            for (++pos; pos != end && *pos != '"'; ++pos) {
+                if (*pos == '\\' && ++pos == end) break;
+            }
+            if (pos == end) return std::pair(pos, std::optional<range<decltype(pos)>>());
+            ++pos;
+            break;
+        case '{': case '[':
+            ++depth;
+            ++pos;
+            continue;
+        case '}': case ']':
+            if (depth == 0) break;
+            ++pos;
+            if (--depth == 0) return std::pair(pos, std::optional(range(begin, pos)));
+            continue;
+        case ',': case ' ': case '\t': case '\n': case '\r':
+            if (depth == 0) break;
+            ++pos;
+            continue;
+        }
+        if (depth == 0) break;
+    }
+    bool success = depth == 0 && pos != begin;
+    return std::pair(pos, success ? std::optional(range(begin, pos)) : std::nullopt);
+});
+
+/**
+ * A cursor to a JSON value that is parsed on demand from its position in the input.
+ *
+ * Looking up a member or an element parses the keys of an object, or counts the elements
+ * of an array, and skips the values in between with `json_skip_parser`, so that nothing is
+ * allocated or converted for them. Lookups return an invalid value if the input is not of
+ * the expected form, and lookups on an invalid value return invalid values.
+ *
+ * Example:
+ * ```
+ * json_ondemand doc(input);
+ * std::optional<double> d = doc["a"]["b"][3].get_number();
+ * ```
+ */
+class json_ondemand {
+    const char* position = nullptr;
+    const char* end = nullptr;
+
+    json_ondemand(const char* position, const char* end) : position{position}, end{end} {}
+
+    std::string_view rest(const char* from) const { return {from, size_t(end - from)}; }
+
+    // The position after whitespace at `p`
+    const char* skip_whitespace(const char* p) const {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+        return p;
+    }
+
+    // The position after the item `c` (and whitespace before it), or nullptr
+    const char* skip_item(const char* p, char c) const {
+        p = skip_whitespace(p);
+        return p != end && *p == c ? p + 1 : nullptr;
+    }
+
+    // The position after the value at `p`, or nullptr
+    const char* skip_value(const char* p) const {
+        auto [state, res] = json_skip_parser.parse(rest(p));
+        return res ? state.position : nullptr;
+    }
+
+    // The position of the next member or element after `p`, or nullptr if `close` is next
+    const char* next(const char* p, char close) const {
+        p = skip_whitespace(p);
+        if (p == end || *p == close) return nullptr;
+        return *p == ',' ? skip_whitespace(p + 1) : nullptr;
+    }
+
+    // The first member or element of an object or array opened by `open`, or nullptr
+    const char* first(char open, char close) const {
+        if (!*this || *position != open) return nullptr;
+        auto p = skip_whitespace(position + 1);
+        return p != end && *p != close ? p : nullptr;
+    }
+
+    template <const auto&... Pointers>
+    friend struct json_pointers;
+
+public:
+    enum class type { object, array, string, number, boolean, null, invalid };
+
+    /// An invalid value.
+    json_ondemand() = default;
+
+    /// The value of the document `input`, which must outlive the value.
+    explicit json_ondemand(std::string_view input)
+        : json_ondemand(input.data(), input.data() + input.size()) {
+        position = skip_whitespace(position);
+        if (position == end) position = nullptr;
+    }
+
+    /// False if the value is invalid, e.g. if a lookup failed.
+    explicit operator bool() const { return position != nullptr; }
+
+    type get_type() const {
+        if (!*this) return type::invalid;
+        switch (*position) {
+        case '{': return type::object;
+        case '[': return type::array;
+        case '"': return type::string;
+        case 't': case 'f': return type::boolean;
+        case 'n': return type::null;
+        default: return type::number;
+        }
+    }
+
+    /// The value of the first member of an object with the key `key`.
+    json_ondemand operator[](std::string_view key) const {
+        for (auto p = first('{', '}'); p; p = next(p, '}')) {
+            auto [state, k] = string_view_parser.parse(rest(p));
+            if (!k) break;
+            auto value = skip_whitespace(state.position);
+            if (value == end || *value != ':') break;
+            value = skip_whitespace(value + 1);
+            if (*k == key) return json_ondemand(value, end);
+            if (!(p = skip_value(value))) break;
+        }
+        return {};
+    }
+
+    /// The element at `index` of an array.
+    template <typename Integral, typename = std::enable_if_t<std::is_integral_v<Integral>>>
+    json_ondemand operator[](Integral index) const {
+        for (auto p = first('[', ']'); p; p = next(p, ']')) {
+            if (index-- == 0) return json_ondemand(p, end);
+            if (!(p = skip_value(p))) break;
+        }
+        return {};
+    }
+
+    /// The number of elements of an array, or members of an object, which skips all of them.
+    size_t size() const {
+        bool object = get_type() == type::object;
+        size_t count = 0;
+        for (auto p = object ? first('{', '}') : first('[', ']'); p; p = next(p, object ? '}' : ']')) {
+            if (object && !((p = skip_value(p)) && (p = skip_item(p, ':')))) break;
+            if (!(p = skip_value(skip_whitespace(p)))) break;
+            ++count;
+        }
+        return count;
+    }
+
+    /// The number, or `std::nullopt` if the value is not a number.
+    std::optional<json_number> get_number() const {
+        if (!*this) return {};
+        if (auto res = number_parser.parse(rest(position)).second) return *res;
+        return {};
+    }
+
+    std::optional<json_string_view> get_string() const {
+        if (!*this) return {};
+        if (auto res = string_view_parser.parse(rest(position)).second) return *res;
+        return {};
+    }
+
+    std::optional<json_bool> get_bool() const {
+        if (!*this) return {};
+        if (auto res = bool_parser.parse(rest(position)).second) return *res;
+        return {};
+    }
+
+    bool is_null() const {
+        return get_type() == type::null && null_parser.parse(rest(position)).second.has_value();
+    }
+
+    /// The raw text of the value, as skipped by `json_skip_parser`.
+    std::string_view raw() const {
+        if (!*this) return {};
+        auto after = skip_value(position);
+        return after ? std::string_view(position, size_t(after - position)) : std::string_view();
+    }
+};
+
+/**
+ * The values at the JSON pointers (RFC 6901) `Pointers`, extracted in a single pass.
+ *
+ * The pointers are `constexpr` character arrays. Members and elements that no pointer
+ * refers to are skipped with `json_skip_parser`.
+ *
+ * Example:
+ * ```
+ * constexpr char id[] = "/id", name[] = "/user/name";
+ * auto [i, n] = json_pointers<id, name>::extract(input);
+ * ```
+ */
+template <const auto&... Pointers>
+struct json_pointers {
+    static constexpr size_t count = sizeof...(Pointers);
+
+    using values = std::array<json_ondemand, count>;
+
+    /// The values at the pointers in `input`. Values that are not found are invalid.
+    static values extract(std::string_view input) {
+        values result{};
+        json_ondemand doc(input);
+        if (!doc) return result;
+        active all{};
+        for (size_t i = 0; i < count; ++i) all.indices[i] = i;
+        all.size = count;
+        extract_from(doc, all, result);
+        return result;
+    }
+
+private:
+    static constexpr std::string_view pointers[] = {Pointers...};
+
+    // The indices of the pointers that refer to the current value or its children, and the
+    // lengths of the prefixes of the pointers that refer to the current value. The lengths
+    // differ when different reference tokens refer to the same member, e.g. `~0` and `~`.
+    struct active {
+        std::array<size_t, count> indices;
+        std::array<size_t, count> offsets;
+        size_t size;
+    };
+
+    // The reference token of `pointer` that starts at `offset`, without the leading `/`
+    static constexpr std::string_view token(std::string_view pointer, size_t offset) {
+        auto token = pointer.substr(offset + 1);
+        return token.substr(0, token.find('/'));
+    }
+
+    // Whether the reference token `t` refers to the key `key`
+    static bool matches(std::string_view t, const json_string_view& key) {
+        if (t.find('~') == std::string_view::npos) return key == t;
+        std::string decoded;
+        for (size_t i = 0; i < t.size(); ++i) {
+            if (t[i] == '~' && i + 1 < t.size()) {
+                decoded += t[++i] == '1' ? '/' : '~';
+            } else {
+                decoded += t[i];
+            }
+        }
+        return key == decoded;
+    }
+
+    // Whether the reference token `t` is the array index `index`
+    static bool matches(std::string_view t, size_t index) {
+        if (t.size() > 1 && t[0] == '0') return false;
+        auto [state, i] = integer<size_t, options::no_negative>().parse(t);
+        return i && *i == index && state.position == t.data() + t.size();
+    }
+
+    // Extract the pointers in `a` from `v`. Return the number of pointers that were found.
+    static size_t extract_from(const json_ondemand& v, const active& a, values& result) {
+        active children{};
+        size_t found = 0;
+        for (size_t i = 0; i < a.size; ++i) {
+            if (pointers[a.indices[i]].size() == a.offsets[i]) {
+                result[a.indices[i]] = v;
+                ++found;
+            } else {
+                children.indices[children.size] = a.indices[i];
+                children.offsets[children.size++] = a.offsets[i];
+            }
+        }
+        if (children.size == 0) return found;
+
+        bool object = v.get_type() == json_ondemand::type::object;
+        if (!object && v.get_type() != json_ondemand::type::array) return found;
+        char close = object ? '}' : ']';
+        size_t index = 0;
+        for (auto p = v.first(object ? '{' : '[', close); p; p = v.next(p, close), ++index) {
+            // The pointers that continue with this member or element
+            active matching{};
+            json_string_view key;
+            if (object) {
+                auto [state, k] = string_view_parser.parse(v.rest(p));
+                if (!k || !(p = v.skip_item(state.position, ':'))) break;
+                p = v.skip_whitespace(p);
+                key = *k;
+            }
+            for (size_t i = 0; i < children.size; ++i) {
+                auto t = token(pointers[children.indices[i]], children.offsets[i]);
+                if (object ? matches(t, key) : matches(t, index)) {
+                    matching.indices[matching.size] = children.indices[i];
+                    matching.offsets[matching.size++] = children.offsets[i] + 1 + t.size();
+                }
+            }
+
+            if (matching.size != 0) {
+                json_ondemand child(p, v.end);
+                found += extract_from(child, matching, result);
+                if (found == a.size) break;
+            }
+            if (!(p = v.skip_value(p))) break;
+        }
+        return found;
+    }
+};
+
+#endif // JSON_ONDEMAND_H
@@ -0,0 +1,156 @@
+#ifndef JSON_PARALLEL_H
+#define JSON_PARALLEL_H
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "json_parser.h"
+
+// Call `f(i)` for `i` in `[0, n)`, each on its own thread
+template <typename Fn>
+void json_run_parallel(size_t n, Fn f) {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n; ++i) threads.emplace_back(f, i);
+    f(0);
+    for (auto& t : threads) t.join();
+}
+
+/**
+ * Split the top-level JSON array `input` into the ranges of its elements, scanning
+ * `chunks` parts of the input in parallel with `structural_index`.
+ *
+ * The parts are scanned speculatively, as if each begins outside of a string. Parts are
+ * split after newlines where possible, which never occur in strings of valid JSON.
+ * Return `std::nullopt` if the speculation turned out to be wrong, i.e. a part ends in a
+ * string, or if the input is not an array.
+ */
+inline std::optional<std::vector<std::string_view>> split_json_array(std::string_view input, size_t chunks) {
+    auto first = input.find_first_not_of(" \t\n\r");
+    auto last = input.find_last_not_of(" \t\n\r");
+    if (first == std::string_view::npos || input[first] != '[' || input[last] != ']' || first == last) {
+        return std::nullopt;
+    }
+    // The contents of the array, with the closing bracket as the last structural item
+    auto contents = input.substr(first + 1, last - first);
+
+    chunks = std::max<size_t>(1, std::min(chunks, contents.size() / 4096));
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < chunks; ++i) {
+        auto approximate = std::max(contents.size() / chunks * i, bounds.back());
+        auto newline = contents.find('\n', approximate);
+        bounds.push_back(newline != std::string_view::npos && newline - approximate < 4096 ? newline + 1 : approximate);
+    }
+    bounds.push_back(contents.size());
+
+    struct part {
+        structural_index index;
+        long depth_change = 0;
+        bool ends_in_string = false;
+        std::vector<std::string_view> elements;
+    };
+    std::vector<part> parts(chunks);
+
+    json_run_parallel(chunks, [&](size_t i) {
+        auto& p = parts[i];
+        auto chunk = contents.substr(bounds[i], bounds[i + 1] - bounds[i]);
+        p.index.build(chunk.data(), chunk.size());
+        size_t quotes = 0;
+        for (auto offset : p.index.offsets()) {
+            switch (chunk[offset]) {
+            case '"': ++quotes; break;
+            case '{': case '[': ++p.depth_change; break;
+            case '}': case ']': --p.depth_change; break;
+            }
+        }
+        p.ends_in_string = quotes % 2 != 0;
+    });
+
+    // The nesting depth at the start of each part, relative to the contents of the array
+    std::vector<long> depths{0};
+    for (size_t i = 0; i < chunks; ++i) {
+        if (parts[i].ends_in_string) return std::nullopt;
+        depths.push_back(depths.back() + parts[i].depth_change);
+    }
+    if (depths.back() != -1) return std::nullopt;
+
+    // Elements end at commas and at the closing bracket at depth 0
+    std::vector<std::vector<const char*>> ends(chunks);
+    json_run_parallel(chunks, [&](size_t i) {
+        auto depth = depths[i];
+        auto chunk = contents.data() + bounds[i];
+        for (auto offset : parts[i].index.offsets()) {
+            switch (chunk[offset]) {
+            case '{': case '[': ++depth; break;
+            case '}': case ']':
+                if (depth-- == 0) ends[i].push_back(chunk + offset);
+                break;
+            case ',':
+                if (depth == 0) ends[i].push_back(chunk + offset);
+                break;
+            }
+        }
+    });
+
+    std::vector<std::string_view> elements;
+    auto start = contents.data();
+    for (auto& part_ends : ends) {
+        for (auto end : part_ends) {
+            elements.emplace_back(start, size_t(end - start));
+            start = end + 1;
+        }
+    }
+    // An empty array has a single element of whitespace
+    if (elements.size() == 1 && elements[0].find_first_not_of(" \t\n\r") == std::string_view::npos) {
+        elements.clear();
+    }
+    return elements;
+}
+
+/**
+ * Parse the top-level JSON array `input` with `json_parser`, with the elements split by
+ * `split_json_array` and parsed on `threads` threads. If the split fails, the input is
+ * parsed sequentially.
+ */
+inline std::optional<json_array> parse_json_array_parallel(std::string_view input,
+                                                           size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<size_t>(threads, 1);
+    auto split = split_json_array(input, threads);
+    if (!split) {
+        auto res = (json_parser << trim()).parse(input);
+        if (!res.second || res.first.position != input.data() + input.size() || !res.second->is_a<json_array>()) {
+            return std::nullopt;
+        }
+        return std::move(res.second->get<json_array>());
+    }
+
+    auto& elements = *split;
+    threads = std::max<size_t>(1, std::min(threads, elements.size()));
+    std::vector<json_array> parts(threads);
+    std::vector<char> failed(threads, false);
+    json_run_parallel(threads, [&](size_t i) {
+        auto begin = elements.size() * i / threads;
+        auto end = elements.size() * (i + 1) / threads;
+        parts[i].reserve(end - begin);
+        for (auto e = begin; e != end; ++e) {
+            auto res = (json_parser << trim()).parse(elements[e]);
+            if (!res.second || res.first.position != elements[e].data() + elements[e].size()) {
+                failed[i] = true;
+                return;
+            }
+            parts[i].push_back(std::move(*res.second));
+        }
+    });
+    if (std::find(failed.begin(), failed.end(), true) != failed.end()) return std::nullopt;
+
+    json_array result;
+    result.reserve(elements.size());
+    for (auto& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(result));
+    }
+    return result;
+}
+
+#endif // JSON_PARALLEL_H
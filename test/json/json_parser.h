@@ -1,6 +1,8 @@
 #ifndef JSON_PARSER_H
 #define JSON_PARSER_H
 
+#include <cstring>
+#include <string_view>
 #include "json_value.h"
 #include "anpa/anpa.h"
 
@@ -12,27 +14,36 @@ constexpr auto eat(Parser p) {
     return trim() >> p;
 }
 
-constexpr auto string_parser = []() {
+// The contents of a string, without the quotes and escapes left as is
+constexpr auto string_contents_parser = []() {
     constexpr auto unicode = item<'u'>() >> times<4>(item_if([](const auto& f) {return std::isxdigit(f);}));
     constexpr auto escaped = item<'\\'>() >> (unicode || any_of<'"','\\','/','b','f','n','r','t'>());
     constexpr auto notEnd = escaped | item_if_not([](auto c) {
         return c == '"' || static_cast<std::make_unsigned_t<decltype(c)>>(c) < 0x20;
     });
-    return lift_value<json_string>(item<'"'>() >> many(notEnd) << item<'"'>());
+    return item<'"'>() >> many(notEnd) << item<'"'>();
 }();
 
+constexpr auto string_parser = lift_value<json_string>(string_contents_parser);
+
+// A string that refers to the input. Escaped strings are flagged, and decoded on demand.
+constexpr auto string_view_parser = lift([](auto r) {
+    std::string_view raw(r);
+    return json_string_view(raw, std::memchr(raw.data(), '\\', raw.size()) != nullptr);
+}, string_contents_parser);
+
 constexpr auto number_parser = floating<json_number, options::no_leading_zero>();
 constexpr auto bool_parser = seq<'t','r','u','e'>() >> mreturn<true>() ||
                                  seq<'f','a','l','s','e'>() >> mreturn<false>();
 constexpr auto null_parser = seq<'n','u','l','l'>() >> mreturn_emplace<json_null>();
 
-template <typename P>
-constexpr auto get_object_parser(P value_parser) {
+template <typename P, typename KeyParser = decltype(string_parser)>
+constexpr auto get_object_parser(P value_parser, KeyParser key_parser = string_parser) {
     auto shared_value_parser = lift([](auto&& r) {
-        return std::make_shared<json_value>(std::forward<decltype(r)>(r));
+        return std::make_shared<std::decay_t<decltype(r)>>(std::forward<decltype(r)>(r));
     }, value_parser);
 
-    return item<'{'>() >> many_to_map<options::no_trailing_separator>(eat(string_parser),
+    return item<'{'>() >> many_to_map<options::no_trailing_separator>(eat(key_parser),
                                       eat(item<':'>() >> shared_value_parser),
                                       eat(item<','>())) << eat(item<'}'>());
 }
@@ -42,11 +53,26 @@ constexpr auto get_array_parser(P value_parser) {
     return item<'['>() >> many_to_vector<options::no_trailing_separator>(value_parser, eat(item<','>())) << eat(item<']'>());
 }
 
-constexpr auto json_parser = recursive<json_value>([](auto val_parser) {
+// The grammar for a JSON value, given a parser for nested values
+constexpr auto json_value_grammar = [](auto val_parser) {
+    // The first item of a value decides which alternative to parse. The first items of the
+    // alternatives are deduced (see "json first sets"), so they need no `first_of` annotations.
     return eat(lift_or_value<json_value>(string_parser, number_parser,
                                          get_object_parser(val_parser), get_array_parser(val_parser),
                                          bool_parser, null_parser));
-});
+};
+
+constexpr auto json_parser = recursive<json_value>(json_value_grammar);
+
+// The grammar for a `json_view_value`, given a parser for nested values
+constexpr auto json_view_grammar = [](auto val_parser) {
+    return eat(lift_or_value<json_view_value>(string_view_parser, number_parser,
+                                              get_object_parser(val_parser, string_view_parser),
+                                              get_array_parser(val_parser), bool_parser, null_parser));
+};
+
+// A parser for values that refer to the input, which is faster for inputs with many strings
+constexpr auto json_view_parser = recursive<json_view_value>(json_view_grammar);
 
 constexpr auto array_parser = get_array_parser(json_parser);
 constexpr auto object_parser = get_object_parser(json_parser);
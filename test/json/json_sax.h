@@ -0,0 +1,64 @@
+#ifndef JSON_SAX_H
+#define JSON_SAX_H
+
+#include "json_parser.h"
+
+/**
+ * Handler for the events of `parse_json_sax`, which does nothing.
+ *
+ * Handlers may derive from this class and hide the events they are interested in.
+ * Every event returns whether to continue parsing, so returning `false` stops the parse.
+ * Strings and keys refer to the input.
+ */
+struct json_sax_handler {
+    bool start_object() { return true; }
+    bool key(const json_string_view&) { return true; }
+    bool end_object() { return true; }
+    bool start_array() { return true; }
+    bool end_array() { return true; }
+    bool string(const json_string_view&) { return true; }
+    bool number(json_number) { return true; }
+    bool boolean(json_bool) { return true; }
+    bool null() { return true; }
+};
+
+// The grammar for a JSON value that calls the handler in the user state for each event,
+// given a parser for nested values. The parsers fail if the handler returns `false`.
+constexpr auto json_sax_grammar = [](auto val_parser) {
+    constexpr auto event = [](auto f, auto p) {
+        return constrain([](bool proceed) { return proceed; }, apply_to_state(f, p));
+    };
+
+    constexpr auto key = event([](auto& h, const json_string_view& s) { return h.key(s); }, string_view_parser);
+    constexpr auto string = event([](auto& h, const json_string_view& s) { return h.string(s); }, string_view_parser);
+    constexpr auto number = event([](auto& h, json_number d) { return h.number(d); }, number_parser);
+    constexpr auto boolean = event([](auto& h, json_bool b) { return h.boolean(b); }, bool_parser);
+    constexpr auto null = event([](auto& h, const auto&) { return h.null(); }, null_parser);
+    constexpr auto start_object = event([](auto& h, const auto&) { return h.start_object(); }, item<'{'>());
+    constexpr auto end_object = event([](auto& h, const auto&) { return h.end_object(); }, item<'}'>());
+    constexpr auto start_array = event([](auto& h, const auto&) { return h.start_array(); }, item<'['>());
+    constexpr auto end_array = event([](auto& h, const auto&) { return h.end_array(); }, item<']'>());
+
+    auto member = eat(key) >> eat(item<':'>()) >> val_parser;
+    auto object = start_object >>
+                  many<options::no_trailing_separator>(member, eat(item<','>())) >>
+                  eat(end_object);
+    auto array = start_array >>
+                 many<options::no_trailing_separator>(val_parser, eat(item<','>())) >>
+                 eat(end_array);
+
+    return eat(string || number || object || array || boolean || null);
+};
+
+constexpr auto json_sax_parser = recursive<bool>(json_sax_grammar);
+
+/**
+ * Parse `str` and call the events of `handler` (see `json_sax_handler`) without building a DOM.
+ * Return whether the parse succeeded, which is `false` if the handler stopped it.
+ */
+template <typename Sequence, typename Handler>
+bool parse_json_sax(const Sequence& str, Handler& handler) {
+    return json_sax_parser.parse_with_state(str, handler).second.has_value();
+}
+
+#endif // JSON_SAX_H
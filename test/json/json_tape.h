@@ -0,0 +1,239 @@
+#ifndef JSON_TAPE_H
+#define JSON_TAPE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "json_parser.h"
+
+/**
+ * A JSON document stored as one tape of 64-bit words and one buffer of strings.
+ *
+ * Every word has a tag in its upper 8 bits and a payload in the lower 56:
+ * - `{` and `[`: the index after the matching `}` or `]` in the lower 32 bits,
+ *   and the number of members or elements in the upper 24 (saturating)
+ * - `}` and `]`: the index of the matching `{` or `[`
+ * - `"`: the offset of the string in the string buffer, where it is stored as
+ *   its length (32 bits) followed by its raw contents, and a flag for escaped strings
+ * - `d`: a number, stored in the following word
+ * - `t`, `f` and `n`: true, false and null
+ *
+ * The document is freed in one go with the two buffers.
+ */
+class json_tape {
+public:
+    enum class type { object, array, string, number, boolean, null };
+
+    /// Cursor to a value of the document.
+    class element;
+
+    json_tape() = default;
+
+    /// The root value. The document must have been parsed successfully.
+    element root() const;
+
+    /// Remove the document, but keep the allocated storage.
+    void clear() {
+        words.clear();
+        strings.clear();
+        open.clear();
+    }
+
+    /// The number of bytes allocated for the document.
+    size_t memory_usage() const {
+        return words.capacity() * sizeof(uint64_t) + strings.capacity() + open.capacity() * sizeof(container);
+    }
+
+    // Construction, used by the parser
+
+    void add_string(const json_string_view& s) {
+        add_word('"', strings.size() | (s.is_escaped() ? escaped_flag : 0));
+        uint32_t length = static_cast<uint32_t>(s.raw().size());
+        strings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        strings.append(s.raw());
+    }
+
+    void add_number(double d) {
+        add_word('d', 0);
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        words.push_back(bits);
+    }
+
+    void add_literal(char tag) {
+        add_word(tag, 0);
+    }
+
+    void open_container(char tag) {
+        add_word(tag, 0);
+        open.push_back({words.size() - 1, 0});
+    }
+
+    void close_container(char tag) {
+        auto [start, count] = open.back();
+        open.pop_back();
+        words.push_back(uint64_t(static_cast<unsigned char>(tag)) << 56 | start);
+        words[start] |= std::min<uint64_t>(count, max_count) << 32 | words.size();
+    }
+
+private:
+    static constexpr uint64_t payload_mask = (uint64_t(1) << 56) - 1;
+    static constexpr uint64_t max_count = (uint64_t(1) << 24) - 1;
+    static constexpr uint64_t escaped_flag = uint64_t(1) << 55;
+
+    struct container {
+        size_t start;
+        uint64_t count;
+    };
+
+    std::vector<uint64_t> words;
+    std::string strings;
+    std::vector<container> open;
+
+    // Add a value, which is a child of the innermost open container
+    void add_word(char tag, uint64_t payload) {
+        if (!open.empty()) ++open.back().count;
+        words.push_back(uint64_t(static_cast<unsigned char>(tag)) << 56 | payload);
+    }
+
+    char tag(size_t i) const { return static_cast<char>(words[i] >> 56); }
+    uint64_t payload(size_t i) const { return words[i] & payload_mask; }
+
+    /// The index after the value at `i`.
+    size_t next(size_t i) const {
+        switch (tag(i)) {
+        case '{': case '[': return payload(i) & 0xffffffff;
+        case 'd': return i + 2;
+        default: return i + 1;
+        }
+    }
+};
+
+class json_tape::element {
+    const json_tape* tape = nullptr;
+    size_t index = 0;
+
+    friend class json_tape;
+
+    element(const json_tape* tape, size_t index) : tape{tape}, index{index} {}
+
+    char tag() const { return tape->tag(index); }
+
+public:
+    element() = default;
+
+    /// False for the element returned by `find_field` if there is no such field.
+    explicit operator bool() const { return tape != nullptr; }
+
+    json_tape::type type() const {
+        switch (tag()) {
+        case '{': return type::object;
+        case '[': return type::array;
+        case '"': return type::string;
+        case 'd': return type::number;
+        case 't': case 'f': return type::boolean;
+        default: return type::null;
+        }
+    }
+
+    bool is_object() const { return tag() == '{'; }
+    bool is_array() const { return tag() == '['; }
+
+    double get_number() const {
+        double d;
+        std::memcpy(&d, &tape->words[index + 1], sizeof(d));
+        return d;
+    }
+
+    bool get_bool() const { return tag() == 't'; }
+
+    /// The string, which is decoded on demand if it is escaped.
+    json_string_view get_string() const {
+        auto payload = tape->payload(index);
+        auto offset = payload & ~escaped_flag;
+        uint32_t length;
+        std::memcpy(&length, tape->strings.data() + offset, sizeof(length));
+        return {{tape->strings.data() + offset + sizeof(length), length}, (payload & escaped_flag) != 0};
+    }
+
+    /// The number of members of an object or elements of an array, or 0 for other values.
+    size_t size() const {
+        if (!is_object() && !is_array()) return 0;
+        return (tape->payload(index) >> 32) / (is_object() ? 2 : 1);
+    }
+
+    /// The value of the first member of an object with the key `key`.
+    element find_field(std::string_view key) const {
+        auto end = tape->next(index) - 1;
+        for (auto i = index + 1; i < end; i = tape->next(i + 1)) {
+            if (element(tape, i).get_string() == key) return {tape, i + 1};
+        }
+        return {};
+    }
+
+    /// Iterator over the elements of an array, or the keys and values of an object.
+    class iterator {
+        const json_tape* tape;
+        size_t index;
+
+    public:
+        iterator(const json_tape* tape, size_t index) : tape{tape}, index{index} {}
+        element operator*() const { return {tape, index}; }
+        iterator& operator++() {
+            index = tape->next(index);
+            return *this;
+        }
+        bool operator==(const iterator& other) const { return index == other.index; }
+        bool operator!=(const iterator& other) const { return index != other.index; }
+    };
+
+    iterator begin() const { return {tape, index + 1}; }
+    iterator end() const { return {tape, tape->next(index) - 1}; }
+};
+
+inline json_tape::element json_tape::root() const {
+    return {this, 0};
+}
+
+// The grammar for a JSON value on a tape, given a parser for nested values.
+// The parsers add the values to the `json_tape` passed as user state.
+constexpr auto json_tape_grammar = [](auto val_parser) {
+    constexpr auto string = apply_to_state([](json_tape& t, const json_string_view& s) { t.add_string(s); },
+                                           string_view_parser);
+    constexpr auto number = apply_to_state([](json_tape& t, double d) { t.add_number(d); }, number_parser);
+    constexpr auto literal = [](auto p, char tag) {
+        return apply_to_state([tag](json_tape& t, const auto&) { t.add_literal(tag); }, p);
+    };
+    constexpr auto open = [](auto p, char tag) {
+        return apply_to_state([tag](json_tape& t, const auto&) { t.open_container(tag); }, p);
+    };
+    constexpr auto close = [](auto p, char tag) {
+        return apply_to_state([tag](json_tape& t, const auto&) { t.close_container(tag); }, p);
+    };
+
+    auto member = eat(string) >> eat(item<':'>()) >> val_parser;
+    auto object = open(item<'{'>(), '{') >>
+                  many<options::no_trailing_separator>(member, eat(item<','>())) >>
+                  eat(close(item<'}'>(), '}'));
+    auto array = open(item<'['>(), '[') >>
+                 many<options::no_trailing_separator>(val_parser, eat(item<','>())) >>
+                 eat(close(item<']'>(), ']'));
+
+    return eat(string || number || object || array ||
+               literal(seq<'t','r','u','e'>(), 't') || literal(seq<'f','a','l','s','e'>(), 'f') ||
+               literal(seq<'n','u','l','l'>(), 'n'));
+};
+
+constexpr auto json_tape_parser = recursive<empty_result>(json_tape_grammar);
+
+/// Parse `str` to `tape`. Return whether the parse succeeded.
+template <typename Sequence>
+bool parse_json_tape(const Sequence& str, json_tape& tape) {
+    tape.clear();
+    return json_tape_parser.parse_with_state(str, tape).second.has_value();
+}
+
+#endif // JSON_TAPE_H
@@ -1,6 +1,11 @@
 #ifndef JSON_VALUE_H
 #define JSON_VALUE_H
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <variant>
@@ -9,26 +14,218 @@
 
 struct json_value;
 
-using json_string = std::string;
-using json_object = std::unordered_map<json_string, std::shared_ptr<json_value>>;
-using json_array = std::vector<json_value>;
+/**
+ * A JSON string that refers to its raw contents (without the quotes) in the input.
+ *
+ * Strings without escapes are used as they are. Escaped strings are flagged, and
+ * decoded on demand with `decode`, `get` or `str`. Comparison and hashing only
+ * decode if a string is escaped, so keys are usually compared in their raw form.
+ */
+class json_string_view {
+    std::string_view raw_contents;
+    bool escaped = false;
+
+    static unsigned hex_value(char c) {
+        return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+    }
+
+    static unsigned read_hex(const char* p) {
+        return hex_value(p[0]) << 12 | hex_value(p[1]) << 8 | hex_value(p[2]) << 4 | hex_value(p[3]);
+    }
+
+    // Call `f` with each decoded character until it returns false.
+    // Return false if `f` did.
+    template <typename F>
+    bool for_each_decoded(F f) const {
+        auto p = raw_contents.data();
+        auto end = p + raw_contents.size();
+        while (p != end) {
+            if (*p != '\\') {
+                if (!f(*p++)) return false;
+                continue;
+            }
+            char c = p[1];
+            p += 2;
+            switch (c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u': {
+                std::uint32_t cp = read_hex(p);
+                p += 4;
+                // Combine surrogate pairs. Lone surrogates are encoded as they are.
+                if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    auto low = read_hex(p + 2);
+                    if (low >= 0xdc00 && low < 0xe000) {
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                        p += 6;
+                    }
+                }
+                char utf8[4];
+                int n = encode_utf8(cp, utf8);
+                for (int i = 0; i < n; ++i) {
+                    if (!f(utf8[i])) return false;
+                }
+                continue;
+            }
+            default: break;
+            }
+            if (!f(c)) return false;
+        }
+        return true;
+    }
+
+    static int encode_utf8(std::uint32_t cp, char* out) {
+        if (cp < 0x80) {
+            out[0] = char(cp);
+            return 1;
+        } else if (cp < 0x800) {
+            out[0] = char(0xc0 | cp >> 6);
+            out[1] = char(0x80 | (cp & 0x3f));
+            return 2;
+        } else if (cp < 0x10000) {
+            out[0] = char(0xe0 | cp >> 12);
+            out[1] = char(0x80 | (cp >> 6 & 0x3f));
+            out[2] = char(0x80 | (cp & 0x3f));
+            return 3;
+        }
+        out[0] = char(0xf0 | cp >> 18);
+        out[1] = char(0x80 | (cp >> 12 & 0x3f));
+        out[2] = char(0x80 | (cp >> 6 & 0x3f));
+        out[3] = char(0x80 | (cp & 0x3f));
+        return 4;
+    }
+
+    // Whether the decoded form of this string equals `s`, which has no escapes
+    bool equals_unescaped(std::string_view s) const {
+        if (!escaped) return raw_contents == s;
+        size_t i = 0;
+        return for_each_decoded([&](char c) {
+            return i < s.size() && s[i++] == c;
+        }) && i == s.size();
+    }
+
+public:
+    json_string_view() = default;
+
+    /// A string with the raw contents `raw`, which contain escapes if `escaped` is true.
+    constexpr json_string_view(std::string_view raw, bool escaped) : raw_contents{raw}, escaped{escaped} {}
+
+    /// A string without escapes.
+    constexpr json_string_view(std::string_view s) : raw_contents{s} {}
+    constexpr json_string_view(const char* s) : raw_contents{s} {}
+    json_string_view(const std::string& s) : raw_contents{s} {}
+
+    /// The contents as they appear in the input.
+    constexpr std::string_view raw() const { return raw_contents; }
+
+    /// Whether the contents contain escapes, so that they must be decoded.
+    constexpr bool is_escaped() const { return escaped; }
+
+    /// The length of the decoded string is at most this size.
+    constexpr size_t max_size() const { return raw_contents.size(); }
+
+    /**
+     * Write the decoded string to `out`, and return the end of the output.
+     * At most `max_size()` characters are written, so `out` may point to a
+     * buffer of that size, e.g. from an arena.
+     */
+    template <typename OutputIt>
+    OutputIt decode(OutputIt out) const {
+        if (!escaped) return std::copy(raw_contents.begin(), raw_contents.end(), out);
+        for_each_decoded([&out](char c) {
+            *out++ = c;
+            return true;
+        });
+        return out;
+    }
+
+    /// The decoded string, which is written to `buffer` if the string is escaped.
+    std::string_view get(std::string& buffer) const {
+        if (!escaped) return raw_contents;
+        buffer.resize(max_size());
+        buffer.resize(decode(buffer.data()) - buffer.data());
+        return buffer;
+    }
+
+    /// A copy of the decoded string.
+    std::string str() const {
+        if (!escaped) return std::string(raw_contents);
+        std::string buffer;
+        get(buffer);
+        return buffer;
+    }
+
+    friend bool operator==(const json_string_view& a, const json_string_view& b) {
+        if (!b.escaped) return a.equals_unescaped(b.raw_contents);
+        if (!a.escaped) return b.equals_unescaped(a.raw_contents);
+        std::string buffer;
+        return a.equals_unescaped(b.get(buffer));
+    }
+
+    friend bool operator!=(const json_string_view& a, const json_string_view& b) {
+        return !(a == b);
+    }
+};
+
+namespace std {
+template <>
+struct hash<json_string_view> {
+    size_t operator()(const json_string_view& s) const {
+        std::string buffer;
+        return hash<string_view>()(s.get(buffer));
+    }
+};
+}
+
 using json_number = double;
 using json_bool = bool;
 using json_null = anpa::empty_result;
 
-using json_value_variant = std::variant<
-json_null,
-bool,
-json_string,
-json_number,
-json_object,
-json_array>;
+/**
+ * A JSON value of a DOM with strings of type `String`. `Value` is the type that derives
+ * from it, which is the type of the nested values.
+ */
+template <typename Value, typename String>
+struct basic_json_value {
+    using string = String;
+    using object = std::unordered_map<String, std::shared_ptr<Value>>;
+    using array = std::vector<Value>;
+    using variant = std::variant<json_null, bool, String, json_number, object, array>;
 
-struct json_value {
-    json_value_variant val;
+    variant val;
 
-    template <typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, json_value>>>
-    json_value(T&& t) : val(std::forward<T>(t)) {}
+    template <typename T, typename = std::enable_if_t<!std::is_base_of_v<basic_json_value, std::decay_t<T>>>>
+    basic_json_value(T&& t) : val(std::forward<T>(t)) {}
+
+    basic_json_value(const basic_json_value&) = default;
+    basic_json_value(basic_json_value&&) = default;
+    basic_json_value& operator=(const basic_json_value&) = default;
+    basic_json_value& operator=(basic_json_value&&) = default;
+
+    /**
+     * Values nested deeper than `max_recursive_destroy_depth` are destroyed iteratively,
+     * so that destroying a deeply nested document doesn't overflow the stack. Values of
+     * objects that are shared with another object are left to their other owner.
+     */
+    ~basic_json_value() {
+        static thread_local size_t depth = 0;
+        if (depth < max_recursive_destroy_depth) {
+            ++depth;
+            clear(val);
+            --depth;
+            return;
+        }
+        std::vector<Value> pending;
+        take_nested(val, pending);
+        while (!pending.empty()) {
+            auto v = std::move(pending.back());
+            pending.pop_back();
+            take_nested(v.val, pending);
+        }
+    }
 
     template <typename T>
     decltype(auto) get() {return std::get<T>(val);}
@@ -36,24 +233,81 @@ struct json_value {
     template <typename T>
     decltype(auto) is_a() {return std::holds_alternative<T>(val);}
 
-    decltype(auto) operator[](size_t i) {return std::get<json_array>(val)[i];}
+    decltype(auto) operator[](size_t i) {return std::get<array>(val)[i];}
 
-    template <typename Key, typename = std::enable_if_t<std::is_convertible_v<Key, json_string>>>
-    decltype(auto) operator[](const Key& key) {return *std::get<json_object>(val).at(key);}
+    template <typename Key, typename = std::enable_if_t<std::is_convertible_v<Key, String>>>
+    decltype(auto) operator[](const Key& key) {return *std::get<object>(val).at(key);}
 
     size_t size() const {
         return std::visit([](const auto& v) {
             using type = std::decay_t<decltype(v)>;
-            if constexpr (anpa::types::is_one_of<type, json_array, json_object>) return std::size(v);
+            if constexpr (anpa::types::is_one_of<type, array, object>) return std::size(v);
             else return size_t(0);
         }, val);
     }
 
     template <typename Key>
     auto contains(const Key& key) {
-        auto& map = get<json_object>();
+        auto& map = get<object>();
         return map.find(key) != map.end();
     }
+
+private:
+    static constexpr size_t max_recursive_destroy_depth = 256;
+
+    static bool is_nested(const variant& v) {
+        return std::visit([](const auto& v) {
+            using type = std::decay_t<decltype(v)>;
+            if constexpr (anpa::types::is_one_of<type, array, object>) return !v.empty();
+            else return false;
+        }, v);
+    }
+
+    static void clear(variant& v) {
+        if (auto a = std::get_if<array>(&v)) a->clear();
+        else if (auto o = std::get_if<object>(&v)) o->clear();
+    }
+
+    /// Move the nested values of `v` to `pending` and clear `v`.
+    static void take_nested(variant& v, std::vector<Value>& pending) {
+        if (auto a = std::get_if<array>(&v)) {
+            for (auto& e : *a) {
+                if (is_nested(e.val)) pending.push_back(std::move(e));
+            }
+            a->clear();
+        } else if (auto o = std::get_if<object>(&v)) {
+            for (auto& e : *o) {
+                if (e.second && e.second.use_count() == 1 && is_nested(e.second->val)) {
+                    pending.push_back(std::move(*e.second));
+                }
+            }
+            o->clear();
+        }
+    }
 };
 
+/**
+ * A JSON value that owns its strings. The contents of the strings are copied
+ * from the input as they are, with escapes left in place.
+ */
+struct json_value : basic_json_value<json_value, std::string> {
+    using basic_json_value::basic_json_value;
+};
+
+using json_string = json_value::string;
+using json_object = json_value::object;
+using json_array = json_value::array;
+using json_value_variant = json_value::variant;
+
+/**
+ * A JSON value whose strings refer to the input (see `json_string_view`), which must
+ * outlive the value. Parsed by `json_view_parser`, which doesn't copy any strings.
+ */
+struct json_view_value : basic_json_value<json_view_value, json_string_view> {
+    using basic_json_value::basic_json_value;
+};
+
+using json_view_object = json_view_value::object;
+using json_view_array = json_view_value::array;
+
 #endif // JSON_VALUE_H
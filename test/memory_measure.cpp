@@ -0,0 +1,46 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "memory_measure.h"
+
+namespace {
+
+std::atomic<std::size_t> allocated{0};
+std::atomic<std::size_t> peak_allocated{0};
+
+// Every allocation is preceded by a header with its size, which keeps the alignment of `malloc`
+constexpr std::size_t header_size = alignof(std::max_align_t);
+
+void* allocate(std::size_t size) {
+    auto memory = static_cast<char*>(std::malloc(size + header_size));
+    if (!memory) throw std::bad_alloc();
+    *reinterpret_cast<std::size_t*>(memory) = size;
+    auto now = allocated += size;
+    auto peak = peak_allocated.load();
+    while (now > peak && !peak_allocated.compare_exchange_weak(peak, now));
+    return memory + header_size;
+}
+
+void deallocate(void* pointer) {
+    if (!pointer) return;
+    auto memory = static_cast<char*>(pointer) - header_size;
+    allocated -= *reinterpret_cast<std::size_t*>(memory);
+    std::free(memory);
+}
+
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void operator delete(void* pointer) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { deallocate(pointer); }
+
+namespace memory_measure {
+
+std::size_t current() { return allocated.load(); }
+std::size_t peak() { return peak_allocated.load(); }
+void reset_peak() { peak_allocated = allocated.load(); }
+
+}
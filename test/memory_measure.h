@@ -0,0 +1,26 @@
+#ifndef MEMORY_MEASURE_H
+#define MEMORY_MEASURE_H
+
+#include <cstddef>
+#include <iostream>
+
+// Heap usage of the test program, counted by the replaced global `operator new` (memory_measure.cpp)
+namespace memory_measure {
+
+/// The number of bytes currently allocated
+std::size_t current();
+
+/// The largest number of bytes allocated at once since the last call to `reset_peak`
+std::size_t peak();
+
+/// Reset the peak to the current number of bytes allocated
+void reset_peak();
+
+}
+
+#define MEMORY_MEASURE_START memory_measure::reset_peak(); auto _memory_start = memory_measure::current()
+
+#define MEMORY_MEASURE_END(x) std::cout << "Peak memory for: " << x << " " \
+    << (memory_measure::peak() - _memory_start) / 1024.0 << " KiB" << std::endl
+
+#endif // MEMORY_MEASURE_H
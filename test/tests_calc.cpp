@@ -1,4 +1,5 @@
 #include <catch2/catch.hpp>
+#include <array>
 #include <fstream>
 #include <iostream>
 #include "time_measure.h"
@@ -31,3 +32,125 @@ TEST_CASE("precedence") {
 TEST_CASE("all together") {
     static_assert (expr.parse("4*2/2+(1-5)*2").second.get_value() == -4);
 }
+
+TEST_CASE("right associative") {
+    static_assert (expr.parse("2^3^2").second.get_value() == 512);
+    static_assert (expr.parse("2*2^3").second.get_value() == 16);
+}
+
+TEST_CASE("prefix") {
+    static_assert (expr.parse("-3*2").second.get_value() == -6);
+    static_assert (expr.parse("-2^2").second.get_value() == -4);
+    static_assert (expr.parse("8--2").second.get_value() == 10);
+    static_assert (expr.parse("--3").second.get_value() == 3);
+}
+
+TEST_CASE("postfix") {
+    static_assert (expr.parse("3!").second.get_value() == 6);
+    static_assert (expr.parse("2*3!").second.get_value() == 12);
+    static_assert (expr.parse("-3!").second.get_value() == -6);
+}
+
+TEST_CASE("partial") {
+    constexpr std::string_view str("1+2*");
+    constexpr auto res = expr.parse(str);
+    static_assert (res.second.get_value() == 3);
+    static_assert (res.first.position == str.end() - 1);
+}
+
+TEST_CASE("operator dispatch") {
+    using namespace anpa;
+    // Count the applications of each operator token
+    std::array<int, 3> applied{};
+    auto token = [&applied](std::size_t i, auto p) {
+        return [&applied, i, p](auto& s) {
+            ++applied[i];
+            return apply(p, s);
+        };
+    };
+    auto counted = operator_table(integer<int, options::no_negative>(),
+                                  infix<1>(first_of<'+'>(parser(token(0, item<'+'>()))), std::plus<>()),
+                                  infix<2>(first_of<'*'>(parser(token(1, item<'*'>()))), std::multiplies<>()),
+                                  postfix<3>(first_of<'!'>(parser(token(2, item<'!'>()))), [](int a) {
+                                      return factorial(a);
+                                  }));
+    REQUIRE(*counted.parse("1+2*3!").second == 13);
+
+    // Only the tokens that begin with the next item are tried
+    REQUIRE(applied == std::array<int, 3>{1, 1, 1});
+
+    // Without first sets, every token is tried
+    applied = {};
+    auto unannotated = operator_table(integer<int, options::no_negative>(),
+                                      infix<1>(parser(token(0, item<'+'>())), std::plus<>()),
+                                      infix<2>(parser(token(1, item<'*'>())), std::multiplies<>()));
+    REQUIRE(*unannotated.parse("1+2").second == 3);
+    REQUIRE(applied == std::array<int, 3>{2, 2, 0});
+}
+
+// Expression parser for the same language as `expr`, with one `chain` per precedence
+// level of the left associative operators, for comparison. The unary operators and the
+// right associative `^` are parsed by recursion.
+constexpr auto chain_op = [](auto c) {
+    return [c](auto a, auto b) {
+        switch (c) {
+        case '+': return a + b;
+        case '-': return a - b;
+        case '*': return a * b;
+        case '/': return a / b;
+        default: return 0; // This can never happen
+        }
+    };
+};
+constexpr auto add_op = anpa::lift(chain_op, anpa::item<'+'>() || anpa::item<'-'>());
+constexpr auto mul_op = anpa::lift(chain_op, anpa::item<'*'>() || anpa::item<'/'>());
+
+constexpr auto unary_chain = anpa::recursive<int>([](auto unary) {
+    using namespace anpa;
+    auto expr = chain(chain(unary, mul_op), add_op);
+    auto atom = integer<int, options::no_negative>() || (item<'('>() >> expr << item<')'>());
+    auto postfix = parser([atom](auto& s) {
+        auto res = apply(atom, s);
+        if (!res) return res;
+        auto value = *res;
+        while (apply(item<'!'>(), s)) value = factorial(value);
+        return s.return_success(value);
+    });
+    auto power = lift([](int a, std::optional<int> b) { return b ? const_pow(a, *b) : a; },
+                      postfix, succeed<options::optional>(item<'^'>() >> unary));
+    return lift(std::negate<>(), item<'-'>() >> unary) || power;
+});
+
+constexpr auto expr_chain = anpa::chain(anpa::chain(unary_chain, mul_op), add_op);
+
+TEST_CASE("chain equivalent") {
+    for (std::string_view input : {"8+2+2", "8-2-2", "8/2/2", "4*2/2+(1-5)*2", "2^3^2", "2*2^3", "-3*2",
+                                   "-2^2", "8--2", "--3", "3!", "2*3!", "-3!", "2^-1^2", "2^3!", "(1+2)!^2"}) {
+        INFO(input);
+        REQUIRE(*expr_chain.parse(input).second == *expr.parse(input).second);
+    }
+    static_assert(*expr_chain.parse("2^3^2").second == 512);
+}
+
+TEST_CASE("performance calc") {
+    std::string str;
+    for (int i = 0; i < 100000; ++i) {
+        str += "1+2*3-4/2+(5-3)*2^2-3!+-1-";
+    }
+    str += "1";
+
+    int result_table = 0;
+    int result_chain = 0;
+    {
+        TICK;
+        result_table = *expr.parse(str).second;
+        TOCK("calc operator_table");
+    }
+    {
+        TICK;
+        result_chain = *expr_chain.parse(str).second;
+        TOCK("calc chain");
+    }
+    REQUIRE(result_table == result_chain);
+    REQUIRE(result_table == 400001);
+}
@@ -1,6 +1,7 @@
 #include <stack>
 #include <iostream>
 #include <functional>
+#include <stdexcept>
 #include <string>
 #include <catch2/catch.hpp>
 #include "anpa/anpa.h"
@@ -219,7 +220,7 @@ TEST_CASE("many_to_vector") {
     REQUIRE(res.second->at(0) == 100);
     REQUIRE(res.second->at(1) == 20);
     REQUIRE(res.second->at(2) == 3);
-    REQUIRE(res.first.position == str.begin() + 9);
+    REQUIRE(to_iterator(str, res.first.position) == str.begin() + 9);
 }
 
 TEST_CASE("many_to_array") {
@@ -267,7 +268,7 @@ TEST_CASE("many_to_map") {
     REQUIRE(res.second->at(1) == 'a');
     REQUIRE(res.second->at(2) == 'b');
     REQUIRE(res.second->at(3) == 'c');
-    REQUIRE(res.first.position == str.begin() + 12);
+    REQUIRE(res.first.position == str.data() + 12);
 }
 
 TEST_CASE("many_mutate") {
@@ -364,6 +365,21 @@ TEST_CASE("lift_or") {
     constexpr auto res3 = p.parse("#aabbcc");
     static_assert(res3.second);
     static_assert(*res3.second == 3);
+
+    // Functors with a const call operator are not copied when the parser is applied
+    struct counting {
+        int* copies;
+        explicit counting(int* copies) : copies{copies} {}
+        counting(const counting& other) : copies{other.copies} { ++*copies; }
+        int operator()(int i) const { return i; }
+    };
+    int copies = 0;
+    auto counted = lift_or(counting(&copies), integer(), item<'x'>() >> mreturn<0>());
+    auto constructed = copies;
+    for (std::string_view input : {"1", "x", "2"}) {
+        REQUIRE(counted.parse(input).second);
+    }
+    REQUIRE(copies == constructed);
 }
 
 TEST_CASE("lift_or_state") {
@@ -428,6 +444,174 @@ TEST_CASE("lift_or_value") {
     static_assert(res2.second->i == 1234);
 }
 
+TEST_CASE("first_of") {
+    // Annotated parsers are only tried if the next item is in their set
+    constexpr auto p = first_of<'x'>(any_item()) || any_item() >> mreturn<'?'>();
+
+    static_assert(*p.parse("x").second == 'x');
+    static_assert(*p.parse("y").second == '?');
+    static_assert(!p.parse("").second);
+
+    constexpr auto alternatives = first_of<'a'>(item('a')) || first_of<'b', 'c'>(any_item());
+    constexpr auto first = internal::first_set_v<decltype(alternatives)>;
+    static_assert(first.contains('a') && first.contains('b') && first.contains('c'));
+    static_assert(!first.nullable && !first.contains('d'));
+    static_assert(internal::first_set_v<decltype(alternatives || any_item())>.any);
+}
+
+TEST_CASE("first set analysis") {
+    using internal::first_set_v;
+
+    constexpr auto keyword = seq<'i','f'>() >> mreturn<1>();
+    static_assert(first_set_v<decltype(keyword)>.contains('i'));
+    static_assert(!first_set_v<decltype(keyword)>.contains('e'));
+    static_assert(!first_set_v<decltype(keyword)>.nullable);
+
+    // Nullable parsers in sequence let the next parser decide
+    constexpr auto signed_number = succeed(any_of<'-','+'>()) >> integer<int, options::no_negative>();
+    static_assert(first_set_v<decltype(signed_number)>.contains('-'));
+    static_assert(first_set_v<decltype(signed_number)>.contains('7'));
+    static_assert(!first_set_v<decltype(signed_number)>.contains('a'));
+    static_assert(!first_set_v<decltype(signed_number)>.nullable);
+
+    static_assert(first_set_v<decltype(many(item<'a'>()))>.nullable);
+    static_assert(!first_set_v<decltype(many<options::fail_on_no_parse>(item<'a'>()))>.nullable);
+    static_assert(first_set_v<decltype(trim() >> item<'a'>())>.contains(' '));
+    static_assert(first_set_v<decltype(trim() >> item<'a'>())>.contains('a'));
+    static_assert(!first_set_v<decltype(trim() >> item<'a'>())>.contains('b'));
+    static_assert(first_set_v<decltype(floating<double>())>.contains('-'));
+    static_assert(!first_set_v<decltype(floating<double>())>.contains('.'));
+
+    // Opaque parsers may begin with anything
+    constexpr auto predicate = item_if([](auto c) { return c == 'a'; });
+    constexpr auto opaque = custom([](auto b, auto) { return std::pair(b, std::optional(0)); });
+    static_assert(first_set_v<decltype(predicate)>.any);
+    static_assert(first_set_v<decltype(opaque)>.is_unknown());
+
+    constexpr auto p = lift_or_value<int>(keyword,
+                                          seq<'e','l','s','e'>() >> mreturn<2>(),
+                                          integer(),
+                                          item<'a'>() >> item<'b'>() >> mreturn<3>());
+    static_assert(*p.parse("if").second == 1);
+    static_assert(*p.parse("else").second == 2);
+    static_assert(*p.parse("-12").second == -12);
+    static_assert(*p.parse("ab").second == 3);
+    static_assert(!p.parse("ac").second);
+    static_assert(!p.parse("x").second);
+    static_assert(!p.parse("").second);
+}
+
+TEST_CASE("dispatch") {
+    constexpr auto p = dispatch(first_of<'@'>(item('@') >> integer()),
+                                first_of<'#'>(item('#') >> integer() >>= [](int i) { return mreturn(-i); }),
+                                first_of<'0','1','2','3','4','5','6','7','8','9'>(integer()),
+                                rest() >> mreturn<0>());
+
+    static_assert(*p.parse("@12").second == 12);
+    static_assert(*p.parse("#12").second == -12);
+    static_assert(*p.parse("34").second == 34);
+    static_assert(*p.parse("abc").second == 0);
+    static_assert(*p.parse("").second == 0);
+
+    // The error of the last alternative tried is kept
+    constexpr auto p2 = dispatch(first_of<'a'>(item('a')), first_of<'b'>(item('b') >> item('c')));
+    constexpr auto res = p2.parse<parser_settings<true>>("bd");
+    static_assert(!res.second);
+    static_assert(res.first.position == res.first.end - 2);
+    static_assert(!p2.parse("c").second);
+}
+
+// Hide the type of a parser, so that it is not fused with others
+template <typename Parser>
+constexpr auto opaque(Parser p) {
+    return parser([=](auto& s) { return apply(p, s); });
+}
+
+template <typename Fused, typename Unfused, typename Input>
+constexpr bool same_parse(Fused fused, Unfused unfused, Input input) {
+    auto [s1, r1] = fused.template parse<parser_settings<true>>(input);
+    auto [s2, r2] = unfused.template parse<parser_settings<true>>(input);
+    return s1.position == s2.position && bool(r1) == bool(r2) && (!r1 || *r1 == *r2);
+}
+
+TEST_CASE("fusion") {
+    constexpr auto literals = item<'a'>() >> seq<'b','c'>() >> item<'d'>();
+    constexpr auto literals_unfused = opaque(item<'a'>()) >> opaque(seq<'b','c'>()) >> opaque(item<'d'>());
+    static_assert(std::is_same_v<std::decay_t<decltype(literals.p)>,
+                  internal::literal_parser<internal::literal_kind::item, options::none,
+                                           std::index_sequence<1, 2, 1>, 'a', 'b', 'c', 'd'>>);
+    static_assert(*literals.parse("abcd").second == 'd');
+    for (auto input : {"abcd", "abcx", "abx", "ax", "x", "", "abc"}) {
+        REQUIRE(same_parse(literals, literals_unfused, std::string_view(input)));
+    }
+    static_assert(same_parse(literals, literals_unfused, std::string_view("abcx")));
+
+    constexpr auto seqs = seq("if") >> seq("else");
+    constexpr auto seqs_unfused = opaque(seq("if")) >> opaque(seq("else"));
+    static_assert(std::is_same_v<std::decay_t<decltype(seqs.p)>, internal::sequence_parser<const char*, 2>>);
+    static_assert(*seqs.parse("ifelse").second == "else");
+    for (auto input : {"ifelse", "ifels", "ifx", "i", ""}) {
+        REQUIRE(same_parse(seqs, seqs_unfused, std::string_view(input)));
+    }
+
+    constexpr auto digits = many<options::fail_on_no_parse>(any_of<'0','1','2','3','4','5','6','7','8','9'>());
+    constexpr auto digits_unfused = many<options::fail_on_no_parse>(opaque(any_of<'0','1','2','3','4','5','6','7','8','9'>()));
+    static_assert(internal::first_set_v<decltype(digits)>.contains('5'));
+    static_assert(!internal::first_set_v<decltype(digits)>.contains('a'));
+    for (auto input : {"123a", "a", ""}) {
+        REQUIRE(same_parse(digits, digits_unfused, std::string_view(input)));
+        REQUIRE(same_parse(many(item<'a'>()), many(opaque(item<'a'>())), std::string_view(input)));
+    }
+
+    for (auto input : {"abc;d", "abc", ";", ""}) {
+        REQUIRE(same_parse(until(item<';'>()), until(opaque(item<';'>())), std::string_view(input)));
+        REQUIRE(same_parse(until<options::include>(seq<'c',';'>()), until<options::include>(opaque(seq<'c',';'>())),
+                           std::string_view(input)));
+    }
+}
+
+TEST_CASE("validate") {
+    constexpr auto p = item<'('>() >> many_to_vector(integer(), item<','>()) << item<')'>();
+    static_assert(validate(p, "(1,2,3)").second);
+    static_assert(!validate(p, "(1,2,3").second);
+    static_assert(validate(p, "(1,2,3)x").first.position == validate(p, "(1,2,3)x").first.end - 1);
+
+    constexpr auto alternatives = lift_or_value<int>(item<'a'>() >> mreturn<1>(), seq<'b','c'>() >> mreturn<2>());
+    for (auto input : {"a", "bc", "bd", "c", ""}) {
+        auto [s1, r1] = alternatives.parse(std::string_view(input));
+        auto [s2, r2] = validate(alternatives, std::string_view(input));
+        REQUIRE(bool(r1) == r2);
+        REQUIRE(s1.position == s2.position);
+    }
+
+    // Functors building results are not called by `validate`
+    int calls = 0;
+    auto counted = lift([&calls](auto c) { ++calls; return c; }, any_item());
+    REQUIRE(validate(counted >> counted >> item<'c'>(), "abc").second);
+    REQUIRE(calls == 0);
+    REQUIRE((counted >> counted).parse("ab").second);
+    REQUIRE(calls == 2);
+
+    // In a parse, they are called also where the result is dropped
+    calls = 0;
+    auto counted_or = lift_or([&calls](auto c) { ++calls; return c; }, item<'a'>(), item<'b'>());
+    REQUIRE(validate(counted_or >> counted_or, "ab").second);
+    REQUIRE(calls == 0);
+    REQUIRE((counted_or >> counted_or).parse("ab").second);
+    REQUIRE(calls == 2);
+    REQUIRE((counted_or << counted_or).parse("ab").second);
+    REQUIRE(calls == 4);
+    REQUIRE(many(counted_or).parse("abab").second);
+    REQUIRE(calls == 8);
+    REQUIRE((counted >> counted_or).parse<parser_settings<true>>("ab").second);
+    REQUIRE(calls == 10);
+
+    // Functors that are applied to the user state are called
+    auto stateful = lift_or_state([](int& n, auto c) { ++n; return c; }, item<'a'>());
+    REQUIRE((stateful >> stateful).parse_with_state("aa", calls).second);
+    REQUIRE(calls == 12);
+}
+
 TEST_CASE("parse_result") {
     constexpr auto between = between_items('{', '}');
     constexpr std::string_view str("{#100#20#3def}");
@@ -592,3 +776,136 @@ TEST_CASE("recursive") {
     static_assert(*res.second == 123);
     static_assert(res.first.position == str.end());
 }
+
+TEST_CASE("recursive max depth") {
+    using max_depth_3 = parser_settings<true, range_convert, 3>;
+    constexpr auto rec_parser = recursive<int>([](auto p) {
+        return integer() || (item<'{'>() >> p << item<'}'>());
+    });
+
+    constexpr auto res1 = rec_parser.parse<max_depth_3>("{{{123}}}");
+    static_assert(res1.second);
+    static_assert(*res1.second == 123);
+
+    constexpr auto res2 = rec_parser.parse<max_depth_3>("{{{{123}}}}");
+    static_assert(!res2.second);
+    static_assert(res2.second.error().message == std::string_view("Maximum recursion depth exceeded"));
+
+    // The depth is restored when a nested parser throws
+    constexpr auto throwing = custom([](auto begin, auto) -> std::pair<decltype(begin), std::optional<int>> {
+        throw std::runtime_error("x");
+    });
+    constexpr auto throwing_rec = recursive<int>([throwing](auto p) {
+        return (item<'{'>() >> p << item<'}'>()) || throwing;
+    });
+    auto depth_after_throw = [throwing_rec](auto& s) {
+        try {
+            apply(throwing_rec, s);
+        } catch (const std::runtime_error&) {}
+        return s.return_success(s.depth);
+    };
+    REQUIRE(*parser(depth_after_throw).parse("{{{").second == 0);
+    REQUIRE(*parser(depth_after_throw).parse<max_depth_3>("{{{").second == 0);
+}
+
+TEST_CASE("recursive heap stack") {
+    static constexpr auto rec_parser = recursive<int, options::heap_stack>([](auto p) {
+        return integer() || (item<'{'>() >> p << item<'}'>());
+    });
+
+    constexpr size_t depth = 100000;
+    std::string str = std::string(depth, '{') + "123" + std::string(depth, '}');
+    auto res = rec_parser.parse(str);
+    REQUIRE(res.second);
+    REQUIRE(*res.second == 123);
+    REQUIRE(to_iterator(str, res.first.position) == str.end());
+    REQUIRE(res.first.depth == 0);
+
+#if ANPA_HAS_HEAP_STACK && defined(__GLIBC__)
+    // Threads with small stacks switch to the heap before their stack is used up
+    struct job {
+        const std::string& input;
+        int result = 0;
+    } small_stack_job{str};
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+    pthread_t thread;
+    REQUIRE(pthread_create(&thread, &attr, [](void* arg) -> void* {
+        auto& j = *static_cast<job*>(arg);
+        if (auto res = rec_parser.parse(j.input).second) j.result = *res;
+        return nullptr;
+    }, &small_stack_job) == 0);
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+    REQUIRE(small_stack_job.result == 123);
+#endif
+}
+
+TEST_CASE("rule") {
+    rule<const char*, int> expr;
+    REQUIRE(!expr.parse("123").second);
+
+    // Recursive rules refer to themselves without `recursive`
+    expr = integer() || (item<'{'>() >> expr << item<'}'>());
+    auto res1 = expr.parse("{{{123}}}");
+    REQUIRE(res1.second);
+    REQUIRE(*res1.second == 123);
+    REQUIRE(!expr.parse("{{{123}}").second);
+    REQUIRE(validate(expr, std::string_view("{{123}}")).second);
+    REQUIRE(!validate(expr, std::string_view("{{123}")).second);
+
+    // Parsers that refer to a rule see its new definition
+    auto braced = item<'<'>() >> expr << item<'>'>();
+    expr = integer() || (item<'['>() >> expr << item<']'>());
+    auto res2 = braced.parse("<[[5]]>");
+    REQUIRE(res2.second);
+    REQUIRE(*res2.second == 5);
+
+    // Copies have their own definition, that refers to the original
+    rule<const char*, int> copy = expr;
+    expr = integer();
+    REQUIRE(*copy.parse("[7]").second == 7);
+    REQUIRE(!copy.parse("[[7]]").second);
+
+    // The result of the definition is converted to the result of the rule
+    rule<const char*, long> converted = integer() >> mreturn<3>();
+    REQUIRE(*converted.parse("1").second == 3);
+
+    // Definitions larger than the small buffer are stored on the heap
+    std::string long_text(100, 'x');
+    rule<const char*, std::size_t> large = lift([long_text](auto) {
+        return long_text.size();
+    }, seq<'a','b'>());
+    rule<const char*, std::size_t> large_copy = large;
+    REQUIRE(*large_copy.parse("ab").second == 100);
+}
+
+TEST_CASE("rule max depth") {
+    using max_depth_3 = parser_settings<true, range_convert, 3>;
+    rule<const char*, int, max_depth_3> expr;
+    expr = integer() || (item<'{'>() >> expr << item<'}'>());
+
+    auto res1 = expr.parse<max_depth_3>("{{123}}");
+    REQUIRE(res1.second);
+    REQUIRE(*res1.second == 123);
+
+    auto res2 = expr.parse<max_depth_3>("{{{123}}}");
+    REQUIRE(!res2.second);
+    REQUIRE(res2.second.error().message == std::string_view("Maximum recursion depth exceeded"));
+
+    // The depth is restored when the definition throws
+    expr = (item<'{'>() >> expr << item<'}'>()) || custom([](auto begin, auto) -> std::pair<decltype(begin), std::optional<int>> {
+        throw std::runtime_error("x");
+    });
+    auto depth_after_throw = [&expr](auto& s) {
+        try {
+            apply(expr, s);
+        } catch (const std::runtime_error&) {}
+        try {
+            recognize(expr, s);
+        } catch (const std::runtime_error&) {}
+        return s.return_success(s.depth);
+    };
+    REQUIRE(*parser(depth_after_throw).parse<max_depth_3>("{{").second == 0);
+}
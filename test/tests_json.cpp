@@ -1,6 +1,12 @@
 #include <fstream>
 #include <catch2/catch.hpp>
+#include "json/json_bind.h"
+#include "json/json_ondemand.h"
+#include "json/json_parallel.h"
 #include "json/json_parser.h"
+#include "json/json_sax.h"
+#include "json/json_tape.h"
+#include "memory_measure.h"
 #include "time_measure.h"
 
 template <typename T, typename Str>
@@ -13,6 +19,26 @@ auto test_json_type(Str&& s, T val) {
     REQUIRE(res.second->get<T>() == val);
 }
 
+TEST_CASE("json first sets") {
+    using internal::first_set_v;
+
+    // The first item of a value decides which alternative to parse
+    constexpr internal::first_set sets[] = {first_set_v<decltype(string_parser)>,
+                                            first_set_v<decltype(number_parser)>,
+                                            first_set_v<decltype(object_parser)>,
+                                            first_set_v<decltype(array_parser)>,
+                                            first_set_v<decltype(bool_parser)>,
+                                            first_set_v<decltype(null_parser)>};
+    static_assert(sets[0].contains('"') && sets[1].contains('-') && sets[1].contains('0') &&
+                  sets[2].contains('{') && sets[3].contains('[') && sets[4].contains('t') &&
+                  sets[4].contains('f') && sets[5].contains('n'));
+    for (size_t i = 0; i < std::size(sets); ++i) {
+        for (size_t j = i + 1; j < std::size(sets); ++j) {
+            REQUIRE(sets[i].disjoint(sets[j]));
+        }
+    }
+}
+
 TEST_CASE("json_number") {
     test_json_type<json_number>("-123.20", -123.20);
 }
@@ -29,6 +55,40 @@ TEST_CASE("json_bool") {
 TEST_CASE("json_string") {
     test_json_type<json_string>("\"abc\"", "abc");
     REQUIRE(!json_parser.parse("\"abc").second);
+
+    // Values of `json_parser` own their strings, which are copied with escapes left as is
+    std::string_view input(R"({"abc": "d\"e\u00e9\ud83d\ude00\n", "f\u0067": "\\"})");
+    auto owned = json_parser.parse(std::string(input)).second;
+    REQUIRE(owned);
+    REQUIRE((*owned)["abc"].get<json_string>() == R"(d\"e\u00e9\ud83d\ude00\n)");
+    REQUIRE((*owned)[R"(f\u0067)"].get<json_string>() == R"(\\)");
+
+    // Strings of `json_view_parser` refer to the input
+    auto res = string_view_parser.parse(input.substr(1));
+    REQUIRE(res.second);
+    REQUIRE(!res.second->is_escaped());
+    REQUIRE(res.second->raw().data() == input.data() + 2);
+
+    auto json = json_view_parser.parse(input);
+    REQUIRE(json.second);
+    auto abc = (*json.second)["abc"].get<json_string_view>();
+    REQUIRE(abc.is_escaped());
+    REQUIRE(abc.raw() == R"(d\"e\u00e9\ud83d\ude00\n)");
+    REQUIRE(abc == "d\"e\u00e9\U0001f600\n");
+    REQUIRE(abc != "d\"e\u00e9\U0001f600");
+    REQUIRE(abc.str() == "d\"e\u00e9\U0001f600\n");
+
+    // Escaped strings are decoded on demand, to a buffer or to storage of `max_size()`
+    std::string buffer;
+    REQUIRE(abc.get(buffer) == "d\"e\u00e9\U0001f600\n");
+    char storage[32];
+    REQUIRE(abc.max_size() <= sizeof(storage));
+    REQUIRE(std::string_view(storage, abc.decode(storage) - storage) == buffer);
+
+    // Object lookup decodes escaped keys
+    REQUIRE(json.second->contains("fg"));
+    REQUIRE((*json.second)["fg"].get<json_string_view>() == "\\");
+    REQUIRE(json_string_view(R"(f\u0067)", true) == json_string_view(R"(\u0066g)", true));
 }
 
 TEST_CASE("json_general") {
@@ -70,17 +130,652 @@ TEST_CASE("json_general") {
     std::cout << 3e0 << std::endl;
 }
 
+// Print the throughput of parsing `size` bytes in `ms` milliseconds
+static void print_throughput(const char* name, size_t size, double ms) {
+    std::cout << "Throughput for: " << name << " " << size / (ms * 1000.0) << " MB/s" << std::endl;
+}
+
 TEST_CASE("performance_json") {
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+
+    {
+        MEMORY_MEASURE_START;
+        TICK;
+        auto res1 = json_parser.parse(str1);
+        TOCK("json");
+        MEMORY_MEASURE_END("json");
+        print_throughput("json", str1.size(), fp_ms.count());
+        if (res1.second) {
+            std::cout << res1.second->size() << std::endl;
+        } else {
+            std::cout << "No parse canada.json" << std::endl;
+        }
+    }
+    {
+        MEMORY_MEASURE_START;
+        TICK;
+        json_tape tape;
+        bool success = parse_json_tape(str1, tape);
+        TOCK("json tape");
+        MEMORY_MEASURE_END("json tape");
+        print_throughput("json tape", str1.size(), fp_ms.count());
+        REQUIRE(success);
+        std::cout << tape.root().size() << std::endl;
+    }
+    {
+        struct counter : json_sax_handler {
+            size_t numbers = 0;
+            bool number(json_number) { ++numbers; return true; }
+        } handler;
+        MEMORY_MEASURE_START;
+        TICK;
+        bool success = parse_json_sax(str1, handler);
+        TOCK("json sax");
+        MEMORY_MEASURE_END("json sax");
+        print_throughput("json sax", str1.size(), fp_ms.count());
+        REQUIRE(success);
+        REQUIRE(memory_measure::peak() == _memory_start);
+        std::cout << handler.numbers << std::endl;
+    }
+}
+
+namespace {
+constexpr char pointer_a1[] = "/a/1";
+constexpr char pointer_b[] = "/a/4/b";
+constexpr char pointer_slash[] = "/e~1f~0";
+constexpr char pointer_slash_0[] = "/e~1f~0/0";
+constexpr char pointer_slash_unescaped_0[] = "/e~1f~/0";
+constexpr char pointer_missing[] = "/a/5";
+constexpr char pointer_root[] = "";
+
+constexpr char pointer_type[] = "/type";
+constexpr char pointer_geometry_type[] = "/features/0/geometry/type";
+constexpr char pointer_name[] = "/features/0/properties/name";
+}
+
+TEST_CASE("performance json strings") {
+    // Objects with two string members, where copying the strings dominates
+    std::string input = "[";
+    for (int i = 0; i < 200000; ++i) {
+        auto n = std::to_string(i);
+        input += (i ? ", " : "") + std::string(R"({"name": "user)") + n + R"(", "email": "user)" + n + R"(@example.com"})";
+    }
+    input += "]";
+
+    size_t owned_size = 0;
+    size_t view_size = 0;
+    {
+        TICK;
+        auto res = json_parser.parse(input);
+        TOCK("json strings, owned");
+        print_throughput("json strings, owned", input.size(), fp_ms.count());
+        owned_size = res.second->size();
+    }
+    {
+        TICK;
+        auto res = json_view_parser.parse(input);
+        TOCK("json strings, view");
+        print_throughput("json strings, view", input.size(), fp_ms.count());
+        view_size = res.second->size();
+        REQUIRE((*res.second)[199999]["email"].get<json_string_view>() == "user199999@example.com");
+    }
+    REQUIRE(owned_size == 200000);
+    REQUIRE(view_size == 200000);
+}
+
+TEST_CASE("json on demand") {
+    std::string_view input(R"( {"a": [1, 2.5, "x\"y", null, {"b": true}], "c": false, "d": {}, "e/f~": [[]]} )");
+    json_ondemand doc(input);
+    REQUIRE(doc.get_type() == json_ondemand::type::object);
+    REQUIRE(doc.size() == 4);
+    REQUIRE(doc["a"].size() == 5);
+    REQUIRE(doc["a"][0].get_number() == 1);
+    REQUIRE(doc["a"][1].get_number() == 2.5);
+    REQUIRE(doc["a"][2].get_string() == json_string_view("x\"y"));
+    REQUIRE(doc["a"][3].is_null());
+    REQUIRE(doc["a"][4]["b"].get_bool() == true);
+    REQUIRE(doc["c"].get_bool() == false);
+    REQUIRE(doc["d"].size() == 0);
+    REQUIRE(doc["e/f~"].raw() == "[[]]");
+    REQUIRE(doc["a"].raw() == R"([1, 2.5, "x\"y", null, {"b": true}])");
+
+    // Failed lookups give invalid values
+    REQUIRE(!doc["x"]);
+    REQUIRE(!doc["a"][5]);
+    REQUIRE(!doc["a"]["b"]);
+    REQUIRE(!doc["x"][0]["y"]);
+    REQUIRE(!doc["c"].get_number());
+    REQUIRE(!json_ondemand(std::string_view(" ")));
+
+    auto [a1, b, slash, missing, root] =
+        json_pointers<pointer_a1, pointer_b, pointer_slash, pointer_missing, pointer_root>::extract(input);
+    REQUIRE(a1.get_number() == 2.5);
+    REQUIRE(b.get_bool() == true);
+    REQUIRE(slash.raw() == "[[]]");
+    REQUIRE(!missing);
+    REQUIRE(root.size() == 4);
+
+    // Tokens of different lengths that refer to the same member
+    auto [slash_0, slash_unescaped_0] = json_pointers<pointer_slash_0, pointer_slash_unescaped_0>::extract(input);
+    REQUIRE(slash_0.raw() == "[]");
+    REQUIRE(slash_unescaped_0.raw() == "[]");
+
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+    {
+        TICK;
+        auto values = json_pointers<pointer_type, pointer_geometry_type, pointer_name>::extract(str1);
+        TOCK("json pointers");
+        REQUIRE(values[0].get_string() == json_string_view("FeatureCollection"));
+        REQUIRE(values[1].get_string() == json_string_view("Polygon"));
+        REQUIRE(values[2].get_string() == json_string_view("Canada"));
+    }
+    {
+        TICK;
+        auto res = json_parser.parse(str1);
+        auto& feature = (*res.second)["features"][0];
+        bool found = feature["geometry"]["type"].get<json_string>() == "Polygon" &&
+                     feature["properties"]["name"].get<json_string>() == "Canada";
+        TOCK("json pointers with DOM");
+        REQUIRE(found);
+    }
+    {
+        // Skips all of the coordinates
+        TICK;
+        auto size = json_ondemand(str1)["features"][0]["geometry"]["coordinates"].size();
+        TOCK("json on demand skip");
+        REQUIRE(size == 480);
+    }
+}
+
+namespace {
+struct address {
+    std::string city;
+    std::optional<int> zip;
+};
+
+struct person {
+    std::string name;
+    json_string_view nickname;
+    int age = 0;
+    bool active = false;
+    std::optional<double> score;
+    std::vector<int> ids;
+    std::vector<address> addresses;
+};
+
+struct canada_geometry {
+    json_string_view type;
+    std::vector<std::vector<std::vector<double>>> coordinates;
+};
+
+struct canada_properties {
+    json_string_view name;
+};
+
+struct canada_feature {
+    canada_properties properties;
+    canada_geometry geometry;
+};
+
+struct canada_collection {
+    json_string_view type;
+    std::vector<canada_feature> features;
+};
+}
+
+template <>
+struct json_fields<address> {
+    static constexpr auto fields = std::tuple(json_field{"city", &address::city}, json_field{"zip", &address::zip});
+};
+
+template <>
+struct json_fields<person> {
+    static constexpr auto fields = std::tuple(json_field{"name", &person::name},
+                                              json_field{"nickname", &person::nickname},
+                                              json_field{"age", &person::age},
+                                              json_field{"active", &person::active},
+                                              json_field{"score", &person::score},
+                                              json_field{"ids", &person::ids},
+                                              json_field{"addresses", &person::addresses});
+};
+
+template <>
+struct json_fields<canada_geometry> {
+    static constexpr auto fields = std::tuple(json_field{"type", &canada_geometry::type},
+                                              json_field{"coordinates", &canada_geometry::coordinates});
+};
+
+template <>
+struct json_fields<canada_properties> {
+    static constexpr auto fields = std::tuple(json_field{"name", &canada_properties::name});
+};
+
+template <>
+struct json_fields<canada_feature> {
+    static constexpr auto fields = std::tuple(json_field{"properties", &canada_feature::properties},
+                                              json_field{"geometry", &canada_feature::geometry});
+};
+
+template <>
+struct json_fields<canada_collection> {
+    static constexpr auto fields = std::tuple(json_field{"type", &canada_collection::type},
+                                              json_field{"features", &canada_collection::features});
+};
+
+TEST_CASE("json structural index") {
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+
+    structural_index index;
+    {
+        TICK;
+        index.build(str1.data(), str1.size());
+        TOCK("json structural index");
+        print_throughput("json structural index", str1.size(), fp_ms.count());
+    }
+    REQUIRE(index.size() > 0);
+
+    // Skipping the document visits the structural items only
+    std::string_view skipped;
+    {
+        TICK;
+        auto res = between_structural<'{', '}', options::include>().parse_with_state(str1, index);
+        TOCK("json skip with structural index");
+        REQUIRE(res.second);
+        skipped = *res.second;
+    }
+    {
+        TICK;
+        auto res = json_skip_parser.parse(str1);
+        TOCK("json skip");
+        REQUIRE(res.second);
+        REQUIRE(std::string_view(*res.second) == skipped);
+    }
+}
+
+TEST_CASE("json parallel array") {
+    REQUIRE(split_json_array(" [ ] ", 4)->empty());
+    REQUIRE(split_json_array("[1]", 4)->size() == 1);
+    REQUIRE(*split_json_array(R"([1, "a,]", [2, 3], {"b": [4]}])", 4) ==
+            std::vector<std::string_view>{"1", R"( "a,]")", " [2, 3]", R"( {"b": [4]})"});
+    REQUIRE(!split_json_array("{}", 4));
+    REQUIRE(!parse_json_array_parallel("[1, 2,]", 4));
+    REQUIRE(!parse_json_array_parallel("[1, 2] 3", 4));
+
+    // Records with long strings, one per line and all on one line
+    std::string record = R"({"id": 1, "text": ")" + std::string(2000, 'x') + R"(\", [", "values": [1.5, null, true]})";
+    std::string lines = "[";
+    for (int i = 0; i < 2000; ++i) lines += (i ? ",\n" : "\n") + record;
+    lines += "\n]";
+    std::string minified = lines;
+    minified.erase(std::remove(minified.begin(), minified.end(), '\n'), minified.end());
+
+    REQUIRE(split_json_array(lines, 4)->size() == 2000);
+    // A part of the minified array begins in a string, which is detected
+    REQUIRE(!split_json_array(minified, 3));
+
+    for (auto& input : {lines, minified}) {
+        auto res = parse_json_array_parallel(input, 3);
+        REQUIRE(res);
+        REQUIRE(res->size() == 2000);
+        REQUIRE(res->back()["values"].size() == 3);
+        REQUIRE(res->back()["text"].get<json_string>() == std::string(2000, 'x') + "\\\", [");
+    }
+
+    std::string large = "[";
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+    for (int i = 0; i < 8; ++i) large += (i ? ",\n" : "") + str1;
+    large += "]";
+    {
+        TICK;
+        auto res = parse_json_array_parallel(large, 1);
+        TOCK("json parallel array, 1 thread");
+        REQUIRE(res->size() == 8);
+    }
+    {
+        auto threads = std::max(4u, std::thread::hardware_concurrency());
+        TICK;
+        auto res = parse_json_array_parallel(large, threads);
+        TOCK("json parallel array, " << threads << " threads");
+        REQUIRE(res->size() == 8);
+    }
+}
+
+TEST_CASE("json bind") {
+    std::string_view input(R"( {"name": "A\u00e9", "age": 42, "unknown": {"x": [1, {}]}, "nickname": "a",
+                                 "score": null, "ids": [1, 2, 3], "active": true, "n\u0061me": "B",
+                                 "addresses": [{"city": "C", "zip": 123}, {"city": "D"}]} )");
+    auto res = json_bind<person>.parse(input);
+    REQUIRE(res.second);
+    auto& p = *res.second;
+    REQUIRE(p.name == "B");
+    REQUIRE(p.nickname == "a");
+    REQUIRE(p.age == 42);
+    REQUIRE(p.active);
+    REQUIRE(!p.score);
+    REQUIRE(p.ids == std::vector{1, 2, 3});
+    REQUIRE(p.addresses.size() == 2);
+    REQUIRE(p.addresses[0].city == "C");
+    REQUIRE(p.addresses[0].zip == 123);
+    REQUIRE(p.addresses[1].city == "D");
+    REQUIRE(!p.addresses[1].zip);
+
+    REQUIRE(json_bind<person>.parse(std::string_view(R"({"score": 2.5, "ids": []})")).second->score == 2.5);
+    REQUIRE(!json_bind<person>.parse(std::string_view(R"({"age": "42"})")).second);
+    REQUIRE(!json_bind<person>.parse(std::string_view(R"({"unknown": [1,]})")).second);
+    REQUIRE(!json_bind<person>.parse(std::string_view(R"({"ids": [1, 2,]})")).second);
+    REQUIRE(json_bind<std::vector<std::optional<int>>>.parse(std::string_view("[1, null]")).second->size() == 2);
+
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+    {
+        TICK;
+        auto res1 = json_bind<canada_collection>.parse(str1);
+        TOCK("json bind");
+        REQUIRE(res1.second);
+        REQUIRE(res1.second->type == "FeatureCollection");
+        REQUIRE(res1.second->features.size() == 1);
+        REQUIRE(res1.second->features[0].properties.name == "Canada");
+        REQUIRE(res1.second->features[0].geometry.coordinates.size() == 480);
+    }
+    {
+        TICK;
+        auto res1 = json_parser.parse(str1);
+        TOCK("json bind with DOM");
+        REQUIRE(res1.second);
+    }
+}
+
+namespace {
+
+// Records the events of a SAX parse, and stops after `limit` events
+struct recording_handler {
+    std::string events;
+    size_t limit = size_t(-1);
+
+    bool add(std::string_view event) {
+        events += event;
+        return --limit != 0;
+    }
+
+    bool start_object() { return add("{"); }
+    bool key(const json_string_view& s) { return add("k:" + s.str() + " "); }
+    bool end_object() { return add("}"); }
+    bool start_array() { return add("["); }
+    bool end_array() { return add("]"); }
+    bool string(const json_string_view& s) { return add("s:" + s.str() + " "); }
+    bool number(json_number d) { return add("d:" + std::to_string(int(d)) + " "); }
+    bool boolean(json_bool b) { return add(b ? "true " : "false "); }
+    bool null() { return add("null "); }
+};
+
+}
+
+TEST_CASE("json sax") {
+    std::string_view input(R"( {"a": [1, 2, "x\ny", null, {"b": true}], "c": false, "d": {}} )");
+    recording_handler handler;
+    REQUIRE(parse_json_sax(input, handler));
+    REQUIRE(handler.events == "{k:a [d:1 d:2 s:x\ny null {k:b true }]k:c false k:d {}}");
+
+    // The handler stops the parse
+    recording_handler stopping;
+    stopping.limit = 4;
+    REQUIRE(!parse_json_sax(input, stopping));
+    REQUIRE(stopping.events == "{k:a [d:1 ");
+
+    recording_handler invalid;
+    REQUIRE(!parse_json_sax(std::string_view("[1, 2,]"), invalid));
+
+    // Only the events of interest need to be handled
+    json_sax_handler ignoring;
+    REQUIRE(parse_json_sax(input, ignoring));
+}
+
+TEST_CASE("json tape") {
+    json_tape tape;
+    REQUIRE(parse_json_tape(std::string_view(R"( {"a": [1, 2.5, "x\"y", null, {"b": true}], "c": false, "d": {}} )"), tape));
+    auto root = tape.root();
+    REQUIRE(root.type() == json_tape::type::object);
+    REQUIRE(root.size() == 3);
+
+    auto a = root.find_field("a");
+    REQUIRE(a);
+    REQUIRE(a.is_array());
+    REQUIRE(a.size() == 5);
+    std::vector<json_tape::type> types;
+    for (auto e : a) types.push_back(e.type());
+    REQUIRE(types == std::vector{json_tape::type::number, json_tape::type::number, json_tape::type::string,
+                                 json_tape::type::null, json_tape::type::object});
+    REQUIRE((*a.begin()).get_number() == 1);
+    REQUIRE((*++a.begin()).get_number() == 2.5);
+    REQUIRE((*++++a.begin()).get_string() == "x\"y");
+    REQUIRE((*++++a.begin()).get_string().raw() == R"(x\"y)");
+
+    auto b = (*++++++++a.begin()).find_field("b");
+    REQUIRE(b.type() == json_tape::type::boolean);
+    REQUIRE(b.get_bool());
+    REQUIRE(!root.find_field("c").get_bool());
+    REQUIRE(root.find_field("d").size() == 0);
+    REQUIRE(!root.find_field("e"));
+    REQUIRE(!root.find_field("b"));
+
+    REQUIRE(!parse_json_tape(std::string_view("[1, 2,]"), tape));
+    REQUIRE(parse_json_tape(std::string_view("[[], [[]], \"\"]"), tape));
+    REQUIRE(tape.root().size() == 3);
+
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+    REQUIRE(parse_json_tape(str1, tape));
+    auto features = tape.root().find_field("features");
+    REQUIRE(features.size() == 1);
+    auto coordinates = (*features.begin()).find_field("geometry").find_field("coordinates");
+    REQUIRE(coordinates.size() == 480);
+}
+
+TEST_CASE("json validate") {
+    REQUIRE(validate(json_parser, std::string_view("{\"a\": [1, 2.5, \"x\", null, {\"b\": true}]}")).second);
+    REQUIRE(!validate(json_parser, std::string_view("{\"a\": [1, 2.5,]}")).second);
+    REQUIRE(!validate(json_parser, std::string_view("[\"abc]")).second);
+
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+
+    TICK;
+    auto res1 = validate(json_parser, str1);
+    TOCK("json validate");
+    REQUIRE(res1.second);
+    REQUIRE(res1.first.position == json_parser.parse(str1).first.position);
+}
+
+TEST_CASE("json padded input") {
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+    padded_string padded(str1);
+
+    bool valid = false;
+    bool valid_padded = false;
+    {
+        TICK;
+        valid = validate(json_parser, str1).second;
+        TOCK("json validate");
+    }
+    {
+        TICK;
+        valid_padded = validate<padded_parser_settings>(json_parser, padded).second;
+        TOCK("json validate padded");
+    }
+    REQUIRE(valid);
+    REQUIRE(valid_padded);
+
+    auto res = json_parser.parse<padded_parser_settings>(padded);
+    REQUIRE(res.second);
+    REQUIRE(res.second->size() == 2);
+    REQUIRE(!json_parser.parse<padded_parser_settings>(padded_string("[tru")).second);
+    REQUIRE(!json_parser.parse<padded_parser_settings>(padded_string("[true")).second);
+    REQUIRE(json_parser.parse<padded_parser_settings>(padded_string("[true]")).second);
+}
+
+namespace {
+constexpr char json_grammar[] = R"(
+    value   <- ws (object / array / string / number / "true" / "false" / "null") ws
+    object  <- '{' ws (member (',' member)*)? '}'
+    member  <- ws string ws ':' value
+    array   <- '[' ws (value (',' value)*)? ']'
+    string  <- '"' ([^"\\] / '\\' (["\\/bfnrt] / 'u' hex hex hex hex))* '"'
+    hex     <- [0-9a-fA-F]
+    number  <- '-'? ('0' / [1-9] [0-9]*) ('.' [0-9]+)? ([eE] [+-]? [0-9]+)?
+    ws      <- [ \t\n\r]*
+)";
+}
+
+TEST_CASE("json grammar") {
+    constexpr auto p = grammar<json_grammar>();
+    REQUIRE(validate(p, std::string_view("{\"a\": [1, 2.5, \"x\\u00e9\", null, {\"b\": true}]}")).second);
+    REQUIRE(!validate(p, std::string_view("{\"a\": [1, 2.5,]}")).second);
+    REQUIRE(!validate(p, std::string_view("[\"abc]")).second);
+
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+
+    TICK;
+    auto res1 = validate(p, str1);
+    TOCK("json grammar validate");
+    REQUIRE(res1.second);
+
+    // The grammar also consumes the trailing whitespace
+    REQUIRE(to_iterator(str1, res1.first.position) == str1.end());
+}
+
+TEST_CASE("json runtime grammar") {
+    runtime_grammar g(json_grammar, {"number"});
+    REQUIRE(g.valid());
+
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+
+    size_t numbers = 0;
+    auto p = g.parser([&numbers](std::string_view, const auto&) { ++numbers; });
+    TICK;
+    auto res1 = p.parse(str1);
+    TOCK("json runtime grammar");
+    REQUIRE(res1.second);
+    REQUIRE(to_iterator(str1, res1.first.position) == str1.end());
+    REQUIRE(numbers == 111126);
+
+    // Later parses reuse the stacks of the virtual machine
+    numbers = 0;
+    MEMORY_MEASURE_START;
+    auto res2 = p.parse(str1);
+    MEMORY_MEASURE_END("json runtime grammar");
+    REQUIRE(res2.second);
+    REQUIRE(numbers == 111126);
+    REQUIRE(memory_measure::peak() == _memory_start);
+}
+
+TEST_CASE("json rule") {
+    rule<const char*, json_value> value;
+    value = json_value_grammar(value.ref());
+
+    std::ifstream t1("canada.json");
+    std::string str1((std::istreambuf_iterator<char>(t1)),
+                     std::istreambuf_iterator<char>());
+    std::string_view view(str1);
+
+    TICK;
+    auto res1 = value.parse(view);
+    TOCK("json rule");
+    REQUIRE(res1.second);
+    REQUIRE(res1.second->size() == json_parser.parse(view).second->size());
+}
+
+// Normally declared in a header and defined in a single source file
+ANPA_DECLARE_PARSER(json_declared, const char*, json_value)
+ANPA_DEFINE_PARSER(json_declared, json_parser)
+
+TEST_CASE("json declared parser") {
+    REQUIRE(validate(json_declared, std::string_view("{\"a\": [1, 2.5, \"x\", null, {\"b\": true}]}")).second);
+    REQUIRE(!validate(json_declared, std::string_view("{\"a\": [1, 2.5,]}")).second);
+
+    // Declared parsers combine with other parsers
+    auto res1 = many_to_vector(json_declared, eat(item<';'>())).parse(std::string("1; [2]; \"3\""));
+    REQUIRE(res1.second);
+    REQUIRE(res1.second->size() == 3);
+    REQUIRE((*res1.second)[2].get<json_string>() == "3");
+
     std::ifstream t1("canada.json");
     std::string str1((std::istreambuf_iterator<char>(t1)),
                      std::istreambuf_iterator<char>());
 
     TICK;
-    auto res1 = json_parser.parse(str1);
-    TOCK("json");
-    if (res1.second) {
-        std::cout << res1.second->size() << std::endl;
-    } else {
-        std::cout << "No parse canada.json" << std::endl;
+    auto res2 = json_declared.parse(str1);
+    TOCK("json declared parser");
+    REQUIRE(res2.second);
+    REQUIRE(res2.second->size() == 2);
+}
+
+constexpr auto json_parser_heap_stack = recursive<json_value, options::heap_stack>(json_value_grammar);
+
+TEST_CASE("json max depth") {
+    using max_depth_512 = parser_settings<false, range_convert, 512>;
+    std::string deep = std::string(100000, '[') + std::string(100000, ']');
+    REQUIRE(!json_parser.parse<max_depth_512>(deep).second);
+
+    std::string shallow = std::string(512, '[') + std::string(512, ']');
+    REQUIRE(json_parser.parse<max_depth_512>(shallow).second);
+}
+
+TEST_CASE("json heap stack") {
+    // A deep document is parsed on the heap, and destroyed without recursion
+    std::string deep = std::string(100000, '[') + std::string(100000, ']');
+    {
+        auto res1 = json_parser_heap_stack.parse(deep);
+        REQUIRE(res1.second);
+        REQUIRE(to_iterator(deep, res1.first.position) == deep.end());
+    }
+
+    std::string deep_objects;
+    for (int i = 0; i < 100000; ++i) deep_objects += "{\"a\":[";
+    for (int i = 0; i < 100000; ++i) deep_objects += "]}";
+    {
+        auto res1 = json_parser_heap_stack.parse(deep_objects);
+        REQUIRE(res1.second);
+        REQUIRE(res1.second->size() == 1);
     }
+
+    std::string nested = std::string(10000, '[') + "1" + std::string(10000, ']');
+    auto res2 = json_parser_heap_stack.parse(nested);
+    REQUIRE(res2.second);
+    REQUIRE(to_iterator(nested, res2.first.position) == nested.end());
+}
+
+TEST_CASE("json stack usage") {
+    // Positions of the stack at each nesting level, for measuring the stack usage per level
+    static std::vector<std::uintptr_t> stack_positions;
+    constexpr auto probe = custom([](auto begin, auto) {
+        char marker;
+        stack_positions.push_back(reinterpret_cast<std::uintptr_t>(&marker));
+        return std::pair(begin, std::optional<empty_result>(empty_result()));
+    });
+    constexpr auto probed_parser = recursive<json_value>([](auto p) {
+        return json_value_grammar(probe >> p);
+    });
+
+    std::string nested = std::string(100, '[') + std::string(100, ']');
+    REQUIRE(probed_parser.parse(nested).second);
+    REQUIRE(stack_positions.size() > 2);
+    std::cout << "Stack usage per nesting level (JSON): "
+              << stack_positions[1] - stack_positions[2] << " bytes" << std::endl;
 }
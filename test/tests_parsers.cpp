@@ -1,6 +1,19 @@
+#include <algorithm>
+#include <list>
+#include <numeric>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 #include <catch2/catch.hpp>
 #include "anpa/parsers.h"
+#include "anpa/grammar.h"
+#include "anpa/runtime_grammar.h"
+#include "anpa/padded_string.h"
+#include "anpa/structural_index.h"
+#include "anpa/parallel.h"
+#include "anpa/pipeline.h"
 
 using namespace anpa;
 
@@ -248,6 +261,21 @@ TEST_CASE("while_if") {
     static_assert(resNoMatch.first.position == strNoMatch.begin());
 }
 
+TEST_CASE("while_if_not") {
+    auto pred = [](auto& x) {
+        return x == 'c';
+    };
+
+    constexpr std::string_view str("aabbcc");
+    constexpr auto res = while_if_not(pred).parse(str);
+    static_assert(res.second);
+    static_assert(*res.second == "aabb");
+    static_assert(res.first.position == str.begin() + 4);
+
+    constexpr auto resNoParse = while_if_not<options::fail_on_no_parse>(pred).parse(str.substr(4));
+    static_assert(!resNoParse.second);
+}
+
 TEST_CASE("while_in") {
     constexpr std::string_view str("aabbcc");
     constexpr auto res = while_in("abc").parse(str);
@@ -261,6 +289,218 @@ TEST_CASE("while_in") {
     static_assert(resNoMatch.first.position == str.begin());
 }
 
+namespace {
+constexpr char identifier_pattern[] = "[A-Za-z_][A-Za-z0-9_]*";
+constexpr char number_pattern[] = "-?(?:0|[1-9]\\d*)(?:\\.\\d+)?(?:[eE][+-]?\\d+)?";
+constexpr char keyword_pattern[] = "if|else|elif";
+constexpr char date_pattern[] = "\\d{4}-\\d{2}-\\d{2}";
+constexpr char repeat_pattern[] = "(?:ab){1,2}c{2,}";
+constexpr char empty_pattern[] = "a*";
+constexpr char dot_pattern[] = "[^\\s]+.";
+}
+
+TEST_CASE("regex") {
+    constexpr std::string_view str("foo_12 bar");
+    constexpr auto res = regex<identifier_pattern>().parse(str);
+    static_assert(res.second);
+    static_assert(*res.second == "foo_12");
+    static_assert(res.first.position == str.begin() + 6);
+
+    constexpr std::string_view strFail(" foo");
+    constexpr auto resFail = regex<identifier_pattern>().parse(strFail);
+    static_assert(!resFail.second);
+    static_assert(resFail.first.position == strFail.begin());
+
+    // Longest match, not the first accepting state
+    static_assert(*regex<number_pattern>().parse("-12.5e+3,").second == "-12.5e+3");
+    static_assert(*regex<number_pattern>().parse("12.x").second == "12");
+    static_assert(*regex<number_pattern>().parse("0123").second == "0");
+    static_assert(!regex<number_pattern>().parse("-x").second);
+    static_assert(*regex<keyword_pattern>().parse("elif").second == "elif");
+    static_assert(*regex<keyword_pattern>().parse("elsewhere").second == "else");
+
+    static_assert(*regex<date_pattern>().parse("2020-01-31T").second == "2020-01-31");
+    static_assert(!regex<date_pattern>().parse("202-01-31").second);
+    static_assert(*regex<repeat_pattern>().parse("ababccc").second == "ababccc");
+    static_assert(!regex<repeat_pattern>().parse("abc").second);
+    static_assert(*regex<dot_pattern>().parse("ab\n").second == "ab");
+    static_assert(!regex<dot_pattern>().parse("a\n").second);
+
+    // Nullable patterns succeed without consuming
+    constexpr auto resEmpty = regex<empty_pattern>().parse("b");
+    static_assert(resEmpty.second);
+    static_assert(*resEmpty.second == "");
+
+    static_assert(validate(regex<identifier_pattern>(), "abc").second);
+    static_assert(internal::first_set_v<decltype(regex<identifier_pattern>())>.contains('_'));
+    static_assert(!internal::first_set_v<decltype(regex<identifier_pattern>())>.contains('1'));
+    static_assert(internal::first_set_v<decltype(regex<empty_pattern>())>.nullable);
+
+    static_assert(!internal::regex::is_valid("a("));
+    static_assert(!internal::regex::is_valid("[a"));
+    static_assert(!internal::regex::is_valid("*a"));
+    static_assert(!internal::regex::is_valid("a{2,1}"));
+}
+
+namespace {
+constexpr char list_grammar[] = R"(
+    # A list of numbers
+    list    <- '[' (number (',' number)*)? ']'
+    number  <- '-'? [0-9]+
+)";
+constexpr char number_rule[] = "number";
+
+constexpr char predicate_grammar[] = R"(
+    keyword <- ("if" / "else") !ident_char
+    ident   <- !keyword ident_char+
+    ident_char <- [a-zA-Z_]
+    comment <- "/*" (!"*/" .)* "*/"
+    lookahead <- &'a' [a-z]+
+)";
+constexpr char ident_rule[] = "ident";
+constexpr char comment_rule[] = "comment";
+constexpr char lookahead_rule[] = "lookahead";
+
+constexpr char nested_grammar[] = R"(
+    parens <- '(' parens ')' / ''
+)";
+}
+
+TEST_CASE("grammar") {
+    constexpr std::string_view str("[1,-23,4]x");
+    constexpr auto res = grammar<list_grammar>().parse(str);
+    static_assert(res.second);
+    static_assert(*res.second == "[1,-23,4]");
+    static_assert(res.first.position == str.begin() + 9);
+
+    // A failed sequence restores the position
+    constexpr std::string_view strFail("[1,]");
+    constexpr auto resFail = grammar<list_grammar>().parse(strFail);
+    static_assert(!resFail.second);
+    static_assert(resFail.first.position == strFail.begin());
+
+    static_assert(*grammar<list_grammar, number_rule>().parse("-12,").second == "-12");
+    static_assert(*grammar<predicate_grammar, ident_rule>().parse("iffy").second == "iffy");
+    static_assert(!grammar<predicate_grammar, ident_rule>().parse("if").second);
+    static_assert(*grammar<predicate_grammar, comment_rule>().parse("/* a * b */c").second == "/* a * b */");
+    static_assert(*grammar<predicate_grammar, lookahead_rule>().parse("abc1").second == "abc");
+    static_assert(!grammar<predicate_grammar, lookahead_rule>().parse("bc").second);
+    static_assert(*grammar<nested_grammar>().parse("((()))(").second == "((()))");
+    static_assert(validate(grammar<list_grammar>(), "[]").second);
+
+    // First sets are derived from the rules
+    static_assert(internal::first_set_v<decltype(grammar<list_grammar, number_rule>())>.contains('-'));
+    static_assert(!internal::first_set_v<decltype(grammar<list_grammar, number_rule>())>.contains('a'));
+
+    std::vector<int> numbers;
+    auto p = grammar<list_grammar>(rule_action<number_rule>([&](auto r) {
+        numbers.push_back(*integer().parse(r.begin(), r.end()).second);
+    }));
+    REQUIRE(p.parse(str).second);
+    REQUIRE(numbers == std::vector{1, -23, 4});
+
+    // Actions are also called for matches that are undone later on
+    numbers.clear();
+    REQUIRE(!p.parse(strFail).second);
+    REQUIRE(numbers == std::vector{1});
+
+    // The depth is restored when an action throws
+    auto throwing = grammar<list_grammar>(rule_action<number_rule>([](auto) {
+        throw std::runtime_error("x");
+    }));
+    auto depth_after_throw = [throwing](auto& s) {
+        try {
+            apply(throwing, s);
+        } catch (const std::runtime_error&) {}
+        try {
+            recognize(throwing, s);
+        } catch (const std::runtime_error&) {}
+        return s.return_success(s.depth);
+    };
+    REQUIRE(*parser(depth_after_throw).parse(str).second == 0);
+}
+
+TEST_CASE("runtime grammar") {
+    std::string text(list_grammar);
+    runtime_grammar g(text, {"number", "list"});
+    REQUIRE(g.valid());
+
+    std::vector<std::pair<std::string_view, std::string_view>> captures;
+    auto p = g.parser([&](std::string_view rule, auto r) {
+        captures.emplace_back(rule, std::string_view(&*r.begin(), r.end() - r.begin()));
+    });
+
+    std::string_view str("[1,-23,4]x");
+    auto res = p.parse(str);
+    REQUIRE(res.second);
+    REQUIRE(*res.second == "[1,-23,4]");
+    REQUIRE(res.first.position == str.begin() + 9);
+    using capture = std::pair<std::string_view, std::string_view>;
+    REQUIRE(captures == std::vector<capture>{{"number", "1"}, {"number", "-23"}, {"number", "4"}, {"list", "[1,-23,4]"}});
+
+    // Captures that are undone by backtracking are not reported
+    captures.clear();
+    std::string_view strFail("[1,]");
+    auto resFail = p.parse(strFail);
+    REQUIRE(!resFail.second);
+    REQUIRE(captures.empty());
+
+    // Parses in the callback have their own stacks
+    runtime_grammar digits("d <- [0-9]+", {"d"});
+    std::vector<std::string_view> nested;
+    auto nesting = g.parser([&](std::string_view rule, auto r) {
+        if (rule != "number") return;
+        digits.parser([&](std::string_view, auto d) {
+            nested.emplace_back(&*d.begin(), d.end() - d.begin());
+        }).parse(r.begin(), r.end());
+    });
+    REQUIRE(nesting.parse(str).second);
+    REQUIRE(nested == std::vector<std::string_view>{"1", "4"});
+
+    runtime_grammar predicates(predicate_grammar, {}, "comment");
+    REQUIRE(*predicates.parser().parse(std::string_view("/* a * b */c")).second == "/* a * b */");
+    REQUIRE(*runtime_grammar(predicate_grammar, {}, "ident").parser().parse(std::string_view("iffy")).second == "iffy");
+    REQUIRE(!runtime_grammar(predicate_grammar, {}, "ident").parser().parse(std::string_view("if")).second);
+    REQUIRE(*runtime_grammar(predicate_grammar, {}, "lookahead").parser().parse(std::string_view("abc1")).second == "abc");
+    REQUIRE(*runtime_grammar(nested_grammar).parser().parse(std::string_view("((()))(")).second == "((()))");
+
+    // Choices of literals are matched in order
+    REQUIRE(*runtime_grammar("k <- 'a' / 'ab' / 'abc'").parser().parse(std::string_view("abc")).second == "a");
+    REQUIRE(*runtime_grammar("k <- 'abc' / 'ab'").parser().parse(std::string_view("abd")).second == "ab");
+    runtime_grammar accented("k <- 'é' / 'ü' / 'üb'");
+    REQUIRE(*accented.parser().parse(std::string_view("é")).second == "é");
+    REQUIRE(*accented.parser().parse(std::string_view("üb")).second == "ü");
+    REQUIRE(!accented.parser().parse(std::string_view("e")).second);
+
+    // Alternatives that begin with different items are selected with a table
+    runtime_grammar dispatched("k <- 'x' [0-9] / 'y' / [a-c]+ / 'dd'");
+    REQUIRE(*dispatched.parser().parse(std::string_view("x1")).second == "x1");
+    REQUIRE(*dispatched.parser().parse(std::string_view("abcd")).second == "abc");
+    REQUIRE(!dispatched.parser().parse(std::string_view("xy")).second);
+    REQUIRE(!dispatched.parser().parse(std::string_view("z")).second);
+
+    REQUIRE(!runtime_grammar("a <- b").valid());
+    REQUIRE(!runtime_grammar("a <- 'x").valid());
+    REQUIRE(!runtime_grammar("a <- 'x'", {"b"}).valid());
+    REQUIRE(!runtime_grammar("a <- 'x'").parser().parse(std::string_view("y")).second);
+    REQUIRE(!runtime_grammar("a <- b").parser().parse(std::string_view("y")).second);
+    REQUIRE(runtime_grammar("a <- 'x'").error().empty());
+    REQUIRE(runtime_grammar("a <- b").error() == "Invalid grammar");
+    REQUIRE(runtime_grammar("a <- 'x'", {}, "b").error() == "Unknown start rule");
+    REQUIRE(runtime_grammar("a <- 'x'", {"b"}).error() == "Unknown captured rule");
+
+    // Grammars that could loop forever are rejected
+    std::string_view empty_repetition("Repetition of an expression that may match the empty string");
+    REQUIRE(runtime_grammar("x <- ('a'?)*").error() == empty_repetition);
+    REQUIRE(runtime_grammar("x <- ('a'* 'b'?)+").error() == empty_repetition);
+    REQUIRE(runtime_grammar("x <- (!'a')*").error() == empty_repetition);
+    REQUIRE(runtime_grammar("x <- y* \n y <- 'a' / &'b'").error() == empty_repetition);
+    REQUIRE(runtime_grammar("x <- x 'a' / 'b'").error() == "Left recursive rule");
+    REQUIRE(runtime_grammar("x <- 'c'? y \n y <- !'a' x").error() == "Left recursive rule");
+    REQUIRE(!runtime_grammar("x <- ('a'?)*").parser().parse(std::string_view("b")).second);
+    REQUIRE(runtime_grammar("x <- ('a'? 'b')* \n y <- 'a' y / 'b'").valid());
+}
+
 TEST_CASE("between_sequences") {
     constexpr std::string_view str("beginabcdeend");
     constexpr auto res = between_sequences("begin", "end").parse(str);
@@ -380,3 +620,295 @@ TEST_CASE("floating") {
     floating_test_("123.321e-3", 123.321e-3);
     floating_test_("-123.321e-3", -123.321e-3);
 }
+
+TEST_CASE("contiguous input") {
+    // Contiguous sequences are parsed through pointers
+    std::string str("abc,def");
+    auto res1 = until_item<','>().parse(str);
+    static_assert(std::is_same_v<decltype(res1.first.position), const char*>);
+    REQUIRE(res1.second);
+    REQUIRE(*res1.second == "abc");
+    REQUIRE(to_iterator(str, res1.first.position) == str.begin() + 4);
+
+    std::vector<char> vec(str.begin(), str.end());
+    auto res2 = until_seq(",d").parse(vec);
+    static_assert(std::is_same_v<decltype(res2.first.position), const char*>);
+    REQUIRE(*res2.second == "abc");
+    REQUIRE(res2.first.position == vec.data() + 5);
+
+    // Other sequences are parsed through their iterators
+    std::list<char> list(str.begin(), str.end());
+    auto res3 = until_item<','>().parse(list);
+    static_assert(std::is_same_v<decltype(res3.first.position), std::list<char>::const_iterator>);
+    REQUIRE(res3.second);
+
+    // The fast paths give the same results at compile time
+    constexpr std::string_view view("abc,def,,ghi");
+    static_assert(*until_item<','>().parse(view).second == "abc");
+    static_assert(!until_item<';'>().parse(view).second);
+    static_assert(*until_seq(",,").parse(view).second == "abc,def");
+    static_assert(!until_seq(",,,").parse(view).second);
+    REQUIRE(*until_seq(",,").parse(std::string(view)).second == "abc,def");
+    REQUIRE(!until_seq(",,,").parse(std::string(view)).second);
+    REQUIRE(!until_seq("hij").parse(std::string(view)).second);
+}
+
+TEST_CASE("padded input") {
+    padded_string str("true,tr");
+    REQUIRE(str.size() == 7);
+    REQUIRE(std::string_view(str.end(), input_padding) == std::string_view(std::string(input_padding, '\0')));
+
+    // Literals may be compared past the end, but never match the padding
+    auto literal = seq<'t','r','u','e'>();
+    auto res1 = literal.parse<padded_parser_settings>(str);
+    REQUIRE(res1.second);
+    REQUIRE(res1.first.position == str.begin() + 4);
+    auto res2 = literal.parse<padded_parser_settings>(str.begin() + 5, str.end());
+    REQUIRE(!res2.second);
+    REQUIRE(res2.first.position == str.begin() + 5);
+
+    // Scans stop at the end
+    auto letters = while_if([](char c) { return c >= 'a' && c <= 'z'; });
+    auto res3 = letters.parse<padded_parser_settings>(str.begin() + 5, str.end());
+    REQUIRE(*res3.second == "tr");
+    REQUIRE(res3.first.position == str.end());
+    auto res4 = many(item_if([](char c) { return c != ','; })).parse<padded_parser_settings>(str.begin() + 5, str.end());
+    REQUIRE(*res4.second == "tr");
+    auto res5 = regex<identifier_pattern>().parse<padded_parser_settings>(str.begin() + 5, str.end());
+    REQUIRE(*res5.second == "tr");
+
+    // Predicates that accept the padding check for the end
+    auto res6 = while_if<options::negate>([](char c) { return c == ','; }).parse<padded_parser_settings>(str.begin() + 5, str.end());
+    REQUIRE(*res6.second == "tr");
+    REQUIRE(res6.first.position == str.end());
+    REQUIRE(!item_if([](char) { return true; }).parse<padded_parser_settings>(str.end(), str.end()).second);
+
+    // A part of the input is followed by the rest of the input, so its parses check for the end
+    padded_string abc("abc");
+    REQUIRE(!parse_result(consume<2>(), seq<'a','b','c'>()).parse<padded_parser_settings>(abc).second);
+    REQUIRE(!parse_result(consume<2>(), item<'a'>() >> item<'b'>() >> item<'c'>()).parse<padded_parser_settings>(abc).second);
+    REQUIRE(*parse_result(consume<2>(), regex<identifier_pattern>()).parse<padded_parser_settings>(abc).second == "ab");
+    padded_string keyword("else");
+    REQUIRE(!parse_result(consume<3>(), regex<keyword_pattern>()).parse<padded_parser_settings>(keyword).second);
+    REQUIRE(parse_result<padded_parser_settings>(consume<2>(), seq<'a','b'>()).parse<padded_parser_settings>(abc).second);
+    REQUIRE(!parse_result<padded_parser_settings>(consume<2>(), seq<'a','b','c'>()).parse(abc).second);
+}
+
+// The offsets of the structural items of `str` for JSON, found one item at a time
+static std::vector<uint32_t> structural_offsets(std::string_view str) {
+    std::vector<uint32_t> offsets;
+    bool in_string = false;
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (in_string && str[i] == '\\') {
+            ++i;
+        } else if (str[i] == '"') {
+            in_string = !in_string;
+            offsets.push_back(uint32_t(i));
+        } else if (!in_string && std::string_view("{}[]:,").find(str[i]) != std::string_view::npos) {
+            offsets.push_back(uint32_t(i));
+        }
+    }
+    return offsets;
+}
+
+TEST_CASE("structural index") {
+    std::string str = R"({"a": [1, "b,]", "c\"]", "\\", {"d\\\"": [] }]})";
+    REQUIRE(structural_index(str).offsets() == structural_offsets(str));
+
+    // Escapes and strings that cross blocks (escapes are only expected in strings)
+    for (size_t shift = 0; shift < 70; ++shift) {
+        std::string shifted = std::string(shift, ' ') + R"([", \\\"\\", ":{]", "\\\\", 1] , {"x": "{" })" + std::string(shift, ' ');
+        shifted += "[\"" + std::string(shift * 3, ',') + "\", \"" + std::string(shift, '\\') + "\"]\"]";
+        REQUIRE(structural_index(shifted).offsets() == structural_offsets(shifted));
+    }
+
+    structural_index index(str);
+    REQUIRE(index.next(str.data() + 7) == str.data() + 8);
+    REQUIRE(index.next(str.data() + 2) == str.data() + 3);
+    REQUIRE(index.next(str.data() + str.size()) == str.data() + str.size());
+    REQUIRE(index.matching(str.data() + 6, '[', ']') == str.data() + str.size() - 2);
+
+    auto res1 = between_structural<'[', ']'>().parse_with_state(std::string_view(str).substr(6), index);
+    REQUIRE(res1.second);
+    REQUIRE(*res1.second == std::string_view(str).substr(7, str.size() - 9));
+    REQUIRE(res1.first.position == str.data() + str.size() - 1);
+
+    auto res2 = (item<'{'>() >> until_structural<','>()).parse_with_state(str, index);
+    REQUIRE(*res2.second == R"("a": [1)");
+    auto res3 = until_structural<']', options::dont_eat>().parse_with_state(res2.first.position, std::string_view(str).end(), index);
+    REQUIRE(*res3.second == R"( "b,]", "c\"]", "\\", {"d\\\"": [)");
+    REQUIRE(!until_structural<'x'>().parse_with_state(str, index).second);
+    REQUIRE(!between_structural<'{', '}'>().parse_with_state(std::string_view(str).substr(1), index).second);
+}
+
+TEST_CASE("parse records parallel") {
+    std::string buffer;
+    constexpr int records = 100000;
+    for (int i = 0; i < records; ++i) {
+        buffer += i % 1000 == 999 ? "x" : std::to_string(i);
+        buffer += '\n';
+    }
+
+    constexpr auto p = apply_to_state([](auto& v, int i) { v.push_back(i); }, integer());
+    for (size_t threads : {1, 3, 8}) {
+        std::vector<int> values;
+        size_t states = 0;
+        auto res = parse_records_parallel(p, buffer, '\n', []() { return std::vector<int>(); },
+                                          [&](std::vector<int>&& v) {
+            values.insert(values.end(), v.begin(), v.end());
+            ++states;
+        }, threads);
+        REQUIRE(res.records == records);
+        REQUIRE(res.failed == records / 1000);
+        REQUIRE(values.size() == records - records / 1000);
+        REQUIRE(std::is_sorted(values.begin(), values.end()));
+        REQUIRE(states >= threads);
+    }
+
+    // Without a trailing delimiter, and without records
+    auto count = [](std::string_view str) {
+        return parse_records_parallel(empty(), str, ';', []() { return 0; }, [](int) {}).records;
+    };
+    REQUIRE(count("a;b;c") == 3);
+    REQUIRE(count("a;;c;") == 3);
+    REQUIRE(count("") == 0);
+
+    // Exceptions of the parsers are rethrown
+    auto throwing = custom([](auto begin, auto) -> std::pair<decltype(begin), std::optional<int>> {
+        if (*begin == 'x') throw std::runtime_error("x");
+        return {begin, 0};
+    });
+    REQUIRE_THROWS_AS(parse_records_parallel(throwing, buffer, '\n', []() { return 0; }, [](int) {}, 4),
+                      std::runtime_error);
+}
+
+TEST_CASE("parse batch") {
+    // Inputs of very uneven sizes
+    std::vector<std::string> inputs;
+    for (int i = 0; i < 5000; ++i) {
+        inputs.push_back(i % 997 == 0 ? std::string(200000, 'a') + "1" : std::to_string(i));
+    }
+    inputs.push_back("x");
+
+    constexpr auto p = while_if([](char c) { return c == 'a'; }) >> integer();
+    for (size_t threads : {1, 4}) {
+        work_stealing_pool pool(threads);
+        REQUIRE(pool.size() == threads);
+
+        using result_type = decltype(p.parse(inputs[0]).second);
+        std::vector<result_type> results(inputs.size());
+        for (int batch = 0; batch < 3; ++batch) {
+            std::fill(results.begin(), results.end(), result_type());
+            parse_batch(p, inputs, results.begin(), pool);
+            for (size_t i = 0; i + 1 < inputs.size(); ++i) {
+                if (!results[i] || *results[i] != (i % 997 == 0 ? 1 : int(i))) FAIL("Wrong result for input " << i);
+            }
+            REQUIRE(!results.back());
+        }
+
+        // Every worker has its own state, which is reused across batches
+        constexpr auto counting = apply_to_state([](size_t& count, int i) { ++count; return i; }, integer());
+        std::vector<size_t> counts(pool.size());
+        std::vector<decltype(counting.parse_with_state(inputs[0], counts[0]).second)> counting_results(inputs.size());
+        parse_batch_with_state(counting, inputs, counting_results.begin(), counts, pool);
+        parse_batch_with_state(counting, inputs, counting_results.begin(), counts, pool);
+        REQUIRE(std::accumulate(counts.begin(), counts.end(), size_t(0)) == 2 * (inputs.size() - 1 - 6));
+
+        std::vector<result_type> none;
+        parse_batch(p, std::vector<std::string>(), none.begin(), pool);
+
+        auto throwing = custom([](auto begin, auto) -> std::pair<decltype(begin), std::optional<int>> {
+            if (*begin == 'x') throw std::runtime_error("x");
+            return {begin, 0};
+        });
+        std::vector<decltype(throwing.parse(inputs[0]).second)> throwing_results(inputs.size());
+        REQUIRE_THROWS_AS(parse_batch(throwing, inputs, throwing_results.begin(), pool), std::runtime_error);
+        parse_batch(p, inputs, results.begin(), pool);
+        REQUIRE(results[1]);
+    }
+}
+
+TEST_CASE("parse pipeline") {
+    std::string input;
+    constexpr int records = 20000;
+    for (int i = 0; i < records; ++i) {
+        input += i % 1000 == 999 ? "x" : std::to_string(i);
+        input += '\n';
+    }
+    // A record that is larger than the buffers, without a trailing delimiter
+    input += std::string(5000, '7');
+
+    // Reads at most `max_read` items at a time, like a pipe
+    auto reader = [&input](size_t max_read) {
+        return [&input, max_read, offset = size_t(0)](char* data, size_t size) mutable {
+            auto n = std::min({size, max_read, input.size() - offset});
+            std::copy_n(input.data() + offset, n, data);
+            offset += n;
+            return n;
+        };
+    };
+
+    constexpr auto p = apply_to_state([](auto& v, std::string_view s) { v.push_back(s); },
+                                      while_if<options::fail_on_no_parse>([](char c) { return c >= '0' && c <= '9'; }));
+    for (size_t parsers : {1, 3}) {
+        for (bool ordered : {true, false}) {
+            for (size_t max_read : {size_t(100), size_t(1) << 20}) {
+                pipeline_config config;
+                config.buffer_size = 1024;
+                config.buffers = 4;
+                config.parsers = parsers;
+                config.ordered = ordered;
+
+                std::vector<std::string> values;
+                size_t states = 0;
+                auto stats = parse_pipeline(p, reader(max_read), '\n', []() { return std::vector<std::string_view>(); },
+                                            [&](std::vector<std::string_view>&& v) {
+                    values.insert(values.end(), v.begin(), v.end());
+                    ++states;
+                }, config);
+                REQUIRE(stats.records == records + 1);
+                REQUIRE(stats.failed == records / 1000);
+                REQUIRE(stats.bytes == input.size());
+                REQUIRE(stats.chunks == states);
+                REQUIRE(stats.chunks > 1);
+                REQUIRE(stats.max_parse_queue_depth <= config.buffers);
+                REQUIRE(values.size() == records + 1 - records / 1000);
+                REQUIRE(values.back() == std::string(5000, '7'));
+                if (ordered) {
+                    REQUIRE(std::is_sorted(values.begin(), values.end() - 1, [](auto& a, auto& b) {
+                        return std::stoi(a) < std::stoi(b);
+                    }));
+                }
+            }
+        }
+    }
+
+    // Without a trailing delimiter, and without records
+    auto count = [](std::string str) {
+        size_t offset = 0;
+        auto read = [&](char* data, size_t size) {
+            auto n = std::min(size, str.size() - offset);
+            std::copy_n(str.data() + offset, n, data);
+            offset += n;
+            return n;
+        };
+        return parse_pipeline(empty(), read, ';', []() { return 0; }, [](int) {}).records;
+    };
+    REQUIRE(count("a;b;c") == 3);
+    REQUIRE(count("a;;c;") == 3);
+    REQUIRE(count("") == 0);
+
+    // Exceptions of the parsers and the consumer are rethrown
+    auto throwing = custom([](auto begin, auto) -> std::pair<decltype(begin), std::optional<int>> {
+        if (*begin == 'x') throw std::runtime_error("x");
+        return {begin, 0};
+    });
+    pipeline_config config;
+    config.buffer_size = 1024;
+    config.parsers = 2;
+    REQUIRE_THROWS_AS(parse_pipeline(throwing, reader(size_t(1) << 20), '\n', []() { return 0; }, [](int) {}, config),
+                      std::runtime_error);
+    REQUIRE_THROWS_AS(parse_pipeline(empty(), reader(size_t(1) << 20), '\n', []() { return 0; },
+                                     [](int) { throw std::logic_error("consumer"); }, config),
+                      std::logic_error);
+}
@@ -1,9 +1,13 @@
+#include <cstdio>
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <streambuf>
 #include <memory>
 #include <variant>
+#include <array>
+#include <optional>
+#include <thread>
 #include <catch2/catch.hpp>
 #include "anpa/anpa.h"
 #include "time_measure.h"
@@ -48,8 +52,7 @@ syntax_error
  * This parser uses an external state and is invoked on each line of input.
  *
  */
-void test()
-{
+constexpr auto hub_entry_parser() {
     using namespace anpa;
 
     constexpr auto add_to_state = [](auto& s, auto&& arg) {
@@ -64,7 +67,12 @@ void test()
     constexpr auto parse_space = seq("Space") >> mreturn_emplace<space>();
     constexpr auto parse_error = lift_value<syntax_error>(rest());
     constexpr auto ignore = empty() || (item('#') >> rest());
-    constexpr auto entry_parser = ignore || lift_or_state(add_to_state, parse_action, parse_info, parse_separator, parse_space, parse_error);
+    return ignore || lift_or_state(add_to_state, parse_action, parse_info, parse_separator, parse_space, parse_error);
+}
+
+void test()
+{
+    constexpr auto entry_parser = hub_entry_parser();
 
     std::ifstream t("hub");
 
@@ -91,3 +99,298 @@ void test()
 TEST_CASE("performance") {
     test();
 }
+
+TEST_CASE("performance hub parallel") {
+    using namespace anpa;
+    constexpr auto entry_parser = hub_entry_parser();
+
+    std::ifstream t("hub");
+    std::string buffer((std::istreambuf_iterator<char>(t)),
+                       std::istreambuf_iterator<char>());
+
+    auto parse = [&](size_t threads) {
+        std::vector<entry> entries;
+        auto result = parse_records_parallel(entry_parser, buffer, '\n',
+            []() { return std::vector<entry>(); },
+            [&entries](std::vector<entry>&& chunk) {
+                entries.insert(entries.end(), std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end()));
+            }, threads);
+        REQUIRE(result.failed == 0);
+        return entries;
+    };
+
+    std::vector<entry> sequential;
+    {
+        TICK;
+        sequential = parse(1);
+        TOCK("hub parallel, 1 thread");
+    }
+    std::vector<entry> parallel;
+    auto threads = std::max(4u, std::thread::hardware_concurrency());
+    {
+        TICK;
+        parallel = parse(threads);
+        TOCK("hub parallel, " << threads << " threads");
+    }
+    REQUIRE(parallel.size() == sequential.size());
+    REQUIRE(std::equal(parallel.begin(), parallel.end(), sequential.begin(), [](const auto& e1, const auto& e2) {
+        return e1.index() == e2.index();
+    }));
+}
+
+/**
+ * Performance test for the pipeline, which reads the hub file while it is parsed.
+ * The entries refer to the buffers of the pipeline, so they are only counted.
+ */
+TEST_CASE("performance hub pipeline") {
+    using namespace anpa;
+    constexpr auto entry_parser = hub_entry_parser();
+
+    std::ifstream t("hub");
+    std::string buffer((std::istreambuf_iterator<char>(t)),
+                       std::istreambuf_iterator<char>());
+    std::vector<size_t> expected(4);
+    parse_records_parallel(entry_parser, buffer, '\n', []() { return std::vector<entry>(); },
+                           [&expected](std::vector<entry>&& chunk) {
+        for (auto& e : chunk) ++expected[e.index()];
+    }, 1);
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(std::fopen("hub", "rb"), &std::fclose);
+    REQUIRE(file);
+    std::vector<size_t> counts(4);
+    pipeline_config config;
+    config.parsers = std::max(2u, std::thread::hardware_concurrency());
+    TICK;
+    auto stats = parse_pipeline(entry_parser, file_reader(file.get()), '\n', []() { return std::vector<entry>(); },
+                                [&counts](std::vector<entry>&& chunk) {
+        for (auto& e : chunk) ++counts[e.index()];
+    }, config);
+    auto reader_stall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stats.reader_stall).count();
+    TOCK("hub pipeline, " << config.parsers << " parsers, " << stats.bytes_per_second() / 1e6 << " MB/s, "
+         << "max queue depth " << stats.max_parse_queue_depth << ", reader stall " << reader_stall_ms << " ms");
+    REQUIRE(stats.failed == 0);
+    REQUIRE(stats.bytes == buffer.size());
+    REQUIRE(counts == expected);
+}
+
+/**
+ * Performance test for parsers with large captures.
+ *
+ * The input is a sequence of tokens (strings), and the parsers compare against
+ * long strings and a lookup table that are captured by value. Parsers are applied
+ * by reference, so none of the captures should be copied during the parse.
+ */
+TEST_CASE("performance large captures") {
+    using namespace anpa;
+
+    const std::string keyword1(128, 'a');
+    const std::string keyword2(128, 'b');
+
+    std::array<bool, 256> table{};
+    table['c'] = true;
+
+    auto table_parser = custom([table](auto begin, auto end) {
+        using type = std::pair<decltype(begin), std::optional<bool>>;
+        if (begin != end && !begin->empty() && table[static_cast<unsigned char>(begin->front())]) {
+            return type(std::next(begin), true);
+        }
+        return type(begin, {});
+    });
+
+    auto token_parser = many(item(keyword1) || item(keyword2) || table_parser);
+
+    std::vector<std::string> tokens;
+    tokens.reserve(300000);
+    for (size_t i = 0; i < 100000; ++i) {
+        tokens.push_back(keyword1);
+        tokens.push_back(keyword2);
+        tokens.push_back("c");
+    }
+
+    TICK;
+    auto res = token_parser.parse(tokens);
+    TOCK("large captures");
+
+    REQUIRE(res.second);
+    REQUIRE(res.second->length() == tokens.size());
+}
+
+/**
+ * Performance test for alternatives selected by their first item.
+ *
+ * The input is a sequence of keywords. The same alternatives are tried in order,
+ * and then dispatched on a table built from the first items of the alternatives.
+ * For the alternatives to be tried in order, each is hidden in a parser without
+ * a first set.
+ */
+TEST_CASE("performance dispatch") {
+    using namespace anpa;
+
+    constexpr auto keyword_grammar = [](auto wrap) {
+        return lift_or_value<int>(wrap(seq<'i','f'>() >> mreturn<1>()),
+                                  wrap(seq<'e','l','s','e'>() >> mreturn<2>()),
+                                  wrap(seq<'w','h','i','l','e'>() >> mreturn<3>()),
+                                  wrap(seq<'f','o','r'>() >> mreturn<4>()),
+                                  wrap(seq<'r','e','t','u','r','n'>() >> mreturn<5>()),
+                                  wrap(seq<'b','r','e','a','k'>() >> mreturn<6>()),
+                                  wrap(seq<'c','o','n','t','i','n','u','e'>() >> mreturn<7>()),
+                                  wrap(seq<'s','w','i','t','c','h'>() >> mreturn<8>()));
+    };
+
+    constexpr auto in_order = keyword_grammar([](auto p) {
+        return parser([p](auto& s) { return apply(p, s); });
+    });
+    constexpr auto dispatched = keyword_grammar([](auto p) { return p; });
+    static_assert(internal::first_set_v<decltype(in_order)>.is_unknown());
+    static_assert(!internal::first_set_v<decltype(dispatched)>.is_unknown());
+
+    std::string input;
+    const char* keywords[] = {"if ", "else ", "while ", "for ", "return ", "break ", "continue ", "switch "};
+    for (size_t i = 0; i < 400000; ++i) {
+        input += keywords[(i * 7) % 8];
+    }
+
+    auto count = [](auto p) {
+        return fold([](int& sum, int i) { sum += i; }, 0, item<' '>(), p);
+    };
+
+    int sum_in_order = 0;
+    int sum_dispatched = 0;
+    {
+        TICK;
+        sum_in_order = *count(in_order).parse(input).second;
+        TOCK("alternatives in order");
+    }
+    {
+        TICK;
+        sum_dispatched = *count(dispatched).parse(input).second;
+        TOCK("alternatives dispatched");
+    }
+    REQUIRE(sum_in_order == 1800000);
+    REQUIRE(sum_dispatched == sum_in_order);
+}
+
+namespace {
+constexpr char identifier_pattern[] = "[A-Za-z_][A-Za-z0-9_]*";
+}
+
+/**
+ * Performance test for a regular expression compared to the equivalent
+ * combinator expression.
+ *
+ * The input is a sequence of identifiers separated by spaces.
+ */
+TEST_CASE("performance regex") {
+    using namespace anpa;
+
+    constexpr auto first = [](const auto& c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; };
+    constexpr auto rest = [](const auto& c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'; };
+
+    constexpr auto combinators = get_parsed(item_if(first), many(item_if(rest)));
+    constexpr auto compiled = regex<identifier_pattern>();
+
+    std::string input;
+    const char* identifiers[] = {"foo ", "bar_12 ", "_tmp ", "someLongerIdentifier ", "x ", "CamelCase99 "};
+    for (size_t i = 0; i < 400000; ++i) {
+        input += identifiers[(i * 5) % 6];
+    }
+
+    auto count = [](auto p) {
+        return fold([](size_t& sum, auto r) { sum += static_cast<size_t>(std::distance(r.begin(), r.end())); }, size_t(0), item<' '>(), p);
+    };
+
+    size_t size_combinators = 0;
+    size_t size_regex = 0;
+    {
+        TICK;
+        size_combinators = *count(combinators).parse(input).second;
+        TOCK("identifiers with combinators");
+    }
+    {
+        TICK;
+        size_regex = *count(compiled).parse(input).second;
+        TOCK("identifiers with regex");
+    }
+    REQUIRE(size_combinators == input.size() - 400000);
+    REQUIRE(size_regex == size_combinators);
+}
+
+/**
+ * Performance test for the cost of a rule boundary.
+ *
+ * The input is a sequence of integers separated by spaces, parsed once with
+ * the integer parser directly and once through a rule, so that the difference
+ * is the cost of one indirect call per integer.
+ */
+TEST_CASE("performance rule") {
+    using namespace anpa;
+
+    constexpr size_t count = 1000000;
+    std::string input;
+    for (size_t i = 0; i < count; ++i) {
+        input += std::to_string(i % 1000) + ' ';
+    }
+    std::string_view view(input);
+
+    constexpr auto direct = integer();
+    rule<const char*, int> erased = integer();
+
+    auto sum = [](auto p) {
+        return fold([](long& sum, int i) { sum += i; }, 0L, item<' '>(), p);
+    };
+
+    long sum_direct = 0;
+    long sum_rule = 0;
+    double ms_direct = 0;
+    double ms_rule = 0;
+    {
+        TICK;
+        sum_direct = *sum(direct).parse(view).second;
+        TOCK("integers");
+        ms_direct = fp_ms.count();
+    }
+    {
+        TICK;
+        sum_rule = *sum(erased.ref()).parse(view).second;
+        TOCK("integers through a rule");
+        ms_rule = fp_ms.count();
+    }
+    std::cout << "Cost per rule boundary: " << (ms_rule - ms_direct) * 1e6 / count << " ns" << std::endl;
+    REQUIRE(sum_direct == 499500L * (count / 1000));
+    REQUIRE(sum_rule == sum_direct);
+}
+
+/**
+ * Performance test for contiguous input.
+ *
+ * The input is a sequence of lines. A `std::string` is parsed through pointers,
+ * so that searching for the end of a line uses `memchr`, while parsing its
+ * iterators searches item by item.
+ */
+TEST_CASE("performance contiguous input") {
+    using namespace anpa;
+
+    std::string input;
+    const char* lines[] = {"short\n", "a somewhat longer line of text\n", "\n",
+                           "key = value, another_key = another value, and some more text\n"};
+    for (size_t i = 0; i < 400000; ++i) {
+        input += lines[(i * 3) % 4];
+    }
+
+    constexpr auto line_count = fold([](size_t& count, auto) { ++count; }, size_t(0), {}, until_item<'\n'>());
+
+    size_t count_iterators = 0;
+    size_t count_pointers = 0;
+    {
+        TICK;
+        count_iterators = *line_count.parse(input.cbegin(), input.cend()).second;
+        TOCK("lines with iterators");
+    }
+    {
+        TICK;
+        count_pointers = *line_count.parse(input).second;
+        TOCK("lines with pointers");
+    }
+    REQUIRE(count_iterators == 400000);
+    REQUIRE(count_pointers == count_iterators);
+}